@@ -0,0 +1,91 @@
+#include "common.h"
+
+#ifdef CRS_COUNT_ALLOCATIONS
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Heap allocations made by the calling thread. Counting replaces the global operator new
+// and delete, so it is only built into `make bench` (server-bench), where the benchmarks
+// report allocations per operation and metrics per request; the server keeps the
+// library's allocator.
+static thread_local uint64_t threadAllocations = 0;
+
+bool allocationsCounted() { return true; }
+
+uint64_t allocationCount() { return threadAllocations; }
+
+// not inlined, so callers see a matching operator new / delete pair rather than malloc
+// and free
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+NOINLINE void *operator new(std::size_t size)
+{
+    threadAllocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+NOINLINE void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    threadAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+// over-aligned types (alignas above 16, like the profile shards) come here
+static void *alignedAlloc(std::size_t size, std::align_val_t alignment) noexcept
+{
+    threadAllocations++;
+    const std::size_t a = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, a);
+#else
+    // aligned_alloc wants a non-zero multiple of the alignment
+    return std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a);
+#endif
+}
+
+static void alignedFree(void *p) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+NOINLINE void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *p = alignedAlloc(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+NOINLINE void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return alignedAlloc(size, alignment);
+}
+
+// the array forms forward to these
+NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+NOINLINE void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+NOINLINE void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+NOINLINE void operator delete(void *p, std::align_val_t) noexcept { alignedFree(p); }
+NOINLINE void operator delete(void *p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+NOINLINE void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { alignedFree(p); }
+
+#undef NOINLINE
+
+#else
+
+bool allocationsCounted() { return false; }
+
+uint64_t allocationCount() { return 0; }
+
+#endif
@@ -0,0 +1,1472 @@
+#include "bench.h"
+
+// random tickers shaped like the built-in data, for benchmarks; strings live in `strings`
+static std::vector<Asset> syntheticAssets(size_t n, unsigned seed, StringArena &strings)
+{
+    static const char *syllables[] = {"bit", "eth", "coin", "sol", "ana", "chain", "link", "lite", "doge",
+                                      "net", "meta", "corp", "tech", "gen", "fin", "nova", "star", "ium"};
+    static const char *categories[] = {"layer1", "defi", "ai", "meme", "gaming", "tech", "media", "storage",
+                                       "financial", "healthcare", "energy", "industrial", "consumer", "retail"};
+    std::mt19937 rng(seed);
+    std::vector<Asset> out;
+    out.reserve(n);
+    std::string name, symbol;
+    for (size_t i = 0; i < n; i++)
+    {
+        Asset a;
+        name.clear();
+        symbol.clear();
+        int parts = 2 + static_cast<int>(rng() % 3);
+        for (int p = 0; p < parts; p++)
+            name += syllables[rng() % (sizeof(syllables) / sizeof(*syllables))];
+        name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+        name += " " + std::to_string(i);
+        for (int c = 0; c < 3 + static_cast<int>(rng() % 3); c++)
+            symbol += static_cast<char>('A' + rng() % 26);
+        a.name = strings.add(name);
+        a.symbol = strings.add(symbol);
+        a.category = categories[rng() % (sizeof(categories) / sizeof(*categories))];
+        a.type = (rng() % 2) ? "crypto" : "stock";
+        a.price = 0.01 + (rng() % 1000000) / 100.0;
+        a.change = (static_cast<int>(rng() % 2001) - 1000) / 100.0;
+        a.marketCap = static_cast<long long>(rng() % 1000000) * 1000000LL;
+        a.score = 60 + static_cast<int>(rng() % 40);
+        out.push_back(std::move(a));
+    }
+    return out;
+}
+
+template <class Fn>
+static double nsPerOp(size_t ops, Fn &&fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(ops);
+}
+
+// heap allocations fn makes on this thread, per op
+template <class Fn>
+static double allocsPerOp(size_t ops, Fn &&fn)
+{
+    uint64_t before = allocationCount();
+    fn();
+    return static_cast<double>(allocationCount() - before) / static_cast<double>(ops);
+}
+
+// named benchmark results, written by --bench-out as one flat JSON object so the runs
+// of two builds can be diffed
+static std::vector<std::pair<std::string, double>> &benchResults()
+{
+    static std::vector<std::pair<std::string, double>> results;
+    return results;
+}
+
+static void record(std::string name, double value)
+{
+    benchResults().emplace_back(std::move(name), value);
+}
+
+bool writeResults(const std::string &path, const char *mode)
+{
+    std::string out = "{\"mode\":";
+    appendString(out, mode);
+    out += ",\"simd\":";
+    appendString(out, kernels::variant());
+    out += ",\"results\":{";
+    for (size_t i = 0; i < benchResults().size(); i++)
+    {
+        out += i ? ",\n" : "\n";
+        appendString(out, benchResults()[i].first);
+        out += ':';
+        appendNumber(out, benchResults()[i].second);
+    }
+    out += "\n}}\n";
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    bool ok = f && std::fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (f)
+        ok = std::fclose(f) == 0 && ok;
+    if (!ok)
+        std::cerr << "Cannot write " << path << "\n";
+    return ok;
+}
+
+// Latency histogram in the manner of HdrHistogram: each power of two of nanoseconds is
+// split into kSub / 2 linear buckets, so a reported percentile is within 1/1024 of the
+// recorded value (3 significant digits) from 1 ns to over an hour, in fixed memory.
+class LatencyHistogram
+{
+    static constexpr int kSubBits = 11;
+    static constexpr uint64_t kSub = uint64_t(1) << kSubBits;
+    static constexpr int kMaxBits = 42;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>(kSub + (kMaxBits - kSubBits) * kSub / 2);
+    uint64_t total = 0, largest = 0;
+    double sum = 0;
+
+    static int topBit(uint64_t v)
+    {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(v);
+#else
+        int b = 0;
+        while (v >>= 1)
+            b++;
+        return b;
+#endif
+    }
+
+    static size_t index(uint64_t v)
+    {
+        if (v < kSub)
+            return static_cast<size_t>(v);
+        int shift = topBit(v) - kSubBits + 1;
+        return static_cast<size_t>(kSub + static_cast<uint64_t>(shift - 1) * (kSub / 2) + ((v >> shift) - kSub / 2));
+    }
+
+    // largest value that lands in bucket i
+    static uint64_t highest(size_t i)
+    {
+        if (i < kSub)
+            return i;
+        uint64_t shift = (i - kSub) / (kSub / 2) + 1, sub = (i - kSub) % (kSub / 2) + kSub / 2;
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+    void record(uint64_t ns)
+    {
+        ns = std::min(ns, (uint64_t(1) << kMaxBits) - 1);
+        counts[index(ns)]++;
+        total++;
+        largest = std::max(largest, ns);
+        sum += static_cast<double>(ns);
+    }
+
+    void merge(const LatencyHistogram &o)
+    {
+        for (size_t i = 0; i < counts.size(); i++)
+            counts[i] += o.counts[i];
+        total += o.total;
+        largest = std::max(largest, o.largest);
+        sum += o.sum;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return largest; }
+    double mean() const { return total ? sum / static_cast<double>(total) : 0; }
+
+    // the value at or below which a fraction p of the samples fall; p in [0, 1]
+    uint64_t percentile(double p) const
+    {
+        uint64_t want = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size() && total; i++)
+            if ((seen += counts[i]) >= want)
+                return std::min(highest(i), largest);
+        return largest;
+    }
+};
+
+static void benchTrie()
+{
+    const size_t n = 50000;
+    StringArena strings;
+    auto assets = syntheticAssets(n, 42, strings);
+    Interner types;
+    for (auto &a : assets)
+        a.typeId = types.intern(a.type);
+    const int crypto = types.find("crypto");
+    Trie trie([](const Asset &a) { return static_cast<double>(a.score); });
+    double insertNs = nsPerOp(n * 3, [&]
+                              {
+                                  for (auto &a : assets)
+                                  {
+                                      trie.insert(a.name, &a);
+                                      trie.insert(a.symbol, &a);
+                                      trie.insert(a.category, &a);
+                                  }
+                                  trie.build();
+                              });
+
+    std::vector<std::string> prefixes;
+    std::vector<Asset *> picks;
+    for (size_t i = 0; i < 4096; i++)
+    {
+        const Asset &a = assets[(i * 7919) % n];
+        std::string_view key = (i % 2) ? a.name : a.symbol;
+        prefixes.emplace_back(key.substr(0, 1 + i % std::min<size_t>(key.size(), 6)));
+    }
+    size_t sink = 0;
+    const size_t rounds = 50;
+    double searchNs = nsPerOp(rounds * prefixes.size(), [&]
+                              {
+                                  for (size_t r = 0; r < rounds; r++)
+                                      for (auto &p : prefixes)
+                                          sink += trie.search(p, 200).size();
+                              });
+    double topNs = nsPerOp(rounds * prefixes.size(), [&]
+                           {
+                               for (size_t r = 0; r < rounds; r++)
+                                   for (size_t i = 0; i < prefixes.size(); i++)
+                                   {
+                                       trie.top(prefixes[i], 50, (i % 3) ? Trie::kAnyType : crypto, picks);
+                                       sink += picks.size();
+                                   }
+                           });
+
+    record("trie.bytes", static_cast<double>(trie.memoryBytes()));
+    record("trie.insert_build_ns", insertNs);
+    record("trie.search_ns", searchNs);
+    record("trie.top_ns", topNs);
+    std::cout << "trie: " << n << " assets, " << trie.nodeCount() << " nodes, "
+              << trie.memoryBytes() / 1024 << " KiB\n"
+              << "trie insert+build: " << insertNs << " ns/key\n"
+              << "trie search(prefix, 200): " << searchNs << " ns/op\n"
+              << "trie top(prefix, 50, type): " << topNs << " ns/op (" << sink << ")\n";
+}
+
+// p in [0, 1]; sorts v
+static double percentile(std::vector<double> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * static_cast<double>(v.size())))];
+}
+
+// search/recommend latency on reader threads, first idle, then while a feed submits ticks
+static void benchTicks()
+{
+    const int readers = std::max(1, std::min(4, static_cast<int>(std::thread::hardware_concurrency()) - 2));
+    const double ticksPerSecond = 100000;
+    const auto phase = std::chrono::seconds(1);
+    InvestmentSystem system;
+    std::vector<std::string> symbols = system.symbols();
+
+    auto measure = [&](bool feed)
+    {
+        std::atomic<bool> done{false};
+        std::vector<std::vector<double>> latencies(readers);
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++)
+            threads.emplace_back([&, r]
+                                 {
+                                     std::mt19937 rng(static_cast<unsigned>(r));
+                                     std::string out, prefix;
+                                     while (!done.load(std::memory_order_relaxed))
+                                     {
+                                         const std::string &sym = symbols[rng() % symbols.size()];
+                                         prefix.assign(sym, 0, 1 + rng() % 2);
+                                         out.clear();
+                                         auto t0 = std::chrono::steady_clock::now();
+                                         if (rng() % 4)
+                                             system.searchJSON(prefix, "", false, out);
+                                         else
+                                             system.getRecommendationsJSON("crypto", "", out);
+                                         auto t1 = std::chrono::steady_clock::now();
+                                         latencies[r].push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+                                     }
+                                 });
+
+        uint64_t ticksBefore = system.tickCount(), batchesBefore = system.batchCount();
+        auto start = std::chrono::steady_clock::now();
+        if (feed)
+        {
+            // 1 ms slices of ticksPerSecond / 1000 random price moves
+            std::mt19937 rng(7);
+            auto next = start;
+            while (next - start < phase)
+            {
+                std::vector<Tick> ticks(static_cast<size_t>(ticksPerSecond / 1000));
+                for (auto &t : ticks)
+                {
+                    t.symbol = symbols[rng() % symbols.size()];
+                    t.price = 1 + (rng() % 100000) / 10.0;
+                }
+                system.submitTicks(std::move(ticks));
+                next += std::chrono::milliseconds(1);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        else
+            std::this_thread::sleep_for(phase);
+        done = true;
+        for (auto &t : threads)
+            t.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        for (auto &l : latencies)
+            all.insert(all.end(), l.begin(), l.end());
+        size_t reads = all.size();
+        double p50 = percentile(all, 0.5), p99 = percentile(all, 0.99), p999 = percentile(all, 0.999);
+        std::string name = feed ? "ticks.feed." : "ticks.idle.";
+        record(name + "reads_per_s", static_cast<double>(reads) / seconds);
+        record(name + "p50_us", p50);
+        record(name + "p99_us", p99);
+        record(name + "p999_us", p999);
+        std::cout << (feed ? "reads with ticks: " : "reads idle:       ") << readers << " threads, "
+                  << static_cast<long long>(static_cast<double>(reads) / seconds) << " reads/s, p50 " << p50
+                  << " us, p99 " << p99 << " us, p99.9 " << p999 << " us, max " << all.back() << " us";
+        if (feed)
+            std::cout << "; " << static_cast<long long>(static_cast<double>(system.tickCount() - ticksBefore) / seconds)
+                      << " ticks/s applied in " << system.batchCount() - batchesBefore << " snapshots";
+        std::cout << "\n";
+    };
+    measure(false);
+    measure(true);
+}
+
+static void writeCSV(const std::string &path, const std::vector<Asset> &assets)
+{
+    if (std::FILE *f = std::fopen(path.c_str(), "wb"))
+    {
+        std::fputs("name,symbol,category,type,price,change,marketCap,score\n", f);
+        for (auto &a : assets)
+            std::fprintf(f, "%.*s,%.*s,%.*s,%.*s,%.2f,%.2f,%lld,%d\n", static_cast<int>(a.name.size()), a.name.data(),
+                         static_cast<int>(a.symbol.size()), a.symbol.data(), static_cast<int>(a.category.size()),
+                         a.category.data(), static_cast<int>(a.type.size()), a.type.data(), a.price, a.change,
+                         a.marketCap, a.score);
+        std::fclose(f);
+    }
+}
+
+// startup cost of a 100k-instrument universe: CSV parse + bulk build vs. mapping a snapshot
+static void benchLoader()
+{
+    const size_t n = 100000;
+    StringArena strings;
+    auto assets = syntheticAssets(n, 7, strings);
+    auto dir = std::filesystem::temp_directory_path();
+    std::string csv = (dir / "crs_bench_universe.csv").string();
+    std::string snap = (dir / "crs_bench_universe.snap").string();
+    writeCSV(csv, assets);
+
+    InvestmentSystem system;
+    auto t0 = std::chrono::steady_clock::now();
+    bool csvOk = system.loadFile(csv);
+    auto t1 = std::chrono::steady_clock::now();
+    size_t loaded = system.assetCount();
+    bool saved = system.saveSnapshot(snap);
+    auto t2 = std::chrono::steady_clock::now();
+    bool snapOk = system.loadFile(snap);
+    auto t3 = std::chrono::steady_clock::now();
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::error_code ec;
+    auto csvBytes = std::filesystem::file_size(csv, ec), snapBytes = std::filesystem::file_size(snap, ec);
+
+    record("load.csv_ms", ms(t0, t1));
+    record("load.snapshot_ms", ms(t2, t3));
+    std::cout << "load csv: " << n << " rows (" << csvBytes / 1024 << " KiB) -> " << loaded << " assets in "
+              << ms(t0, t1) << " ms" << (csvOk ? "" : " FAILED") << "\n"
+              << "load snapshot: " << snapBytes / 1024 << " KiB in " << ms(t2, t3) << " ms"
+              << (saved && snapOk && system.assetCount() == loaded ? "" : " FAILED") << "\n";
+
+    // rows the loader must refuse, next to one it keeps
+    std::string bad = (dir / "crs_bench_bad.csv").string();
+    if (std::FILE *f = std::fopen(bad.c_str(), "wb"))
+    {
+        std::fputs("name,symbol,category,type,price,change,marketCap,score\n"
+                   "Good,GOOD,ai,stock,10,1,1000,80\n"
+                   "Inf change,BADC1,ai,stock,10,inf,1000,80\n"
+                   "Nan change,BADC2,ai,stock,10,nan,1000,80\n"
+                   "Zero price,BADP1,ai,stock,0,1,1000,80\n"
+                   "Negative price,BADP2,ai,stock,-3,1,1000,80\n"
+                   "Inf price,BADP3,ai,stock,inf,1,1000,80\n"
+                   "Huge cap,BADM1,ai,stock,10,1,1e30,80\n"
+                   "Nan cap,BADM2,ai,stock,10,1,nan,80\n"
+                   "Huge score,BADS1,ai,stock,10,1,1000,1e20\n",
+                   f);
+        std::fclose(f);
+    }
+    bool badOk = system.loadFile(bad) && system.assetCount() == 1 && system.knownSymbol("GOOD");
+    std::cout << "load rejects non-finite change, price <= 0 and out-of-range integers: "
+              << (badOk ? "ok" : "FAILED") << "\n";
+    std::filesystem::remove(csv, ec);
+    std::filesystem::remove(snap, ec);
+    std::filesystem::remove(bad, ec);
+}
+
+// full-universe scans at 1M instruments: record-by-record with string type compares
+// (the old getStatsJSON/getRecommendationsJSON loops) vs. the column kernels
+static void benchColumns()
+{
+    StringArena strings;
+    auto assets = syntheticAssets(1000000, 11, strings);
+    const size_t n = assets.size();
+    Interner types, categories;
+    AssetColumns columns;
+    columns.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        Asset &a = assets[i];
+        a.typeId = types.intern(a.type);
+        a.categoryId = categories.intern(a.category);
+        a.rank = a.score;
+        columns.set(i, a);
+    }
+    std::vector<double> bonus(categories.size(), 0.0);
+    bonus[0] = 15;
+    const int crypto = types.find("crypto");
+    double sink = 0;
+    const int rounds = 20;
+
+    double statsAoS = nsPerOp(rounds, [&]
+                              {
+                                  for (int r = 0; r < rounds; r++)
+                                  {
+                                      double cap = 0, score = 0;
+                                      size_t cryptos = 0;
+                                      for (auto &a : assets)
+                                      {
+                                          cap += static_cast<double>(a.marketCap);
+                                          score += a.rank;
+                                          cryptos += a.type == "crypto";
+                                      }
+                                      sink += cap + score + static_cast<double>(cryptos);
+                                  }
+                              });
+    double statsSoA = nsPerOp(rounds, [&]
+                              {
+                                  for (int r = 0; r < rounds; r++)
+                                      sink += kernels::sum(columns.marketCap.data(), n) + kernels::sum(columns.rank.data(), n) +
+                                              static_cast<double>(kernels::countEqual(columns.typeId.data(), n, crypto));
+                              });
+    std::vector<const Asset *> candidates;
+    double topAoS = nsPerOp(rounds, [&]
+                            {
+                                for (int r = 0; r < rounds; r++)
+                                {
+                                    candidates.clear();
+                                    for (auto &a : assets)
+                                        if (a.type == "crypto")
+                                            candidates.push_back(&a);
+                                    std::partial_sort(candidates.begin(), candidates.begin() + 5, candidates.end(),
+                                                      [](const Asset *x, const Asset *y) { return x->rank > y->rank; });
+                                    sink += candidates[0]->rank;
+                                }
+                            });
+    std::vector<uint32_t> best;
+    double topSoA = nsPerOp(rounds, [&]
+                            {
+                                for (int r = 0; r < rounds; r++)
+                                {
+                                    kernels::topByRank(columns, n, crypto, 5, best);
+                                    sink += columns.rank[best[0]];
+                                }
+                            });
+    double rankAoS = nsPerOp(rounds, [&]
+                             {
+                                 for (int r = 0; r < rounds; r++)
+                                     for (size_t i = 0; i < n; i++)
+                                     {
+                                         const Asset &a = assets[i];
+                                         double s = a.score + bonus[a.categoryId];
+                                         if (a.marketCap > 50000000000LL)
+                                             s += 10;
+                                         columns.rank[i] = std::min(100.0, s);
+                                     }
+                             });
+    double rankSoA = nsPerOp(rounds, [&]
+                             {
+                                 for (int r = 0; r < rounds; r++)
+                                     kernels::ranks(columns, bonus.data(), n, columns.rank.data());
+                             });
+
+    record("columns.stats_ms", statsSoA / 1e6);
+    record("columns.top5_ms", topSoA / 1e6);
+    record("columns.rank_ms", rankSoA / 1e6);
+    std::cout << "columns (" << kernels::variant() << "), " << n << " assets, ms per scan (records -> columns):\n"
+              << "  stats:        " << statsAoS / 1e6 << " -> " << statsSoA / 1e6 << "\n"
+              << "  top 5 crypto: " << topAoS / 1e6 << " -> " << topSoA / 1e6 << "\n"
+              << "  rank all:     " << rankAoS / 1e6 << " -> " << rankSoA / 1e6 << " (" << (sink > 0) << ")\n";
+}
+
+// fuzzy search over 100k symbols with queries that are prefixes of real names and symbols
+// carrying as many typos as the budget for their length allows, anywhere in the query;
+// reports per-query latency and how often exact and fuzzy search come back empty
+static void benchFuzzy()
+{
+    StringArena strings;
+    auto assets = syntheticAssets(100000, 5, strings);
+    const size_t n = assets.size();
+    Interner types;
+    for (auto &a : assets)
+        a.typeId = types.intern(a.type);
+    Trie trie([](const Asset &a) { return static_cast<double>(a.score); });
+    for (auto &a : assets)
+    {
+        trie.insert(a.name, &a);
+        trie.insert(a.symbol, &a);
+        trie.insert(a.category, &a);
+    }
+    trie.build();
+
+    std::mt19937 rng(9);
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 2000; i++)
+    {
+        const Asset &a = assets[rng() % n];
+        std::string_view key = (i % 4) ? a.name : a.symbol;
+        std::string q(key.substr(0, std::min<size_t>(key.size(), 4 + rng() % 7)));
+        for (uint32_t e = 0, edits = Trie::typoBudget(q.size()); e < edits && q.size() > 1; e++)
+        {
+            size_t at = rng() % q.size();
+            switch (rng() % 4)
+            {
+            case 0: q[at] = static_cast<char>('a' + rng() % 26); break;
+            case 1: q.erase(at, 1); break;
+            case 2: q.insert(at, 1, static_cast<char>('a' + rng() % 26)); break;
+            default: if (at + 1 < q.size()) std::swap(q[at], q[at + 1]); break;
+            }
+        }
+        queries.push_back(std::move(q));
+    }
+
+    std::vector<Asset *> res;
+    std::vector<double> micros;
+    size_t exactEmpty = 0, fuzzyEmpty = 0;
+    for (auto &q : queries)
+    {
+        trie.top(q, 50, Trie::kAnyType, res);
+        exactEmpty += res.empty();
+    }
+    for (int round = 0; round < 5; round++)
+        for (auto &q : queries)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            trie.fuzzyTop(q, Trie::typoBudget(q.size()), 50, Trie::kAnyType, res);
+            micros.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+            if (round == 0)
+                fuzzyEmpty += res.empty();
+        }
+    double mean = 0;
+    for (double v : micros)
+        mean += v;
+    mean /= static_cast<double>(micros.size());
+    record("fuzzy.mean_us", mean);
+    record("fuzzy.p99_us", percentile(micros, 0.99));
+    std::cout << "fuzzy search: " << n << " assets, " << queries.size() << " typo'd queries, us/query mean " << mean
+              << " p50 " << percentile(micros, 0.5) << " p99 " << percentile(micros, 0.99) << " max " << micros.back()
+              << "; empty results exact " << exactEmpty * 100 / queries.size() << "% fuzzy "
+              << fuzzyEmpty * 100 / queries.size() << "%\n";
+}
+
+// personalized top 5 over 100k instruments for users drawn from a million profiles,
+// from 1 and from several threads, vs. re-ranking the universe with the user's bonus
+// per request
+static void benchProfiles()
+{
+    static const char *categories[] = {"layer1", "defi", "ai", "meme", "gaming", "tech", "media", "storage",
+                                       "financial", "healthcare", "energy", "industrial", "consumer", "retail"};
+    const size_t users = 1000000, requests = 20000;
+    StringArena strings;
+    auto assets = syntheticAssets(100000, 11, strings);
+    std::string csv = (std::filesystem::temp_directory_path() / "crs_bench_profiles.csv").string();
+    writeCSV(csv, assets);
+    InvestmentSystem system;
+    bool loaded = system.loadFile(csv);
+    std::error_code ec;
+    std::filesystem::remove(csv, ec);
+
+    std::mt19937 rng(13);
+    std::pmr::vector<std::pair<std::string_view, float>> weights;
+    double setNs = nsPerOp(users, [&]
+                           {
+                               for (size_t u = 0; u < users; u++)
+                               {
+                                   weights.clear();
+                                   for (size_t w = 1 + rng() % 4; w > 0; w--)
+                                       weights.emplace_back(categories[rng() % 14], static_cast<float>(rng() % 31));
+                                   system.setProfile("user" + std::to_string(u), weights);
+                               }
+                           });
+
+    auto run = [&](int threads)
+    {
+        std::vector<std::thread> pool;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++)
+            pool.emplace_back([&, t]
+                              {
+                                  std::mt19937 r(static_cast<unsigned>(t));
+                                  std::string out;
+                                  for (size_t i = 0; i < requests; i++)
+                                  {
+                                      out.clear();
+                                      system.getRecommendationsJSON(i % 2 ? "crypto" : "", "user" + std::to_string(r() % users), out);
+                                  }
+                              });
+        for (auto &t : pool)
+            t.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return static_cast<double>(requests * static_cast<size_t>(threads)) / seconds;
+    };
+    const int threads = std::max(2, std::min(8, static_cast<int>(std::thread::hardware_concurrency())));
+    double single = run(1), many = run(threads);
+
+    // the alternative: rank every asset with the user's bonus, then take the top 5
+    Interner types, cats;
+    AssetColumns columns;
+    columns.resize(assets.size());
+    for (size_t i = 0; i < assets.size(); i++)
+    {
+        assets[i].typeId = types.intern(assets[i].type);
+        assets[i].categoryId = cats.intern(assets[i].category);
+        columns.set(i, assets[i]);
+    }
+    std::vector<double> bonus(cats.size());
+    std::vector<uint32_t> best;
+    double rerankNs = nsPerOp(requests / 10, [&]
+                              {
+                                  for (size_t i = 0; i < requests / 10; i++)
+                                  {
+                                      for (auto &b : bonus)
+                                          b = (rng() % 4) ? 0 : static_cast<double>(rng() % 31);
+                                      kernels::ranks(columns, bonus.data(), assets.size(), columns.rank.data());
+                                      kernels::topByRank(columns, assets.size(), i % 2 ? 0 : -1, 5, best);
+                                  }
+                              });
+
+    record("profiles.set_ns", setNs);
+    record("profiles.top5_us", 1e6 / single);
+    record("profiles.rerank_us", rerankNs / 1e3);
+    std::cout << "profiles: " << system.profileCount() << " users stored at " << setNs << " ns each"
+              << (loaded ? "" : " (universe FAILED)") << "; personalized top 5 of " << system.assetCount()
+              << ": " << 1e6 / single << " us (" << static_cast<long long>(single) << "/s on 1 thread, "
+              << static_cast<long long>(many) << "/s on " << threads << ") vs. re-rank per request "
+              << rerankNs / 1e3 << " us\n";
+}
+
+// one bar close over 100k assets, incremental against recomputing every window from the
+// closes, and gainers plus losers off a momentum column
+static void benchAnalytics()
+{
+    const size_t n = 100000;
+    const size_t bars = 200;
+    std::mt19937 rng(5);
+    std::vector<double> price(n);
+    for (auto &p : price)
+        p = 1 + (rng() % 100000) / 10.0;
+    auto move = [&]
+    {
+        for (auto &p : price)
+            p *= 1 + (static_cast<int>(rng() % 2001) - 1000) / 100000.0;
+    };
+    PriceHistory history;
+    history.reset(n);
+    std::shared_ptr<const PriceStats> stats;
+    double closeNs = 0;
+    for (size_t b = 0; b < bars; b++)
+    {
+        move();
+        closeNs += nsPerOp(1, [&]
+                           {
+                               history.close(price);
+                               stats = history.stats();
+                           });
+    }
+    closeNs /= bars;
+
+    // the same statistics from a plain history of closes, every window rescanned per bar
+    std::vector<float> closes(PriceHistory::kBars * n, 1.0f);
+    std::vector<double> out(3 * n);
+    double sink = 0;
+    double rescanNs = nsPerOp(bars, [&]
+                              {
+                                  for (size_t b = 0; b < bars; b++)
+                                  {
+                                      float *row = closes.data() + (b % PriceHistory::kBars) * n;
+                                      for (size_t i = 0; i < n; i++)
+                                          row[i] = static_cast<float>(price[i]);
+                                      for (uint32_t w : PriceStats::kWindowBars)
+                                          for (size_t i = 0; i < n; i++)
+                                          {
+                                              double sum = 0, high = 0, r = 0, r2 = 0;
+                                              for (uint32_t k = 0; k < w; k++)
+                                              {
+                                                  size_t at = (b + PriceHistory::kBars - k) % PriceHistory::kBars;
+                                                  size_t prev = (at + PriceHistory::kBars - 1) % PriceHistory::kBars;
+                                                  double c = closes[at * n + i], ret = std::log(c / closes[prev * n + i]);
+                                                  sum += c;
+                                                  high = std::max(high, c);
+                                                  r += ret;
+                                                  r2 += ret * ret;
+                                              }
+                                              out[i] = sum / w;
+                                              out[n + i] = high;
+                                              out[2 * n + i] = std::sqrt(std::max(0.0, (r2 - r * r / w) / (w - 1)));
+                                          }
+                                      sink += out[b % n];
+                                  }
+                              });
+
+    std::vector<double> momentum(n);
+    std::vector<int32_t> typeId(n, 0);
+    for (size_t i = 0; i < n; i++)
+        momentum[i] = stats->momentum(2, i, price[i]);
+    std::vector<uint32_t> gainers, losers;
+    const int rounds = 200;
+    double moversNs = nsPerOp(rounds, [&]
+                              {
+                                  for (int r = 0; r < rounds; r++)
+                                  {
+                                      kernels::topBy(momentum.data(), 1, 0, typeId.data(), n, -1, 10, gainers);
+                                      kernels::topBy(momentum.data(), -1, 0, typeId.data(), n, -1, 10, losers);
+                                      sink += static_cast<double>(gainers.size() + losers.size());
+                                  }
+                              });
+
+    record("analytics.bar_close_ms", closeNs / 1e6);
+    record("analytics.bar_rescan_ms", rescanNs / 1e6);
+    record("analytics.movers_us", moversNs / 1e3);
+    std::cout << "analytics, " << n << " assets: bar close + stats " << closeNs / 1e6 << " ms (rescanning "
+              << rescanNs / 1e6 << " ms), gainers + losers " << moversNs / 1e3 << " us (" << (sink > 0) << ")\n";
+}
+
+struct MicroBench
+{
+    // ticks that are not finite, or would overflow the cap, are refused by the endpoint's
+    // parser and by applyTicks, so no response ever carries inf or nan
+    static void badTicks()
+    {
+        bool ok = true;
+        std::vector<Tick> parsed;
+        for (const char *body : {"BTC,inf", "BTC,nan", "BTC,-inf", "BTC,0", "BTC,-5", "BTC,100,inf", "BTC,100,nan",
+                                 "BTC,100,1,-5", "ETH,3900\nBTC,infinity"})
+            ok &= !SimpleHTTPServer::parseTicks(body, parsed);
+        parsed.clear();
+        ok &= SimpleHTTPServer::parseTicks("BTC,100000,1.5,2000000000000", parsed) && parsed.size() == 1;
+
+        InvestmentSystem system;
+        const double inf = std::numeric_limits<double>::infinity(), nan = std::numeric_limits<double>::quiet_NaN();
+        std::vector<Tick> ticks(5);
+        for (auto &t : ticks)
+        {
+            t.symbol = "BTC";
+            t.price = 100000;
+        }
+        ticks[0].price = inf;
+        ticks[1].price = nan;
+        ticks[2].change = inf;
+        ticks[3].change = -inf;
+        ticks[4].price = 1e300; // scales the cap far past long long
+        ok &= system.applyTicks(ticks) == 0;
+
+        std::string out;
+        system.searchJSON("btc", "", false, out);
+        system.getStatsJSON(out);
+        ok &= out.find("inf") == std::string::npos && out.find("nan") == std::string::npos;
+        record("ticks.invalid_rejected", ok ? 1 : 0);
+        std::cout << "invalid ticks (inf, nan, price <= 0, negative or overflowing cap): "
+                  << (ok ? "rejected" : "FAILED") << "\n";
+    }
+
+    // the per-request helpers one at a time (calcScore, toJSON and urlDecode over 100k
+    // synthetic assets), then searchJSON/getRecommendationsJSON on the built-in universe
+    // with keystroke prefixes
+    static void run()
+    {
+        const size_t rounds = 20;
+        StringArena strings;
+        auto assets = syntheticAssets(100000, 17, strings);
+        InvestmentSystem::Snapshot s;
+        InvestmentSystem::setPrefs(s, {"defi", "ai", "tech"});
+        for (auto &a : assets)
+        {
+            a.categoryId = s.categories.intern(a.category);
+            a.typeId = s.types.intern(a.type);
+        }
+        double sink = 0;
+        double scoreNs = nsPerOp(rounds * assets.size(), [&]
+                                 {
+                                     for (size_t r = 0; r < rounds; r++)
+                                         for (auto &a : assets)
+                                             sink += InvestmentSystem::calcScore(s, a);
+                                 });
+        StringArena fragments;
+        double jsonNs = nsPerOp(assets.size(), [&]
+                                {
+                                    for (auto &a : assets)
+                                        InvestmentSystem::toJSON(a, fragments);
+                                });
+
+        // query strings the way browsers send them
+        std::vector<std::string> encoded;
+        for (size_t i = 0; i < 4096; i++)
+        {
+            std::string q = "q=";
+            for (char ch : assets[i].name.substr(0, 1 + i % 12))
+                if (ch == ' ')
+                    q += '+';
+                else if (std::isalnum(static_cast<unsigned char>(ch)))
+                    q += ch;
+                else
+                {
+                    char hex[4];
+                    std::snprintf(hex, sizeof(hex), "%%%02X", static_cast<unsigned char>(ch));
+                    q += hex;
+                }
+            encoded.push_back(std::move(q) + "&type=crypto");
+        }
+        std::string decoded;
+        double decodeNs = nsPerOp(rounds * encoded.size(), [&]
+                                  {
+                                      for (size_t r = 0; r < rounds; r++)
+                                          for (auto &q : encoded)
+                                          {
+                                              decoded.clear();
+                                              SimpleHTTPServer::urlDecode(q, decoded);
+                                              sink += static_cast<double>(decoded.size());
+                                          }
+                                  });
+
+        InvestmentSystem system;
+        std::vector<std::string> keys = system.names(), prefixes;
+        for (auto &sym : system.symbols())
+            keys.push_back(sym);
+        for (auto &key : keys)
+            for (size_t len = 1; len <= std::min<size_t>(key.size(), 8); len++)
+                prefixes.push_back(key.substr(0, len));
+        std::string out;
+        double searchNs = nsPerOp(rounds * prefixes.size(), [&]
+                                  {
+                                      for (size_t r = 0; r < rounds; r++)
+                                          for (size_t i = 0; i < prefixes.size(); i++)
+                                          {
+                                              out.clear();
+                                              system.searchJSON(prefixes[i], i % 3 ? "" : "crypto", false, out);
+                                          }
+                                  });
+        static const char *types[] = {"", "crypto", "stock"};
+        double recommendNs = nsPerOp(rounds * 1000, [&]
+                                     {
+                                         for (size_t i = 0; i < rounds * 1000; i++)
+                                         {
+                                             out.clear();
+                                             system.getRecommendationsJSON(types[i % 3], "", out);
+                                         }
+                                     });
+
+        // heap allocations per call once buffers are warm: the read paths reuse thread-local
+        // buffers, the profile and metrics handlers a worker's scratch arena; a tick batch
+        // copies the snapshot on the writer
+        double searchAllocs = allocsPerOp(prefixes.size(), [&]
+                                          {
+                                              for (size_t i = 0; i < prefixes.size(); i++)
+                                              {
+                                                  out.clear();
+                                                  system.searchJSON(prefixes[i], i % 3 ? "" : "crypto", false, out);
+                                              }
+                                          });
+        double recommendAllocs = allocsPerOp(1000, [&]
+                                             {
+                                                 for (size_t i = 0; i < 1000; i++)
+                                                 {
+                                                     out.clear();
+                                                     system.getRecommendationsJSON(types[i % 3], "", out);
+                                                 }
+                                             });
+        SimpleHTTPServer server(system, ServerConfig());
+        server.workerStates.push_back(std::make_unique<SimpleHTTPServer::WorkerState>());
+        SimpleHTTPServer::Connection c;
+        c.worker = server.workerStates.back().get();
+        c.user = "bench";
+        HttpRequest profile;
+        profile.body = "defi,20\nai,-5\nmeme,1.5\n";
+        auto storeProfile = [&]
+        {
+            c.body.clear();
+            server.storeProfile(profile, c);
+            c.worker->scratch.release();
+        };
+        auto metrics = [&]
+        {
+            c.body.clear();
+            server.metricsText(c.body, &c.worker->scratch);
+            c.worker->scratch.release();
+        };
+        storeProfile();
+        metrics();
+        double profileAllocs = allocsPerOp(1000, [&]
+                                           {
+                                               for (int i = 0; i < 1000; i++)
+                                                   storeProfile();
+                                           });
+        double metricsAllocs = allocsPerOp(100, [&]
+                                           {
+                                               for (int i = 0; i < 100; i++)
+                                                   metrics();
+                                           });
+        std::vector<std::string> symbols = system.symbols();
+        std::vector<Tick> batch(1);
+        double tickAllocs = allocsPerOp(100, [&]
+                                        {
+                                            for (size_t i = 0; i < 100; i++)
+                                            {
+                                                batch[0].symbol = symbols[i % symbols.size()];
+                                                batch[0].price = 1 + static_cast<double>(i);
+                                                system.applyTicks(batch);
+                                            }
+                                        });
+
+        record("micro.calc_score_ns", scoreNs);
+        record("micro.to_json_ns", jsonNs);
+        record("micro.url_decode_ns", decodeNs);
+        record("micro.search_json_ns", searchNs);
+        record("micro.recommend_json_ns", recommendNs);
+        std::cout << "micro, ns/op: calcScore " << scoreNs << ", toJSON " << jsonNs << ", urlDecode " << decodeNs
+                  << ", searchJSON (keystroke prefix) " << searchNs << ", getRecommendationsJSON " << recommendNs
+                  << " (" << (sink > 0) << ")\n";
+        if (!allocationsCounted())
+        {
+            std::cout << "micro, heap allocations/op: not counted in this build (make bench)\n";
+            return;
+        }
+        record("micro.search_json_allocs", searchAllocs);
+        record("micro.recommend_json_allocs", recommendAllocs);
+        record("micro.store_profile_allocs", profileAllocs);
+        record("micro.metrics_text_allocs", metricsAllocs);
+        record("micro.apply_tick_allocs", tickAllocs);
+        std::cout << "micro, heap allocations/op: searchJSON " << searchAllocs << ", getRecommendationsJSON "
+                  << recommendAllocs << ", POST /api/profile " << profileAllocs << ", /api/metrics " << metricsAllocs
+                  << ", applyTicks (1 tick, writer) " << tickAllocs << "\n";
+    }
+
+    // /api/query over 100k instruments, per plan the planner picks, against filtering every
+    // record and sorting the matches; and what the field indexes add to a one-tick batch
+    static void query()
+    {
+        static const char *queries[] = {"cap>1e10&change<0&cat=defi&sort=change&limit=20", "sort=cap&limit=20",
+                                        "price<5&sort=score", "change>9.5&type=crypto&sort=price&order=asc",
+                                        "cap>=9.9e11&cat=ai&sort=change", "score>=99&change<=-9&limit=100"};
+        StringArena strings;
+        auto assets = syntheticAssets(100000, 23, strings);
+        std::string csv = (std::filesystem::temp_directory_path() / "crs_bench_query.csv").string();
+        writeCSV(csv, assets);
+        InvestmentSystem system;
+        bool loaded = system.loadFile(csv);
+        std::error_code ec;
+        std::filesystem::remove(csv, ec);
+        std::pmr::monotonic_buffer_resource scratch;
+        const int rounds = 2000;
+        std::cout << "query, " << system.assetCount() << " assets" << (loaded ? "" : " (universe FAILED)")
+                  << ", us per query (plan, rows examined; scanning records instead):\n";
+        for (size_t k = 0; k < sizeof(queries) / sizeof(*queries); k++)
+        {
+            AssetQuery q;
+            SimpleHTTPServer::parseAssetQuery(queries[k], q, &scratch);
+            std::string out;
+            system.queryJSON(q, out);
+            std::string plan = out.substr(9, out.find('"', 9) - 9);
+            size_t examined = std::strtoul(out.c_str() + out.find("\"examined\":") + 11, nullptr, 10);
+            double ns = nsPerOp(rounds, [&]
+                                {
+                                    for (int r = 0; r < rounds; r++)
+                                    {
+                                        out.clear();
+                                        system.queryJSON(q, out);
+                                    }
+                                });
+
+            // the scan: every record against every filter, then the best of the matches
+            std::vector<const Asset *> hits;
+            double scanNs = nsPerOp(rounds / 20, [&]
+                                    {
+                                        for (int r = 0; r < rounds / 20; r++)
+                                        {
+                                            hits.clear();
+                                            for (const Asset &a : assets)
+                                            {
+                                                double v[AssetQuery::FieldCount] = {a.price, static_cast<double>(a.marketCap), a.change,
+                                                                                    static_cast<double>(a.score)};
+                                                bool match = (q.category.empty() || a.category == q.category) &&
+                                                             (q.type.empty() || a.type == q.type);
+                                                for (int f = 0; f < AssetQuery::FieldCount && match; f++)
+                                                    match = v[f] >= q.low[f] && v[f] <= q.high[f];
+                                                if (match)
+                                                    hits.push_back(&a);
+                                            }
+                                            auto key = [&](const Asset *a)
+                                            {
+                                                double v[AssetQuery::FieldCount] = {a->price, static_cast<double>(a->marketCap), a->change,
+                                                                                    static_cast<double>(a->score)};
+                                                return q.ascending ? -v[q.sort] : v[q.sort];
+                                            };
+                                            size_t keep = std::min(hits.size(), q.limit);
+                                            std::partial_sort(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(keep), hits.end(),
+                                                              [&](const Asset *a, const Asset *b) { return key(a) > key(b); });
+                                        }
+                                    });
+            std::string name = "query." + std::to_string(k) + "_us";
+            record(name, ns / 1e3);
+            std::cout << "  " << queries[k] << ": " << ns / 1e3 << " (" << plan << ", " << examined << "; "
+                      << scanNs / 1e3 << ")\n";
+        }
+
+        std::vector<std::string> symbols = system.symbols();
+        std::mt19937 rng(29);
+        const int batches = 200;
+        double tickNs = nsPerOp(batches, [&]
+                                {
+                                    for (int b = 0; b < batches; b++)
+                                    {
+                                        std::vector<Tick> ticks(1);
+                                        ticks[0].symbol = symbols[rng() % symbols.size()];
+                                        ticks[0].price = 1 + (rng() % 100000) / 10.0;
+                                        system.applyTicks(ticks);
+                                    }
+                                });
+        record("query.apply_tick_us", tickNs / 1e3);
+        std::cout << "  applyTicks, 1 tick with the field indexes kept current: " << tickNs / 1e3 << " us\n";
+    }
+
+    // random unit return features, cap angles and 8 categories for n assets
+    static SimilarityIndex similarityFeatures(size_t n, unsigned seed)
+    {
+        using X = SimilarityIndex;
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> g;
+        X x;
+        x.n = n;
+        x.stride = (n + 7) / 8 * 8;
+        x.features.assign(X::kDims * x.stride, 0.0f);
+        x.categoryId.assign(x.stride, -1);
+        for (size_t i = 0; i < n; i++)
+        {
+            float v[X::kSteps], norm = 0;
+            for (float &f : v)
+            {
+                f = g(rng);
+                norm += f * f;
+            }
+            for (size_t d = 0; d < X::kSteps; d++)
+                x.features[d * x.stride + i] = v[d] / std::sqrt(norm);
+            float angle = static_cast<float>(rng() % 1000) / 1000 * 1.5708f;
+            x.features[X::kSteps * x.stride + i] = std::sqrt(X::kCapWeight) * std::cos(angle);
+            x.features[(X::kSteps + 1) * x.stride + i] = std::sqrt(X::kCapWeight) * std::sin(angle);
+            x.categoryId[i] = static_cast<int32_t>(rng() % 8);
+        }
+        return x;
+    }
+
+    // linking every asset's neighbours, then /api/similar read off the links against
+    // scanning a universe too large to link
+    static void similar()
+    {
+        unsigned threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+        std::cout << "similar, " << SimilarityIndex::kDims << " features, " << threads << " thread(s):\n";
+        for (size_t n : {4096, 32768})
+        {
+            SimilarityIndex x = similarityFeatures(n, 31);
+            double ns = nsPerOp(1, [&] { kernels::similarNeighbors(x, threads); });
+            double pairs = static_cast<double>(n) * static_cast<double>(n);
+            record("similar.link_" + std::to_string(n) + "_ms", ns / 1e6);
+            std::cout << "  link " << n << " assets: " << ns / 1e6 << " ms (" << pairs / ns << " G pairs/s)\n";
+        }
+
+        StringArena strings;
+        auto assets = syntheticAssets(4096, 37, strings);
+        std::string csv = (std::filesystem::temp_directory_path() / "crs_bench_similar.csv").string();
+        writeCSV(csv, assets);
+        InvestmentSystem system;
+        bool loaded = system.loadFile(csv);
+        std::error_code ec;
+        std::filesystem::remove(csv, ec);
+        // the linker thread links the loaded universe in the background
+        for (int wait = 0; wait < 1000; wait++)
+        {
+            {
+                InvestmentSystem::Reader s(system);
+                if (s->similar && s->similar->linked)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::vector<std::string> symbols = system.symbols();
+        std::string out;
+        const int rounds = 20000;
+        size_t next = 0;
+        double linkedNs = nsPerOp(rounds, [&]
+                                  {
+                                      for (int r = 0; r < rounds; r++)
+                                      {
+                                          out.clear();
+                                          system.similarJSON(symbols[next++ % symbols.size()], 10, out);
+                                      }
+                                  });
+        record("similar.linked_lookup_us", linkedNs / 1e3);
+
+        SimilarityIndex big = similarityFeatures(100000, 41);
+        kernels::SimilarBest best;
+        const int scans = 200;
+        uint32_t sink = 0;
+        double scanNs = nsPerOp(scans, [&]
+                                {
+                                    for (int r = 0; r < scans; r++)
+                                    {
+                                        kernels::similarTo(big, static_cast<uint32_t>(r * 499), 10, best);
+                                        sink += best.rows[0];
+                                    }
+                                });
+        record("similar.scan_100k_us", scanNs / 1e3);
+        std::cout << "  /api/similar k=10 over " << system.assetCount() << " linked assets" << (loaded ? "" : " (universe FAILED)")
+                  << ": " << linkedNs / 1e3 << " us; scan of 100k unlinked: " << scanNs / 1e3 << " us (" << (sink > 0) << ")\n";
+    }
+};
+
+// requests as the search box sends them: every prefix of a name or symbol as it is typed,
+// one session in ten fuzzy, with the odd /api/recommend and /api/stats in between
+static std::vector<std::string> keystrokeRequests(const std::vector<std::string> &keys, size_t count, unsigned seed)
+{
+    static const char *types[] = {"", "crypto", "stock"};
+    std::mt19937 rng(seed);
+    std::vector<std::string> out;
+    std::string target;
+    while (out.size() < count)
+    {
+        unsigned pick = rng() % 20;
+        if (pick == 0)
+            target = "/api/stats";
+        else if (pick == 1)
+            target = std::string("/api/recommend?type=") + types[rng() % 3];
+        if (pick < 2)
+        {
+            out.push_back("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+            continue;
+        }
+        const std::string &key = keys[rng() % keys.size()];
+        bool fuzzy = rng() % 10 == 0;
+        size_t typed = 1 + rng() % std::min<size_t>(key.size(), 8);
+        for (size_t len = 1; len <= typed; len++)
+        {
+            target = "/api/search?q=";
+            for (char ch : key.substr(0, len))
+            {
+                if (std::isalnum(static_cast<unsigned char>(ch)))
+                    target += ch;
+                else
+                {
+                    char hex[4];
+                    std::snprintf(hex, sizeof(hex), "%%%02X", static_cast<unsigned char>(ch));
+                    target += hex;
+                }
+            }
+            if (fuzzy)
+                target += "&fuzzy=1";
+            out.push_back("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        }
+    }
+    return out;
+}
+
+#ifndef _WIN32
+struct LoadResult
+{
+    LatencyHistogram latency;
+    uint64_t sent = 0, errors = 0;
+};
+
+// One client thread's share of a load phase over keep-alive connections. With
+// perConnRate == 0 the loop is closed: a connection sends its next request when the
+// previous response is in. Otherwise every connection has requests due at a fixed rate,
+// sends each when due (pipelined behind any still in flight) and measures latency from
+// the due time, so queueing in a stalled server shows up instead of being left out
+// (coordinated omission).
+static void loadWorker(int port, const std::vector<std::string> &requests, int connections, double perConnRate,
+                       std::chrono::steady_clock::time_point end, size_t firstRequest, LoadResult &result)
+{
+    using Clock = std::chrono::steady_clock;
+    struct Client
+    {
+        socket_t fd = -1;
+        std::string in, out;
+        size_t sent = 0, next = 0;
+        std::deque<Clock::time_point> due; // of the requests awaiting a response, oldest first
+        Clock::time_point nextDue;
+    };
+    std::vector<Client> clients(static_cast<size_t>(connections));
+    Poller poller;
+    if (poller.setupError())
+    {
+        result.errors += static_cast<uint64_t>(connections);
+        return;
+    }
+    const auto interval = perConnRate > 0 ? std::chrono::duration_cast<Clock::duration>(
+                                                std::chrono::duration<double>(1 / perConnRate))
+                                          : Clock::duration::zero();
+    auto start = Clock::now();
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        Client &c = clients[i];
+        c.next = firstRequest + i * 997;
+        c.nextDue = start + interval * static_cast<long>(i) / static_cast<long>(clients.size());
+        c.fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        if (c.fd < 0 || connect(c.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            result.errors++;
+            if (c.fd >= 0)
+                closesocket(c.fd);
+            c.fd = -1;
+            continue;
+        }
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL, 0) | O_NONBLOCK);
+        poller.add(c.fd, &c, true);
+    }
+
+    auto drop = [&](Client &c)
+    {
+        result.errors += c.due.size();
+        c.due.clear();
+        poller.remove(c.fd);
+        closesocket(c.fd);
+        c.fd = -1;
+    };
+    auto flush = [&](Client &c)
+    {
+        while (c.fd >= 0 && c.sent < c.out.size())
+        {
+            ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, 0);
+            if (n > 0)
+                c.sent += static_cast<size_t>(n);
+            else if (n < 0 && errno == EINTR)
+                continue;
+            else
+            {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                    drop(c);
+                return;
+            }
+        }
+        c.out.clear();
+        c.sent = 0;
+    };
+    auto issue = [&](Client &c, Clock::time_point due)
+    {
+        c.out += requests[c.next++ % requests.size()];
+        c.due.push_back(due);
+        result.sent++;
+    };
+    // takes every complete response off c.in; false on one that is not HTTP
+    auto complete = [&](Client &c, Clock::time_point now)
+    {
+        size_t pos = 0;
+        while (true)
+        {
+            size_t headEnd = c.in.find("\r\n\r\n", pos);
+            if (headEnd == std::string::npos)
+                break;
+            std::string_view head(c.in.data() + pos, headEnd - pos);
+            size_t at = head.find("Content-Length: ");
+            size_t length = 0;
+            if (at == std::string_view::npos || c.due.empty() ||
+                std::from_chars(head.data() + at + 16, head.data() + head.size(), length).ec != std::errc())
+                return false;
+            if (c.in.size() < headEnd + 4 + length)
+                break;
+            if (head.compare(0, 12, "HTTP/1.1 200") != 0)
+                result.errors++;
+            result.latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - c.due.front()).count()));
+            c.due.pop_front();
+            pos = headEnd + 4 + length;
+        }
+        c.in.erase(0, pos);
+        return true;
+    };
+
+    std::vector<Poller::Event> events;
+    char buf[16384];
+    const auto grace = std::chrono::seconds(2); // for responses still in flight at the end
+    while (true)
+    {
+        auto now = Clock::now();
+        bool issuing = now < end, waiting = false;
+        Clock::time_point soonest = now + std::chrono::milliseconds(10);
+        for (auto &c : clients)
+        {
+            if (c.fd < 0)
+                continue;
+            if (issuing && interval == Clock::duration::zero() && c.due.empty())
+                issue(c, now);
+            for (; issuing && interval != Clock::duration::zero() && c.nextDue <= now; c.nextDue += interval)
+                issue(c, c.nextDue);
+            if (interval != Clock::duration::zero())
+                soonest = std::min(soonest, c.nextDue);
+            flush(c);
+            waiting |= c.fd >= 0 && !c.due.empty();
+        }
+        if (!issuing && (!waiting || now > end + grace))
+            break;
+
+        // a due time under a millisecond away is waited for by polling without a timeout
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(soonest - now).count();
+        if (poller.wait(events, issuing ? static_cast<int>(std::max<long long>(0, wait)) : 10) == 0 && wait <= 0)
+            std::this_thread::yield();
+        now = Clock::now();
+        for (auto &e : events)
+        {
+            Client &c = *static_cast<Client *>(e.tag);
+            if (c.fd < 0)
+                continue;
+            bool open = true;
+            while (e.readable || e.hangup)
+            {
+                ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+                if (n > 0)
+                {
+                    c.in.append(buf, static_cast<size_t>(n));
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                open = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                break;
+            }
+            if (!complete(c, now) || !open)
+                drop(c);
+        }
+    }
+    for (auto &c : clients)
+        if (c.fd >= 0)
+            drop(c);
+}
+
+// one phase of load from several client threads; returns completed requests per second
+static double runLoad(const char *name, int port, const std::vector<std::string> &requests, int connections,
+                      double rate, int seconds)
+{
+    const int threads = std::max(1, std::min(connections, static_cast<int>(std::thread::hardware_concurrency()) / 2));
+    std::vector<LoadResult> results(static_cast<size_t>(threads));
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    for (int t = 0; t < threads; t++)
+    {
+        int share = connections / threads + (t < connections % threads ? 1 : 0);
+        pool.emplace_back(loadWorker, port, std::cref(requests), share, rate / connections, end,
+                          static_cast<size_t>(t) * requests.size() / static_cast<size_t>(threads),
+                          std::ref(results[static_cast<size_t>(t)]));
+    }
+    for (auto &t : pool)
+        t.join();
+    LoadResult all;
+    for (auto &r : results)
+    {
+        all.latency.merge(r.latency);
+        all.sent += r.sent;
+        all.errors += r.errors;
+    }
+    double rps = static_cast<double>(all.latency.count()) / seconds;
+    auto us = [&](double p) { return static_cast<double>(all.latency.percentile(p)) / 1e3; };
+    std::string prefix = std::string("http.") + name + ".";
+    record(prefix + "requests_per_s", rps);
+    record(prefix + "p50_us", us(0.5));
+    record(prefix + "p99_us", us(0.99));
+    record(prefix + "p999_us", us(0.999));
+    record(prefix + "max_us", static_cast<double>(all.latency.max()) / 1e3);
+    record(prefix + "errors", static_cast<double>(all.errors));
+    std::cout << "http " << name << "-loop";
+    if (rate > 0)
+    {
+        record(prefix + "target_per_s", rate);
+        std::cout << " at " << static_cast<long long>(rate) << "/s";
+    }
+    std::cout << ": " << connections << " connections, " << threads << " client threads, "
+              << static_cast<long long>(rps) << " req/s, latency us p50 " << us(0.5) << " p99 " << us(0.99)
+              << " p99.9 " << us(0.999) << " max " << static_cast<double>(all.latency.max()) / 1e3 << " mean "
+              << all.latency.mean() / 1e3 << ", " << all.errors << " errors\n";
+    return rps;
+}
+#endif
+
+// Serves the universe from a child process (same binary, --port/--workers/--data as
+// given) and loads it with keystroke traffic: first closed-loop to find the throughput,
+// then open-loop at a fixed rate for latency under a known load.
+int runHttpBenchmark(const ServerConfig &config, const LoadConfig &load, const std::string &dataPath)
+{
+#ifdef _WIN32
+    (void)config, (void)load, (void)dataPath;
+    std::cerr << "--bench-http needs fork()\n";
+    return 1;
+#else
+    pid_t child = fork();
+    if (child < 0)
+    {
+        std::cerr << "fork failed\n";
+        return 1;
+    }
+    if (child == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        InvestmentSystem system;
+        if (!dataPath.empty() && !system.loadFile(dataPath))
+            _exit(1);
+        SimpleHTTPServer server(system, config);
+        server.start();
+        _exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    InvestmentSystem system;
+    if (!dataPath.empty())
+        system.loadFile(dataPath);
+    std::vector<std::string> keys = system.names();
+    for (auto &sym : system.symbols())
+        keys.push_back(sym);
+    std::vector<std::string> requests = keystrokeRequests(keys, 100000, 1);
+
+    // the server is up once it accepts a connection
+    bool up = false;
+    for (int attempt = 0; attempt < 600 && !up && waitpid(child, nullptr, WNOHANG) == 0; attempt++)
+    {
+        socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(config.port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        up = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        closesocket(fd);
+        if (!up)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (!up)
+    {
+        std::cerr << "server on port " << config.port << " did not come up\n";
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+        return 1;
+    }
+
+    double closed = runLoad("closed", config.port, requests, load.connections, 0, load.seconds);
+    double rate = load.rate > 0 ? load.rate : closed / 2;
+    if (rate >= 1)
+        runLoad("open", config.port, requests, load.connections, rate, load.seconds);
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+    return 0;
+#endif
+}
+
+void runBenchmarks()
+{
+    MicroBench::run();
+    benchTrie();
+    benchFuzzy();
+    benchTicks();
+    MicroBench::badTicks();
+    benchLoader();
+    benchColumns();
+    benchProfiles();
+    benchAnalytics();
+    MicroBench::query();
+    MicroBench::similar();
+}
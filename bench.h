@@ -0,0 +1,19 @@
+#pragma once
+
+#include "http.h"
+
+struct LoadConfig
+{
+    int connections = 64;
+    int rate = 0;    // open-loop requests/s; 0 = half the closed-loop throughput
+    int seconds = 5; // per phase
+};
+
+// --bench: the in-process benchmarks
+void runBenchmarks();
+
+// --bench-http: serves in a child process and loads it over loopback; the exit status
+int runHttpBenchmark(const ServerConfig &config, const LoadConfig &load, const std::string &dataPath);
+
+// every recorded measurement as one flat JSON object; mode names the run
+bool writeResults(const std::string &path, const char *mode);
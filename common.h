@@ -0,0 +1,389 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <cmath>
+#include <filesystem>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <functional>
+#include <type_traits>
+#include <bitset>
+#include <cstdio>
+#include <deque>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+typedef SOCKET socket_t;
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#define closesocket close
+typedef int socket_t;
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+// heap allocations made by the calling thread so far. Only builds with
+// CRS_COUNT_ALLOCATIONS (make bench) count them, see allocations.cpp; elsewhere
+// allocationsCounted() is false and the count stays 0.
+bool allocationsCounted();
+uint64_t allocationCount();
+
+// Append-only string storage. Chunks never move, so a view handed out stays valid for
+// the arena's lifetime and appending never disturbs readers of earlier strings.
+class StringArena
+{
+    static constexpr size_t kChunkSize = 1 << 20;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<std::shared_ptr<const void>> pinned; // e.g. a mapped snapshot file holding some of the views
+    char *cursor = nullptr;
+    size_t left = 0;
+    size_t used = 0;
+
+public:
+    std::string_view add(std::string_view s)
+    {
+        if (s.empty())
+            return {};
+        if (s.size() > left)
+        {
+            size_t size = std::max(kChunkSize, s.size());
+            chunks.emplace_back(new char[size]);
+            cursor = chunks.back().get();
+            left = size;
+        }
+        std::memcpy(cursor, s.data(), s.size());
+        std::string_view v(cursor, s.size());
+        cursor += s.size();
+        left -= s.size();
+        used += s.size();
+        return v;
+    }
+
+    // keeps memory that views were taken from alive as long as the arena
+    void pin(std::shared_ptr<const void> owner) { pinned.push_back(std::move(owner)); }
+
+    size_t bytes() const { return used; }
+};
+
+struct Asset
+{
+    std::string_view name, symbol, category, type; // owned by the snapshot's StringArena
+    double price, change;
+    long long marketCap;
+    int score;
+    uint16_t categoryId = 0, typeId = 0; // interned category/type
+    double rank = 0;                     // cached calcScore(), refreshed when its inputs change
+    double trend = 0;                    // score points from recent momentum, see trendPoints()
+    std::string_view json = {};          // cached toJSON() fragment, re-added to the arena whenever the asset changes
+};
+
+// read-only bytes of a whole file: mmap where available, otherwise read into memory
+class MappedFile
+{
+    const char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::unique_ptr<char[]> buffer;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (bytes)
+            munmap(const_cast<char *>(bytes), length);
+#endif
+    }
+
+    bool open(const std::string &path)
+    {
+#ifdef _WIN32
+        std::FILE *f = std::fopen(path.c_str(), "rb");
+        if (!f)
+            return false;
+        std::fseek(f, 0, SEEK_END);
+        long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        buffer.reset(new char[size > 0 ? size : 1]);
+        bool ok = size >= 0 && std::fread(buffer.get(), 1, static_cast<size_t>(size), f) == static_cast<size_t>(size);
+        std::fclose(f);
+        bytes = buffer.get();
+        length = ok ? static_cast<size_t>(size) : 0;
+        return ok;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+        if (ok)
+        {
+            void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = p != MAP_FAILED;
+            if (ok)
+            {
+                bytes = static_cast<const char *>(p);
+                length = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// Sections of a binary snapshot: a uint64 element count, then the raw elements padded
+// to 8 bytes. Native byte order and layout, so snapshots only move between like builds.
+class BinaryWriter
+{
+    std::FILE *file;
+    bool ok = true;
+
+public:
+    explicit BinaryWriter(std::FILE *f) : file(f) {}
+
+    void bytes(const void *p, size_t n)
+    {
+        if (n && std::fwrite(p, 1, n, file) != n)
+            ok = false;
+    }
+
+    template <class T>
+    void value(const T &v) { bytes(&v, sizeof(v)); }
+
+    template <class T>
+    void array(const T *p, size_t n)
+    {
+        static const char zeros[8] = {};
+        value<uint64_t>(n);
+        bytes(p, n * sizeof(T));
+        bytes(zeros, (8 - n * sizeof(T) % 8) % 8);
+    }
+
+    bool good() const { return ok; }
+};
+
+class BinaryReader
+{
+    const char *cur, *end;
+
+public:
+    BinaryReader(const char *data, size_t size) : cur(data), end(data + size) {}
+
+    template <class T>
+    bool value(T &v)
+    {
+        if (static_cast<size_t>(end - cur) < sizeof(T))
+            return false;
+        std::memcpy(&v, cur, sizeof(T));
+        cur += sizeof(T);
+        return true;
+    }
+
+    // points data at the section in place; sections start 8-byte aligned
+    template <class T>
+    bool array(const T *&data, size_t &n)
+    {
+        uint64_t count;
+        if (!value(count) || count > static_cast<size_t>(end - cur) / sizeof(T))
+            return false;
+        size_t size = static_cast<size_t>(count) * sizeof(T);
+        data = reinterpret_cast<const T *>(cur);
+        n = static_cast<size_t>(count);
+        cur += std::min(static_cast<size_t>(end - cur), size + (8 - size % 8) % 8);
+        return true;
+    }
+};
+
+// append-only JSON writers; numbers go through to_chars (no locale, no allocation)
+inline void appendNumber(std::string &out, double v)
+{
+    char buf[32];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+// shortest form that reads back as the same float
+inline void appendNumber(std::string &out, float v)
+{
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+inline void appendNumber(std::string &out, long long v)
+{
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+inline void appendString(std::string &out, std::string_view s)
+{
+    out += '"';
+    for (char ch : s)
+    {
+        if (ch == '"' || ch == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out += buf;
+            continue;
+        }
+        out += ch;
+    }
+    out += '"';
+}
+
+// maps a small vocabulary (categories, asset types) to dense ids
+class Interner
+{
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint16_t> ids;
+
+public:
+    uint16_t intern(std::string_view s)
+    {
+        std::string key(s);
+        auto it = ids.find(key);
+        if (it != ids.end())
+            return it->second;
+        uint16_t id = static_cast<uint16_t>(names.size());
+        names.push_back(key);
+        ids.emplace(std::move(key), id);
+        return id;
+    }
+
+    // -1 when s was never interned
+    int find(const std::string &s) const
+    {
+        auto it = ids.find(s);
+        return it == ids.end() ? -1 : it->second;
+    }
+
+    const std::string &name(uint16_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+};
+
+// Epoch-based reclamation. Readers pin the global epoch while they use a published
+// object (two atomic stores, never a lock); writers retire replaced objects with the
+// epoch returned by advance() and free them once quiescent() says no reader can
+// still see them.
+class Epochs
+{
+    static constexpr size_t kMaxThreads = 1024;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> pinned{0}; // 0 = not reading
+    };
+
+    std::unique_ptr<Slot[]> slots{new Slot[kMaxThreads]};
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<size_t> threads{0};
+
+    Slot &mine()
+    {
+        thread_local size_t slot = threads.fetch_add(1);
+        if (slot >= kMaxThreads)
+        {
+            std::cerr << "Epochs: more than " << kMaxThreads << " reader threads\n";
+            std::abort();
+        }
+        return slots[slot];
+    }
+
+public:
+    static Epochs &global()
+    {
+        static Epochs instance;
+        return instance;
+    }
+
+    // nests; only the outermost guard pins
+    class Guard
+    {
+        static unsigned &depth()
+        {
+            thread_local unsigned d = 0;
+            return d;
+        }
+
+    public:
+        Guard()
+        {
+            if (depth()++ == 0)
+                global().mine().pinned.store(global().epoch.load());
+        }
+        ~Guard()
+        {
+            if (--depth() == 0)
+                global().mine().pinned.store(0, std::memory_order_release);
+        }
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    // call after unpublishing an object; it may be freed once quiescent(result)
+    uint64_t advance() { return epoch.fetch_add(1); }
+
+    bool quiescent(uint64_t retiredAt) const
+    {
+        size_t n = std::min(threads.load(), kMaxThreads);
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t e = slots[i].pinned.load();
+            if (e != 0 && e <= retiredAt)
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,2536 @@
+#pragma once
+
+#include "investment.h"
+
+struct ServerConfig
+{
+    int port = 8080;
+    int backlog = SOMAXCONN;
+    int workers = 0; // 0 = one per hardware thread
+    // router mode when not empty: the (IPv4 address, port) of every shard
+    std::vector<std::pair<std::string, int>> shards;
+};
+
+// readiness notification: epoll on linux, poll()/WSAPoll everywhere else
+class Poller
+{
+public:
+    struct Event
+    {
+        void *tag;
+        bool readable, writable, hangup;
+    };
+
+private:
+    int error = 0; // errno of a failed setup, 0 when usable
+#ifdef __linux__
+    int epfd;
+    int wakeFd; // an eventfd that wake() makes readable
+    std::vector<epoll_event> ready;
+#else
+    std::vector<pollfd> fds;
+    std::vector<void *> tags;
+#endif
+
+public:
+    Poller(const Poller &) = delete;
+    Poller &operator=(const Poller &) = delete;
+
+    // 0 when the poller works, otherwise the errno its setup failed with
+    int setupError() const { return error; }
+
+#ifdef __linux__
+    static constexpr bool kWakes = true;
+
+    Poller() : epfd(epoll_create1(0)), wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), ready(256)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = &wakeFd;
+        if (epfd < 0 || wakeFd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev) != 0)
+            error = errno;
+    }
+    ~Poller()
+    {
+        if (wakeFd >= 0)
+            close(wakeFd);
+        if (epfd >= 0)
+            close(epfd);
+    }
+
+    // makes a wait() in progress on another thread return early
+    void wake()
+    {
+        uint64_t one = 1;
+        ssize_t n = ::write(wakeFd, &one, sizeof(one));
+        (void)n;
+    }
+
+    // edge-triggered: callers drain reads/writes until EAGAIN
+    bool add(socket_t fd, void *tag, bool wantWrite)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        ev.data.ptr = tag;
+        return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+    bool modify(socket_t fd, void *tag, bool wantWrite)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        ev.data.ptr = tag;
+        return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+    void remove(socket_t fd) { epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr); }
+
+    int wait(std::vector<Event> &out, int timeoutMs)
+    {
+        out.clear();
+        int n = epoll_wait(epfd, ready.data(), static_cast<int>(ready.size()), timeoutMs);
+        for (int i = 0; i < n; i++)
+        {
+            if (ready[i].data.ptr == &wakeFd)
+            {
+                uint64_t count;
+                ssize_t got = ::read(wakeFd, &count, sizeof(count));
+                (void)got;
+                continue;
+            }
+            uint32_t e = ready[i].events;
+            out.push_back({ready[i].data.ptr, (e & EPOLLIN) != 0, (e & EPOLLOUT) != 0,
+                           (e & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0});
+        }
+        return n;
+    }
+#else
+    // without a wake-up, callers that wait for wake() bound their waits instead
+    static constexpr bool kWakes = false;
+
+    Poller() = default;
+
+    void wake() {}
+
+    bool add(socket_t fd, void *tag, bool wantWrite)
+    {
+        pollfd p{};
+        p.fd = fd;
+        p.events = POLLIN | (wantWrite ? POLLOUT : 0);
+        fds.push_back(p);
+        tags.push_back(tag);
+        return true;
+    }
+    bool modify(socket_t fd, void *, bool wantWrite)
+    {
+        for (auto &p : fds)
+            if (p.fd == fd)
+                p.events = POLLIN | (wantWrite ? POLLOUT : 0);
+        return true;
+    }
+    void remove(socket_t fd)
+    {
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (fds[i].fd != fd) continue;
+            fds[i] = fds.back();
+            fds.pop_back();
+            tags[i] = tags.back();
+            tags.pop_back();
+            return;
+        }
+    }
+
+    int wait(std::vector<Event> &out, int timeoutMs)
+    {
+        out.clear();
+        int n = poll(fds.data(), static_cast<unsigned long>(fds.size()), timeoutMs);
+        for (size_t i = 0; n > 0 && i < fds.size(); i++)
+        {
+            short e = fds[i].revents;
+            if (!e) continue;
+            out.push_back({tags[i], (e & POLLIN) != 0, (e & POLLOUT) != 0,
+                           (e & (POLLERR | POLLHUP)) != 0});
+        }
+        return static_cast<int>(out.size());
+    }
+#endif
+};
+
+struct HttpRequest
+{
+    std::string_view method, path, query, body;
+    int minorVersion = 1;
+    bool keepAlive = true;
+};
+
+// one reply as HttpParser::parseResponse() reads it; the router reads its shards' with it
+struct HttpResponse
+{
+    int status = 0;
+    std::string_view body; // into the caller's buffer, or into decoded for a chunked body
+    std::string decoded;
+    bool keepAlive = true;
+};
+
+// incremental HTTP/1.x request and response parser; the views it fills in point into the
+// caller's buffer
+class HttpParser
+{
+public:
+    enum Status { Incomplete, Complete, Invalid, HeadersTooLarge, BodyTooLarge };
+
+private:
+    size_t scanned = 0; // bytes already searched for the end of the header block
+
+    static bool iequals(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++)
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+                return false;
+        return true;
+    }
+
+    static std::string_view trim(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // finds the end of the header block, resuming the search where the last call left off;
+    // Complete with end at its "\r\n\r\n"
+    Status headerEnd(std::string_view buf, size_t limit, size_t &end)
+    {
+        end = buf.find("\r\n\r\n", scanned > 3 ? scanned - 3 : 0);
+        if (end == std::string_view::npos)
+        {
+            scanned = buf.size();
+            return scanned > limit ? HeadersTooLarge : Incomplete;
+        }
+        if (end + 4 > limit)
+            return HeadersTooLarge;
+        scanned = end;
+        return Complete;
+    }
+
+    // how a message's body is delimited
+    struct Framing
+    {
+        size_t length = 0;
+        bool sized = false, chunked = false; // Content-Length, Transfer-Encoding: chunked
+    };
+
+    // the header lines of head from pos on; false on a malformed line, Content-Length or
+    // Transfer-Encoding other than chunked
+    static bool parseHeaders(std::string_view head, size_t pos, bool &keepAlive, Framing &f)
+    {
+        f = Framing();
+        while (pos < head.size())
+        {
+            size_t next = head.find("\r\n", pos);
+            std::string_view h = head.substr(pos, next - pos);
+            pos = next + 2;
+            size_t colon = h.find(':');
+            if (colon == std::string_view::npos)
+                return false;
+            std::string_view name = h.substr(0, colon);
+            std::string_view value = trim(h.substr(colon + 1));
+            if (iequals(name, "connection"))
+            {
+                if (iequals(value, "close"))
+                    keepAlive = false;
+            }
+            else if (iequals(name, "content-length"))
+            {
+                auto r = std::from_chars(value.data(), value.data() + value.size(), f.length);
+                if (r.ec != std::errc() || r.ptr != value.data() + value.size())
+                    return false;
+                f.sized = true;
+            }
+            else if (iequals(name, "transfer-encoding"))
+            {
+                if (!iequals(value, "chunked"))
+                    return false;
+                f.chunked = true;
+            }
+        }
+        // a message with both is how requests get smuggled past a proxy
+        return !(f.sized && f.chunked);
+    }
+
+    // decodes the chunked body that starts at buf[pos] into out; on Complete, consumed is
+    // where it ends, trailers included. Decoding starts over on every call, which is fine
+    // for the small replies it reads.
+    static Status dechunk(std::string_view buf, size_t pos, size_t limit, std::string &out, size_t &consumed)
+    {
+        out.clear();
+        while (true)
+        {
+            size_t lineEnd = buf.find("\r\n", pos);
+            if (lineEnd == std::string_view::npos)
+                return Incomplete;
+            std::string_view line = buf.substr(pos, lineEnd - pos);
+            line = trim(line.substr(0, line.find(';'))); // chunk extensions are ignored
+            size_t size = 0;
+            auto r = std::from_chars(line.data(), line.data() + line.size(), size, 16);
+            if (line.empty() || r.ec != std::errc() || r.ptr != line.data() + line.size())
+                return Invalid;
+            if (size > limit - out.size())
+                return BodyTooLarge;
+            pos = lineEnd + 2;
+            if (size == 0)
+                break;
+            if (buf.size() - pos < size + 2)
+                return Incomplete;
+            if (buf.compare(pos + size, 2, "\r\n") != 0)
+                return Invalid;
+            out.append(buf.data() + pos, size);
+            pos += size + 2;
+        }
+        // trailer lines, up to an empty one
+        for (size_t lineEnd; (lineEnd = buf.find("\r\n", pos)) != std::string_view::npos; pos = lineEnd + 2)
+            if (lineEnd == pos)
+            {
+                consumed = pos + 2;
+                return Complete;
+            }
+        return Incomplete;
+    }
+
+public:
+    // tries to parse one request from the front of buf; on Complete, consumed is its length.
+    // The header block and the Content-Length may each be up to limit bytes.
+    Status parse(std::string_view buf, HttpRequest &req, size_t &consumed,
+                 size_t limit = std::numeric_limits<size_t>::max())
+    {
+        size_t end;
+        Status found = headerEnd(buf, limit, end);
+        if (found != Complete)
+            return found;
+
+        std::string_view head = buf.substr(0, end + 2);
+        size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = line.rfind(' ');
+        if (sp1 == std::string_view::npos || sp2 == sp1)
+            return Invalid;
+
+        std::string_view version = line.substr(sp2 + 1);
+        if (version == "HTTP/1.1") req.minorVersion = 1;
+        else if (version == "HTTP/1.0") req.minorVersion = 0;
+        else return Invalid;
+
+        req.method = line.substr(0, sp1);
+        std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t qpos = target.find('?');
+        req.path = target.substr(0, qpos);
+        req.query = qpos == std::string_view::npos ? std::string_view() : target.substr(qpos + 1);
+        // HTTP/1.0 clients get one response per connection
+        req.keepAlive = req.minorVersion == 1;
+
+        Framing f;
+        if (!parseHeaders(head, lineEnd + 2, req.keepAlive, f) || f.chunked)
+            return Invalid; // chunked request bodies are not supported
+        if (f.length > limit)
+            return BodyTooLarge;
+
+        size_t bodyStart = end + 4;
+        if (buf.size() - bodyStart < f.length)
+            return Incomplete;
+        req.body = buf.substr(bodyStart, f.length);
+        consumed = bodyStart + f.length;
+        scanned = 0;
+        return Complete;
+    }
+
+    // the same for one response: an HTTP/1.x status line with a three-digit status, and a
+    // body framed by Content-Length or chunked. A body that runs until the connection
+    // closes is Invalid, as it cannot be told from one cut short.
+    Status parseResponse(std::string_view buf, HttpResponse &res, size_t &consumed,
+                         size_t limit = std::numeric_limits<size_t>::max())
+    {
+        size_t end;
+        Status found = headerEnd(buf, limit, end);
+        if (found != Complete)
+            return found;
+
+        std::string_view head = buf.substr(0, end + 2);
+        size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        if (line.size() < 12 || (line.compare(0, 9, "HTTP/1.1 ") != 0 && line.compare(0, 9, "HTTP/1.0 ") != 0) ||
+            (line.size() > 12 && line[12] != ' '))
+            return Invalid;
+        auto r = std::from_chars(line.data() + 9, line.data() + 12, res.status);
+        if (r.ec != std::errc() || r.ptr != line.data() + 12 || res.status < 100 || res.status > 599)
+            return Invalid;
+        res.keepAlive = line[7] == '1';
+
+        Framing f;
+        if (!parseHeaders(head, lineEnd + 2, res.keepAlive, f))
+            return Invalid;
+        size_t bodyStart = end + 4;
+        if (f.chunked)
+        {
+            Status body = dechunk(buf, bodyStart, limit, res.decoded, consumed);
+            if (body != Complete)
+                return body;
+            res.body = res.decoded;
+            scanned = 0;
+            return Complete;
+        }
+        // informational, 204 and 304 replies have no body whatever their headers say
+        if (res.status < 200 || res.status == 204 || res.status == 304)
+            f = Framing();
+        else if (!f.sized)
+            return Invalid;
+        if (f.length > limit)
+            return BodyTooLarge;
+        if (buf.size() - bodyStart < f.length)
+            return Incomplete;
+        res.body = buf.substr(bodyStart, f.length);
+        consumed = bodyStart + f.length;
+        scanned = 0;
+        return Complete;
+    }
+};
+
+// Request counters and histograms of one worker thread. Only the owning worker writes
+// a block, so an update is a relaxed load and store with no locked instruction; a
+// /api/metrics scrape reads every worker's block and sums them.
+class RequestMetrics
+{
+public:
+    enum Route { Search, Recommend, Stats, Profile, Ticks, Cache, Metrics, Movers, Query, Similar, Stream, Other, RouteCount };
+    enum Stage { Parse, Routing, Compute, Serialize, Send, Total, StageCount };
+    static constexpr const char *kRouteNames[RouteCount] = {"search", "recommend", "stats", "profile",
+                                                           "ticks", "cache", "metrics", "movers", "query",
+                                                           "similar", "stream", "other"};
+    static constexpr const char *kStageNames[StageCount] = {"parse", "route", "compute", "serialize", "send", "total"};
+    // upper bounds in ns (1 us to 100 ms) and in trie nodes / list entries
+    static constexpr std::array<uint64_t, 16> kTimeBounds = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+                                                             500000, 1000000, 2500000, 5000000, 10000000, 25000000,
+                                                             50000000, 100000000};
+    static constexpr std::array<uint64_t, 11> kCountBounds = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+    template <size_t N>
+    struct Histogram
+    {
+        std::atomic<uint64_t> counts[N + 1] = {}; // the last one counts values above every bound
+        std::atomic<uint64_t> sum{0};
+
+        void add(uint64_t v, const std::array<uint64_t, N> &bounds)
+        {
+            bump(counts[std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin()]);
+            bump(sum, v);
+        }
+    };
+
+    std::atomic<uint64_t> requests[RouteCount] = {}, cached[RouteCount] = {}, rejected{0}, allocations{0};
+    std::atomic<uint64_t> shardFailures{0}; // router mode: requests a shard did not answer
+    std::atomic<uint64_t> shed{0};          // connections closed unanswered for want of descriptors
+    // /api/stream subscribers opened and closed here, events queued to them, and the
+    // subscribers dropped for falling too far behind
+    std::atomic<uint64_t> streamsOpened{0}, streamsClosed{0}, streamEvents{0}, streamsDropped{0};
+    Histogram<16> stages[RouteCount][StageCount];
+    Histogram<11> trieDepth, trieCandidates;
+
+    static void bump(std::atomic<uint64_t> &a, uint64_t by = 1)
+    {
+        a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    static Route routeOf(std::string_view path)
+    {
+        if (path.compare(0, 5, "/api/") == 0)
+            for (int r = 0; r < Other; r++)
+                if (path.substr(5) == kRouteNames[r])
+                    return static_cast<Route>(r);
+        return Other;
+    }
+};
+
+// Access-log lines from one worker to the log thread. The worker writes a slot and
+// publishes it by moving tail; the log thread reads up to tail and hands the slots
+// back by moving head. A full ring drops the line instead of making the worker wait.
+class LogRing
+{
+public:
+    struct Entry
+    {
+        int64_t unixMillis;
+        uint32_t micros, bytes;
+        uint16_t status, length;
+        char text[172]; // "METHOD path?query", cut to fit
+    };
+
+private:
+    static constexpr size_t kCapacity = 1024;
+    std::unique_ptr<Entry[]> slots{new Entry[kCapacity]};
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+
+public:
+    // worker side
+    void push(std::string_view method, std::string_view path, std::string_view query, uint16_t status,
+              uint32_t micros, size_t bytes)
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == kCapacity)
+        {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        Entry &e = slots[t % kCapacity];
+        e.unixMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+        e.micros = micros;
+        e.bytes = static_cast<uint32_t>(std::min<size_t>(bytes, UINT32_MAX));
+        e.status = status;
+        size_t n = 0;
+        auto put = [&](std::string_view s)
+        {
+            size_t take = std::min(s.size(), sizeof(e.text) - n);
+            std::memcpy(e.text + n, s.data(), take);
+            n += take;
+        };
+        put(method.empty() ? "-" : method);
+        put(" ");
+        put(path.empty() ? "-" : path);
+        if (!query.empty())
+        {
+            put("?");
+            put(query);
+        }
+        e.length = static_cast<uint16_t>(n);
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    // log thread side: calls fn(entry) for everything published so far; returns the count
+    template <class Fn>
+    size_t drain(Fn &&fn)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_acquire);
+        for (uint64_t i = h; i < t; i++)
+            fn(static_cast<const Entry &>(slots[i % kCapacity]));
+        head.store(t, std::memory_order_release);
+        return static_cast<size_t>(t - h);
+    }
+
+    uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+class SimpleHTTPServer
+{
+    friend struct MicroBench;
+    friend struct ServerTest;
+
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kScratchBytes = 16 * 1024;
+    static constexpr std::chrono::seconds kShardTimeout{2};
+    // the least time between two rounds of stream events, so a burst of updates goes out
+    // as one, and how long a subscriber may go without hearing anything before it gets a
+    // keep-alive comment
+    static constexpr std::chrono::milliseconds kStreamInterval{100};
+    static constexpr std::chrono::seconds kStreamPing{15};
+    static constexpr size_t kMaxStreamBacklog = 256 * 1024; // unsent bytes before a subscriber is dropped
+    static constexpr int kStreamSendBuffer = 64 * 1024;      // so a stalled subscriber shows up in the backlog
+    static constexpr size_t kMaxStreamSymbols = 32;
+    static constexpr int kAcceptRetryMs = 100; // after accept() failed for want of resources
+
+    struct WorkerState;
+
+    // one server-sent event, built once and shared by every subscriber it goes to
+    struct StreamEvent
+    {
+        std::string topic; // "stats", "recommend:<type>", "price:<symbol>", or "" for keep-alives
+        std::string frame; // "event: ...\ndata: ...\n\n"
+        uint64_t round;    // the stream round that published it
+    };
+    using EventPtr = std::shared_ptr<const StreamEvent>;
+
+    // a topic someone subscribes to: what its last event was built from, to tell a change,
+    // and that event, which new subscribers start with
+    struct Topic
+    {
+        size_t subscribers = 0;
+        std::string state;
+        EventPtr current;
+        uint64_t generation = 0; // of the data state was built from, or an older one
+    };
+
+    // a request the router sent every shard (or one), until the last reply is in
+    struct FanOut
+    {
+        size_t awaiting = 0; // replies still to come
+        RequestMetrics::Route route = RequestMetrics::Other;
+        bool keepAlive = true;
+        std::string method, path, query; // for the access log
+        Clock::time_point at[RequestMetrics::StageCount];
+        std::vector<uint16_t> status; // per shard; 0 while missing or when the shard failed
+        std::vector<std::string> replies;
+        int single = -1; // the one shard asked, or -1 when every shard is
+    };
+
+    // per-socket state; reads and writes may complete in pieces
+    struct Connection
+    {
+        socket_t fd;
+        uint64_t id = 0; // tells apart connections that reuse an fd
+        WorkerState *worker;
+        HttpParser parser;
+        std::string in;
+        std::string out;  // bytes queued behind a full socket buffer
+        std::string head, body; // response being built; capacity is reused across requests
+        std::string query, type, user, window, symbol, symbols;
+        bool fuzzy = false;
+        bool partial = false; // partial=1: answer as a shard, for the router to merge
+        size_t k = 0;      // /api/similar; 0 when out of range
+        AssetQuery filter; // /api/query
+        std::string cacheKey;
+        size_t sent = 0;
+        bool wantWrite = false;
+        bool closing = false; // stop reading, close once out is flushed
+        FanOut fanout;        // router mode; requests behind it wait until it is answered
+        // /api/stream: once streaming, the connection reads no more requests and gets the
+        // events of its topics published after round `since`; pushes holds those not yet
+        // written, the first one pushSent bytes in
+        bool streaming = false;
+        std::vector<std::string> topics;
+        uint64_t since = 0;
+        std::deque<EventPtr> pushes;
+        size_t pushSent = 0, pushBytes = 0;
+    };
+
+    // router mode: a worker's persistent connection to one shard. Requests are pipelined
+    // on it, so replies come back in the order of waiting.
+    struct Upstream
+    {
+        struct Waiter
+        {
+            socket_t client;
+            uint64_t id;
+            Clock::time_point since;
+        };
+
+        size_t shard = 0;
+        socket_t fd = static_cast<socket_t>(-1);
+        std::string in, out;
+        size_t sent = 0;
+        HttpParser parser; // reads the replies in `in`
+        HttpResponse reply;
+        bool wantWrite = false;
+        bool connecting = false; // connect() still in flight; output waits until it is writable
+        bool broken = false;     // failed mid-stream; its waiters are failed by the next sweep
+        std::deque<Waiter> waiting;
+    };
+
+    // what a worker thread owns
+    struct WorkerState
+    {
+        RequestMetrics metrics;
+        LogRing log;
+        // scratch for one request's temporaries, released after each response; a request
+        // that outgrows the buffer takes the rest from the heap until then
+        alignas(std::max_align_t) char scratchBuffer[kScratchBytes];
+        std::pmr::monotonic_buffer_resource scratch{scratchBuffer, sizeof(scratchBuffer)};
+        Poller poller;
+        std::unordered_map<socket_t, std::unique_ptr<Connection>> conns;
+        std::vector<std::unique_ptr<Connection>> closed;  // until the current events are handled
+        std::vector<std::unique_ptr<Upstream>> upstreams; // router mode, one per shard
+        uint64_t accepted = 0;
+#ifndef _WIN32
+        int spareFd = -1; // held open to be given up when accept() runs out of descriptors
+#endif
+        std::unordered_map<std::string, std::vector<Connection *>> subscribers; // by stream topic
+        std::vector<EventPtr> inbox; // from the stream thread, under streamMutex
+        std::atomic<bool> mail{false};
+    };
+
+    InvestmentSystem &system;
+    ServerConfig config;
+    std::vector<std::unique_ptr<WorkerState>> workerStates; // one per worker, made before they start
+    std::atomic<bool> logging{false};
+    std::atomic<bool> streaming{false};
+    std::mutex streamMutex; // topics, streamRound and the workers' inboxes
+    std::unordered_map<std::string, Topic> topics;
+    uint64_t streamRound = 0;
+
+    static constexpr size_t kMaxRequestBytes = 64 * 1024;
+    static constexpr size_t kDefaultSimilar = 10; // /api/similar results without k=
+    // stop parsing pipelined requests while this much output is still unsent
+    static constexpr size_t kMaxPendingOutput = 1024 * 1024;
+
+
+    // URL-decode + and %XX, appending to out (malformed escapes are kept verbatim)
+    template <class String>
+    static void urlDecode(std::string_view s, String &out)
+    {
+        auto hex = [](char c) -> int
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        };
+        out.reserve(out.size() + s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '+') out += ' ';
+            else if (s[i] == '%' && i + 2 < s.size() && hex(s[i + 1]) >= 0 && hex(s[i + 2]) >= 0)
+            {
+                out += static_cast<char>((hex(s[i + 1]) << 4) | hex(s[i + 2]));
+                i += 2;
+            }
+            else out += s[i];
+        }
+    }
+
+    // calls fn(key, rawValue) for every key=value pair, without copying
+    template <class Fn>
+    static void parseQuery(std::string_view queryStr, Fn &&fn)
+    {
+        while (!queryStr.empty())
+        {
+            size_t amp = queryStr.find('&');
+            std::string_view pair = queryStr.substr(0, amp);
+            size_t eq = pair.find('=');
+            if (eq != std::string_view::npos)
+                fn(pair.substr(0, eq), pair.substr(eq + 1));
+            queryStr = (amp == std::string_view::npos) ? std::string_view() : queryStr.substr(amp + 1);
+        }
+    }
+
+    // the status line text for the statuses computeBody() and the router answer with
+    static const char *statusText(uint16_t status)
+    {
+        switch (status)
+        {
+        case 200:
+            return "200 OK";
+        case 400:
+            return "400 Bad Request";
+        case 404:
+            return "404 Not Found";
+        default:
+            return "502 Bad Gateway";
+        }
+    }
+
+    static void buildHead(std::string &head, const char *status, size_t bodyLength, bool keepAlive,
+                          const char *contentType = "application/json")
+    {
+        head.clear();
+        head += "HTTP/1.1 ";
+        head += status;
+        head += "\r\nContent-Type: ";
+        head += contentType;
+        head += "\r\nAccess-Control-Allow-Origin: *\r\n"
+                "Content-Length: ";
+        appendNumber(head, static_cast<long long>(bodyLength));
+        head += keepAlive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    }
+
+    // /api/stats, /api/recommend, /api/movers and /api/similar depend only on the data and
+    // `type`, `window`, `symbol` and `k`, so their full responses are cached per data
+    // generation; false when req is not cacheable. Types and symbols are checked by
+    // computeBody() against the snapshot it reads, and only known ones answered with 200
+    // are stored, so clients cannot grow the cache with made-up names.
+    bool makeCacheKey(const HttpRequest &req, Connection &c)
+    {
+        if (req.method != "GET" || (req.path != "/api/stats" && req.path != "/api/recommend" && req.path != "/api/movers" &&
+                                    req.path != "/api/similar"))
+            return false;
+        c.cacheKey.assign(req.path.data(), req.path.size());
+        if (req.path == "/api/recommend")
+        {
+            // personal rankings change with their profile, not the data generation
+            if (!c.user.empty())
+                return false;
+            c.cacheKey += '?';
+            c.cacheKey += c.type;
+        }
+        if (req.path == "/api/movers")
+        {
+            if (!c.window.empty() && PriceStats::window(c.window) < 0)
+                return false;
+            c.cacheKey += '?';
+            c.cacheKey += c.window;
+            c.cacheKey += '&';
+            c.cacheKey += c.type;
+        }
+        if (req.path == "/api/similar")
+        {
+            if (c.k == 0)
+                return false;
+            c.cacheKey += '?';
+            c.cacheKey += c.symbol;
+            c.cacheKey += '&';
+            appendNumber(c.cacheKey, static_cast<long long>(c.k));
+        }
+        if (c.partial)
+            c.cacheKey += "|partial";
+        if (!req.keepAlive)
+            c.cacheKey += "|close";
+        return true;
+    }
+
+    // at[0] is when parsing started and at[s + 1] when stage s ended; stages a cached
+    // response skips are left out
+    static void recordStages(RequestMetrics &m, RequestMetrics::Route route, const Clock::time_point *at, bool cached)
+    {
+        auto ns = [](Clock::time_point a, Clock::time_point b)
+        { return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count()); };
+        RequestMetrics::bump(m.requests[route]);
+        if (cached)
+            RequestMetrics::bump(m.cached[route]);
+        for (int s = RequestMetrics::Parse; s < RequestMetrics::Total; s++)
+            if (!cached || (s != RequestMetrics::Compute && s != RequestMetrics::Serialize))
+                m.stages[route][s].add(ns(at[s], at[s + 1]), RequestMetrics::kTimeBounds);
+        m.stages[route][RequestMetrics::Total].add(ns(at[0], at[RequestMetrics::Total]), RequestMetrics::kTimeBounds);
+    }
+
+    static void logRequest(Connection &c, const HttpRequest &req, uint16_t status, Clock::time_point start, size_t bytes)
+    {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+        c.worker->log.push(req.method, req.path, req.query, status, static_cast<uint32_t>(micros), bytes);
+    }
+
+    // answers req, from the response cache when possible; at[0] and at[1] hold when
+    // parsing started and ended
+    void handleRequest(const HttpRequest &req, Connection &c, Clock::time_point *at)
+    {
+        using M = RequestMetrics;
+        M::Route route = M::routeOf(req.path);
+        c.query.clear();
+        c.type.clear();
+        c.user.clear();
+        c.window.clear();
+        c.symbol.clear();
+        c.symbols.clear();
+        c.fuzzy = false;
+        c.partial = false;
+        c.k = kDefaultSimilar;
+        parseQuery(req.query, [&](std::string_view k, std::string_view v)
+                   {
+                       if (k == "q") { c.query.clear(); urlDecode(v, c.query); }
+                       else if (k == "type") { c.type.clear(); urlDecode(v, c.type); }
+                       else if (k == "fuzzy") c.fuzzy = v == "1" || v == "true";
+                       else if (k == "partial") c.partial = v == "1";
+                       else if (k == "user") { c.user.clear(); urlDecode(v, c.user); }
+                       else if (k == "window") { c.window.clear(); urlDecode(v, c.window); }
+                       else if (k == "symbol") { c.symbol.clear(); urlDecode(v, c.symbol); }
+                       else if (k == "symbols") { c.symbols.clear(); urlDecode(v, c.symbols); }
+                       else if (k == "k")
+                       {
+                           auto r = std::from_chars(v.data(), v.data() + v.size(), c.k);
+                           if (r.ec != std::errc() || r.ptr != v.data() + v.size() || c.k > SimilarityIndex::kNeighbors)
+                               c.k = 0;
+                       }
+                   });
+        if (!config.shards.empty() && forward(req, c, route, at))
+            return;
+        if (route == M::Stream && req.method == "GET")
+        {
+            subscribe(req, c, at);
+            return;
+        }
+
+        uint64_t generation = system.dataGeneration();
+        bool cacheable = makeCacheKey(req, c);
+        if (cacheable)
+        {
+            if (ResponseCache::Entry hit = system.responses().find(c.cacheKey, generation))
+            {
+                at[M::Routing + 1] = at[M::Compute + 1] = at[M::Serialize + 1] = Clock::now();
+                write(c, hit->head, hit->body);
+                at[M::Send + 1] = Clock::now();
+                recordStages(c.worker->metrics, route, at, true);
+                logRequest(c, req, 200, at[0], hit->head.size() + hit->body.size());
+                return;
+            }
+        }
+        at[M::Routing + 1] = Clock::now();
+
+        bool known = true;
+        uint16_t status = computeBody(req, c, known);
+        at[M::Compute + 1] = Clock::now();
+        if (route == M::Search)
+        {
+            const Trie::SearchStats &walked = Trie::lastSearch();
+            c.worker->metrics.trieDepth.add(walked.depth, M::kCountBounds);
+            c.worker->metrics.trieCandidates.add(walked.candidates, M::kCountBounds);
+        }
+        buildHead(c.head, statusText(status), c.body.size(), req.keepAlive,
+                  route == M::Metrics ? "text/plain; version=0.0.4" : "application/json");
+        if (cacheable && known && status == 200)
+            system.responses().store(c.cacheKey, generation, c.head, c.body);
+        at[M::Serialize + 1] = Clock::now();
+        write(c, c.head, c.body);
+        at[M::Send + 1] = Clock::now();
+        recordStages(c.worker->metrics, route, at, false);
+        logRequest(c, req, status, at[0], c.head.size() + c.body.size());
+    }
+
+    // the event for topic as of the current data, to go out in round, and in state what
+    // tells a change of it (the top list's symbols for recommendations, the event itself
+    // otherwise); null for a symbol that has gone. Takes no lock.
+    std::shared_ptr<StreamEvent> topicEvent(const std::string &topic, uint64_t round, std::string &state)
+    {
+        auto event = std::make_shared<StreamEvent>();
+        event->topic = topic;
+        event->round = round;
+        std::string &frame = event->frame;
+        state.clear();
+        if (topic == "stats")
+        {
+            frame = "event: stats\ndata: ";
+            system.getStatsJSON(frame);
+            state = frame;
+        }
+        else if (topic.compare(0, 10, "recommend:") == 0)
+        {
+            std::string type = topic.substr(10);
+            system.recommendedSymbols(type, state);
+            frame = "event: recommend\ndata: {\"type\":";
+            appendString(frame, type);
+            frame += ",\"assets\":";
+            system.getRecommendationsJSON(type, "", frame);
+            frame += '}';
+        }
+        else
+        {
+            frame = "event: price\ndata: ";
+            if (!system.assetJSON(topic.substr(6), frame))
+                return nullptr;
+            state = frame;
+        }
+        frame += "\n\n";
+        return event;
+    }
+
+    // GET /api/stream: a Server-Sent Events stream that stays open. The subscriber gets
+    // the current stats, recommendations for each of the comma-separated `type`s (all
+    // types when there is none) and the prices of `symbols` at once, then an event
+    // whenever one of them changes.
+    void subscribe(const HttpRequest &req, Connection &c, Clock::time_point *at)
+    {
+        using M = RequestMetrics;
+        c.topics.clear();
+        c.topics.emplace_back(); // keep-alives
+        c.topics.emplace_back("stats");
+        const char *error = nullptr;
+        for (size_t from = 0; !error && from < c.type.size();)
+        {
+            size_t comma = std::min(c.type.find(',', from), c.type.size());
+            std::string type = c.type.substr(from, comma - from);
+            from = comma + 1;
+            if (type.empty())
+                continue;
+            if (!system.knownType(type))
+                error = "{\"error\":\"Unknown type\"}";
+            else
+                c.topics.push_back("recommend:" + type);
+        }
+        if (c.topics.size() == 2)
+            c.topics.emplace_back("recommend:");
+        const size_t maxTopics = c.topics.size() + kMaxStreamSymbols;
+        for (size_t from = 0; !error && from < c.symbols.size();)
+        {
+            size_t comma = std::min(c.symbols.find(',', from), c.symbols.size());
+            std::string symbol = c.symbols.substr(from, comma - from);
+            from = comma + 1;
+            if (symbol.empty())
+                continue;
+            if (c.topics.size() == maxTopics)
+                error = "{\"error\":\"Too many symbols\"}";
+            else if (!system.knownSymbol(symbol))
+                error = "{\"error\":\"Unknown symbol\"}";
+            else
+                c.topics.push_back("price:" + symbol);
+        }
+        at[M::Routing + 1] = Clock::now();
+        if (error)
+        {
+            c.topics.clear();
+            c.body = error;
+            respond(c, "400 Bad Request", req.keepAlive);
+            at[M::Compute + 1] = at[M::Serialize + 1] = at[M::Send + 1] = Clock::now();
+            recordStages(c.worker->metrics, M::Stream, at, false);
+            logRequest(c, req, 400, at[0], c.head.size() + c.body.size());
+            return;
+        }
+        std::sort(c.topics.begin() + 2, c.topics.end());
+        c.topics.erase(std::unique(c.topics.begin() + 2, c.topics.end()), c.topics.end());
+
+        c.streaming = true;
+        setsockopt(c.fd, SOL_SOCKET, SO_SNDBUF, (const char *)&kStreamSendBuffer, sizeof(kStreamSendBuffer));
+        c.head = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                 "Access-Control-Allow-Origin: *\r\n\r\n";
+        write(c, c.head);
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            c.since = streamRound;
+            for (const auto &name : c.topics)
+            {
+                Topic &t = topics[name];
+                if (t.subscribers++ == 0 && !name.empty())
+                {
+                    t.generation = system.dataGeneration();
+                    t.current = topicEvent(name, streamRound, t.state);
+                }
+                if (t.current)
+                    queueEvent(c, t.current);
+            }
+        }
+        for (const auto &name : c.topics)
+            c.worker->subscribers[name].push_back(&c);
+        M::bump(c.worker->metrics.streamsOpened);
+        at[M::Compute + 1] = at[M::Serialize + 1] = at[M::Send + 1] = Clock::now();
+        recordStages(c.worker->metrics, M::Stream, at, false);
+        logRequest(c, req, 200, at[0], c.head.size());
+    }
+
+    // takes a closing subscriber off its topics; a topic nobody follows any more is dropped
+    void unsubscribe(WorkerState &w, Connection &c)
+    {
+        for (const auto &name : c.topics)
+        {
+            auto it = w.subscribers.find(name);
+            auto &list = it->second;
+            *std::find(list.begin(), list.end(), &c) = list.back();
+            list.pop_back();
+            if (list.empty())
+                w.subscribers.erase(it);
+        }
+        std::lock_guard<std::mutex> lock(streamMutex);
+        for (const auto &name : c.topics)
+        {
+            auto it = topics.find(name);
+            if (--it->second.subscribers == 0)
+                topics.erase(it);
+        }
+        RequestMetrics::bump(w.metrics.streamsClosed);
+    }
+
+    // queues event for subscriber c. One that has fallen kMaxStreamBacklog behind is
+    // dropped instead; its client reconnects and starts over from the current state.
+    static void queueEvent(Connection &c, const EventPtr &event)
+    {
+        if (c.pushBytes + event->frame.size() > kMaxStreamBacklog)
+        {
+            c.pushes.clear();
+            c.pushBytes = c.pushSent = 0;
+            c.closing = true;
+            RequestMetrics::bump(c.worker->metrics.streamsDropped);
+            return;
+        }
+        c.pushes.push_back(event);
+        c.pushBytes += event->frame.size();
+        RequestMetrics::bump(c.worker->metrics.streamEvents);
+    }
+
+    // hands what the stream thread published to this worker's subscribers and starts
+    // writing to them
+    void deliverStream(WorkerState &w)
+    {
+        static thread_local std::vector<EventPtr> mail;
+        static thread_local std::vector<Connection *> touched;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            mail.swap(w.inbox);
+        }
+        for (const EventPtr &event : mail)
+        {
+            auto it = w.subscribers.find(event->topic);
+            if (it == w.subscribers.end())
+                continue;
+            // a subscriber started with the topic's current event, which may be this one
+            for (Connection *c : it->second)
+                if (event->round > c->since && !c->closing)
+                {
+                    queueEvent(*c, event);
+                    touched.push_back(c);
+                }
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (Connection *c : touched)
+            settle(w, *c, true);
+        mail.clear();
+        touched.clear();
+    }
+
+    // Woken by every published snapshot: rebuilds the event of every topic someone follows,
+    // once, outside streamMutex, so subscribe() and deliverStream() do not wait on it, then
+    // swaps in and publishes to every worker those that changed. Rounds are kStreamInterval
+    // apart at least. Also publishes a keep-alive comment every kStreamPing.
+    void streamLoop()
+    {
+        struct Built
+        {
+            std::string name, state;
+            std::shared_ptr<StreamEvent> event;
+        };
+        uint64_t seen = system.dataGeneration();
+        auto pinged = Clock::now();
+        std::vector<Built> built;
+        std::vector<EventPtr> batch;
+        while (streaming.load(std::memory_order_acquire))
+        {
+            uint64_t generation = system.waitForData(seen, pinged + kStreamPing, streaming);
+            auto now = Clock::now();
+            bool changed = generation != seen, ping = now - pinged >= kStreamPing;
+            if (!changed && !ping)
+                continue;
+            seen = generation;
+            if (ping)
+                pinged = now;
+            size_t count = 0;
+            {
+                std::lock_guard<std::mutex> lock(streamMutex);
+                if (topics.empty())
+                    continue;
+                for (auto &entry : topics)
+                {
+                    if (!changed || entry.first.empty())
+                        continue;
+                    if (count == built.size())
+                        built.emplace_back();
+                    built[count++].name = entry.first;
+                }
+            }
+            for (size_t i = 0; i < count; i++)
+                built[i].event = topicEvent(built[i].name, 0, built[i].state);
+
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> lock(streamMutex);
+                streamRound++;
+                for (size_t i = 0; i < count; i++)
+                {
+                    Built &b = built[i];
+                    auto it = topics.find(b.name);
+                    // unfollowed meanwhile, gone, unchanged, or rebuilt by subscribe() from newer data
+                    if (it == topics.end() || !b.event || b.state == it->second.state || it->second.generation > generation)
+                        continue;
+                    Topic &t = it->second;
+                    b.event->round = streamRound;
+                    t.state.swap(b.state);
+                    t.generation = generation;
+                    t.current = b.event;
+                    batch.push_back(std::move(b.event));
+                }
+                if (ping)
+                    batch.push_back(std::make_shared<const StreamEvent>(StreamEvent{"", ": ping\n\n", streamRound}));
+                for (auto &w : workerStates)
+                    if (!batch.empty())
+                    {
+                        w->inbox.insert(w->inbox.end(), batch.begin(), batch.end());
+                        w->mail.store(true, std::memory_order_release);
+                    }
+            }
+            if (!batch.empty())
+                for (auto &w : workerStates)
+                    w->poller.wake();
+            if (changed)
+                std::this_thread::sleep_until(now + kStreamInterval);
+        }
+    }
+
+    // Router mode. Search, recommendations, stats, ticks and profile updates go to every
+    // shard with partial=1 and the replies are merged. A profile's categories are checked
+    // here, against the router's own universe, as no shard knows them all; it is read from
+    // the shard its user hashes to. The rest have no merge and are refused. False for a
+    // route the router answers itself (metrics, cache). The connection reads no further
+    // request until the last reply is in.
+    bool forward(const HttpRequest &req, Connection &c, RequestMetrics::Route route, Clock::time_point *at)
+    {
+        using M = RequestMetrics;
+        if (route == M::Metrics || route == M::Cache)
+            return false;
+        FanOut &f = c.fanout;
+        f.route = route;
+        f.keepAlive = req.keepAlive;
+        f.method.assign(req.method.data(), req.method.size());
+        f.path.assign(req.path.data(), req.path.size());
+        f.query.assign(req.query.data(), req.query.size());
+        std::copy(at, at + M::StageCount, f.at);
+        f.at[M::Routing + 1] = Clock::now();
+        const size_t shards = config.shards.size();
+        f.status.assign(shards, 0);
+        f.replies.resize(shards);
+        for (auto &r : f.replies)
+            r.clear();
+        f.single = -1;
+
+        bool post = req.method == "POST";
+        bool merged = (!post && (route == M::Search || route == M::Recommend || route == M::Stats)) ||
+                      (post && (route == M::Ticks || route == M::Profile));
+        if (!merged && !(route == M::Profile && req.method == "GET"))
+        {
+            c.body = "{\"error\":\"Not available on the router\"}";
+            f.awaiting = 0;
+            finishFanOut(c, "404 Not Found");
+            return true;
+        }
+        if (post && route == M::Profile)
+        {
+            std::pmr::vector<std::pair<std::string_view, float>> weights(&c.worker->scratch);
+            weights.reserve(ProfileStore::kMaxWeights);
+            if (!parseProfile(req.body, weights) || !system.validProfile(c.user, weights))
+            {
+                c.body = "{\"error\":\"Bad profile\"}";
+                f.awaiting = 0;
+                finishFanOut(c, "400 Bad Request");
+                return true;
+            }
+        }
+
+        std::string &request = c.head; // free until the response is built
+        request.clear();
+        request.append(req.method.data(), req.method.size());
+        request += ' ';
+        request.append(req.path.data(), req.path.size());
+        request += '?';
+        request.append(req.query.data(), req.query.size());
+        if (merged)
+            request += req.query.empty() ? "partial=1" : "&partial=1";
+        request += " HTTP/1.1\r\nHost: shard\r\n";
+        if (post)
+        {
+            request += "Content-Length: ";
+            appendNumber(request, static_cast<long long>(req.body.size()));
+            request += "\r\n";
+        }
+        request += "\r\n";
+        request.append(req.body.data(), req.body.size());
+
+        size_t first = 0, last = shards;
+        if (!merged)
+        {
+            f.single = static_cast<int>(ShardSpec::hash(c.user) % shards);
+            first = static_cast<size_t>(f.single);
+            last = first + 1;
+        }
+        f.awaiting = last - first;
+        for (size_t i = first; i < last; i++)
+            if (!sendUpstream(*c.worker, *c.worker->upstreams[i], request, c))
+                f.awaiting--; // stays failed
+        if (f.awaiting == 0)
+            finishFanOut(c, nullptr);
+        return true;
+    }
+
+    // starts connecting u to its shard without blocking the worker; the connect finishes
+    // in onUpstreamEvent, and a shard that never answers is timed out by sweepUpstreams
+    bool connectUpstream(WorkerState &w, Upstream &u)
+    {
+        const auto &[host, port] = config.shards[u.shard];
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+            return false;
+        socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == static_cast<socket_t>(-1))
+            return false;
+        bool connected = setNonBlocking(fd) && connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        if (!connected && !connectPending())
+        {
+            closesocket(fd);
+            return false;
+        }
+        if (!w.poller.add(fd, &u, !connected))
+        {
+            closesocket(fd);
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+        u.fd = fd;
+        u.connecting = !connected;
+        u.wantWrite = !connected;
+        return true;
+    }
+
+    // queues request on u for c; false if the shard cannot be reached
+    bool sendUpstream(WorkerState &w, Upstream &u, std::string_view request, Connection &c)
+    {
+        if (u.broken || (u.fd == static_cast<socket_t>(-1) && !connectUpstream(w, u)))
+            return false;
+        u.out.append(request);
+        u.waiting.push_back({c.fd, c.id, Clock::now()});
+        flushUpstream(w, u);
+        return true;
+    }
+
+    void flushUpstream(WorkerState &w, Upstream &u)
+    {
+        if (u.connecting)
+            return;
+        while (u.sent < u.out.size())
+        {
+#ifdef MSG_NOSIGNAL
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            int n = static_cast<int>(send(u.fd, u.out.data() + u.sent, static_cast<int>(u.out.size() - u.sent), flags));
+            if (n > 0)
+            {
+                u.sent += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+                break;
+            u.broken = true;
+            return;
+        }
+        if (u.sent == u.out.size())
+        {
+            u.out.clear();
+            u.sent = 0;
+        }
+        bool pending = u.sent < u.out.size();
+        if (pending != u.wantWrite)
+        {
+            u.wantWrite = pending;
+            w.poller.modify(u.fd, &u, pending);
+        }
+    }
+
+    // reads u's replies and hands each to the connection waiting for it
+    void onUpstreamEvent(WorkerState &w, Upstream &u, const Poller::Event &ev)
+    {
+        if (u.fd == static_cast<socket_t>(-1) || u.broken)
+            return;
+        if (u.connecting)
+        {
+            if (!ev.writable && !ev.hangup)
+                return;
+            int error = 0;
+            socklen_t size = sizeof(error);
+            if (getsockopt(u.fd, SOL_SOCKET, SO_ERROR, (char *)&error, &size) != 0 || error != 0)
+            {
+                u.broken = true;
+                return;
+            }
+            u.connecting = false;
+        }
+        if (ev.writable)
+            flushUpstream(w, u);
+        char buffer[16384];
+        bool open = true;
+        while (ev.readable || ev.hangup)
+        {
+            int n = static_cast<int>(recv(u.fd, buffer, sizeof(buffer), 0));
+            if (n > 0)
+            {
+                u.in.append(buffer, static_cast<size_t>(n));
+                continue;
+            }
+            open = n < 0 && wouldBlock();
+            break;
+        }
+        size_t pos = 0;
+        while (!u.broken && !u.waiting.empty())
+        {
+            size_t consumed = 0;
+            HttpParser::Status parsed = u.parser.parseResponse(std::string_view(u.in).substr(pos), u.reply, consumed);
+            if (parsed == HttpParser::Incomplete)
+                break;
+            if (parsed != HttpParser::Complete)
+            {
+                u.broken = true;
+                break;
+            }
+            Upstream::Waiter to = u.waiting.front();
+            u.waiting.pop_front();
+            // copied out: delivering can send on u again, and nothing may move u.in meanwhile
+            std::string body(u.reply.body);
+            pos += consumed;
+            // a shard that closes after this reply answers nothing queued behind it
+            if (!u.reply.keepAlive)
+                open = false;
+            deliver(w, to, u.shard, static_cast<uint16_t>(u.reply.status), body);
+        }
+        u.in.erase(0, pos);
+        if (!open)
+            u.broken = true;
+    }
+
+    // fails the waiters of broken upstreams and of connects or replies overdue by kShardTimeout
+    void sweepUpstreams(WorkerState &w)
+    {
+        auto now = Clock::now();
+        for (auto &up : w.upstreams)
+        {
+            Upstream &u = *up;
+            if (!u.broken && (u.waiting.empty() || now - u.waiting.front().since < kShardTimeout))
+                continue;
+            if (u.fd != static_cast<socket_t>(-1))
+            {
+                w.poller.remove(u.fd);
+                closesocket(u.fd);
+            }
+            std::deque<Upstream::Waiter> failed;
+            failed.swap(u.waiting);
+            u.fd = static_cast<socket_t>(-1);
+            u.in.clear();
+            u.out.clear();
+            u.sent = 0;
+            u.parser = HttpParser();
+            u.connecting = false;
+            u.broken = false;
+            for (const auto &to : failed)
+                deliver(w, to, u.shard, 0, {});
+        }
+    }
+
+    // one shard's reply (status 0 if it failed) for the connection `to` names, if it is
+    // still open; the last one answers the request and resumes the connection
+    void deliver(WorkerState &w, const Upstream::Waiter &to, size_t shard, uint16_t status, std::string_view body)
+    {
+        auto it = w.conns.find(to.client);
+        if (it == w.conns.end() || it->second->id != to.id || it->second->fanout.awaiting == 0)
+            return;
+        Connection &c = *it->second;
+        c.fanout.status[shard] = status;
+        c.fanout.replies[shard].assign(body.data(), body.size());
+        if (--c.fanout.awaiting > 0)
+            return;
+        finishFanOut(c, nullptr);
+        if (!c.closing && !c.in.empty())
+            processInput(c);
+        settle(w, c, true);
+    }
+
+    // merges the replies into c.body and sends the response; failStatus, if given, sends
+    // c.body as it is with that status. A request the shards refuse (a malformed tick batch
+    // or profile, an unknown user) is refused alike by each, and the first refusal is passed
+    // on with its status, so the router answers as a single node would.
+    void finishFanOut(Connection &c, const char *failStatus)
+    {
+        using M = RequestMetrics;
+        FanOut &f = c.fanout;
+        const char *status = failStatus;
+        if (!status)
+        {
+            c.body.clear();
+            auto first = f.status.begin(), last = f.status.end();
+            if (f.single >= 0)
+            {
+                first += f.single;
+                last = first + 1;
+            }
+            auto refusal = [](uint16_t s) { return s == 400 || s == 404; };
+            bool answered = std::all_of(first, last, [&](uint16_t s) { return s == 200 || refusal(s); });
+            auto refused = std::find_if(first, last, refusal);
+            if (answered && refused != last)
+            {
+                c.body = f.replies[static_cast<size_t>(refused - f.status.begin())];
+                status = statusText(*refused);
+            }
+            else if (answered && mergeReplies(f, c.body))
+                status = "200 OK";
+            else
+            {
+                c.body = "{\"error\":\"Shard unavailable\"}";
+                M::bump(c.worker->metrics.shardFailures);
+                status = "502 Bad Gateway";
+            }
+        }
+        f.at[M::Compute + 1] = Clock::now();
+        buildHead(c.head, status, c.body.size(), f.keepAlive);
+        f.at[M::Serialize + 1] = Clock::now();
+        write(c, c.head, c.body);
+        f.at[M::Send + 1] = Clock::now();
+        recordStages(c.worker->metrics, f.route, f.at, false);
+        HttpRequest req;
+        req.method = f.method;
+        req.path = f.path;
+        req.query = f.query;
+        logRequest(c, req, static_cast<uint16_t>(std::atoi(status)), f.at[0], c.head.size() + c.body.size());
+        if (!f.keepAlive)
+            c.closing = true;
+    }
+
+    // a shard's ranked result and what it is merged by
+    struct Ranked
+    {
+        uint32_t typos, row;
+        double key;
+        std::string_view json;
+    };
+
+    // appends the results of a partial answer (InvestmentSystem::appendPartial) to out;
+    // false if it is malformed
+    static bool parsePartial(std::string_view body, std::vector<Ranked> &out)
+    {
+        const size_t first = out.size();
+        auto list = [&](std::string_view name) -> std::string_view
+        {
+            size_t at = body.find(name);
+            if (at == std::string_view::npos)
+                return {};
+            size_t from = at + name.size(), to = body.find(']', from);
+            return to == std::string_view::npos ? std::string_view() : body.substr(from, to - from);
+        };
+        std::string_view keys = list("\"keys\":["), typos = list("\"typos\":["), rows = list("\"rows\":[");
+        size_t at = body.find("\"results\":[");
+        if (at == std::string_view::npos)
+            return false;
+        // fragments are flat objects; braces inside their strings do not count
+        for (size_t i = at + 11; i < body.size() && body[i] != ']';)
+        {
+            if (body[i] == ',')
+            {
+                i++;
+                continue;
+            }
+            if (body[i] != '{')
+                return false;
+            size_t end = i + 1;
+            for (bool quoted = false; end < body.size() && (quoted || body[end] != '}'); end++)
+            {
+                if (body[end] == '\\')
+                    end++;
+                else if (body[end] == '"')
+                    quoted = !quoted;
+            }
+            if (end >= body.size())
+                return false;
+            out.push_back(Ranked{0, 0, 0, body.substr(i, end + 1 - i)});
+            i = end + 1;
+        }
+        auto fill = [&](std::string_view numbers, auto field)
+        {
+            const char *p = numbers.data(), *end = numbers.data() + numbers.size();
+            for (size_t j = first; j < out.size(); j++)
+            {
+                auto r = std::from_chars(p, end, out[j].*field);
+                if (r.ec != std::errc())
+                    return false;
+                p = r.ptr < end && *r.ptr == ',' ? r.ptr + 1 : r.ptr;
+            }
+            return p == end;
+        };
+        return fill(keys, &Ranked::key) && fill(rows, &Ranked::row) &&
+               (typos.data() == nullptr || fill(typos, &Ranked::typos));
+    }
+
+    // sums a number field over the replies; false if one lacks it
+    template <class T>
+    static bool sumField(const std::vector<std::string> &replies, std::string_view name, T &total)
+    {
+        total = 0;
+        for (const auto &body : replies)
+        {
+            size_t at = body.find(name);
+            T v = 0;
+            if (at == std::string::npos ||
+                std::from_chars(body.data() + at + name.size(), body.data() + body.size(), v).ec != std::errc())
+                return false;
+            total += v;
+        }
+        return true;
+    }
+
+    // the router's answer from every shard's 200 reply; false if one is malformed
+    static bool mergeReplies(const FanOut &f, std::string &out)
+    {
+        using M = RequestMetrics;
+        if (f.route == M::Search || f.route == M::Recommend)
+        {
+            static thread_local std::vector<Ranked> all;
+            all.clear();
+            for (const auto &body : f.replies)
+                if (!parsePartial(body, all))
+                    return false;
+            size_t k = std::min(all.size(), f.route == M::Search ? InvestmentSystem::kSearchResults : InvestmentSystem::kRecommendations);
+            std::partial_sort(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(k), all.end(), [](const Ranked &a, const Ranked &b)
+                              { return a.typos != b.typos ? a.typos < b.typos : a.key != b.key ? a.key > b.key : a.row < b.row; });
+            out += '[';
+            for (size_t i = 0; i < k; i++)
+            {
+                if (i > 0)
+                    out += ',';
+                out += all[i].json;
+            }
+            out += ']';
+            return true;
+        }
+        if (f.route == M::Stats)
+        {
+            long long total, cryptos, stocks;
+            double rankSum, capSum;
+            if (!sumField(f.replies, "\"total\":", total) || !sumField(f.replies, "\"cryptos\":", cryptos) ||
+                !sumField(f.replies, "\"stocks\":", stocks) || !sumField(f.replies, "\"rankSum\":", rankSum) ||
+                !sumField(f.replies, "\"capSum\":", capSum))
+                return false;
+            InvestmentSystem::appendStats(out, static_cast<size_t>(total), static_cast<size_t>(cryptos),
+                                          static_cast<size_t>(stocks), rankSum, capSum);
+            return true;
+        }
+        if (f.route == M::Ticks)
+        {
+            long long accepted, dropped;
+            if (!sumField(f.replies, "\"accepted\":", accepted) || !sumField(f.replies, "\"dropped\":", dropped))
+                return false;
+            out += "{\"accepted\":";
+            appendNumber(out, accepted);
+            out += ",\"dropped\":";
+            appendNumber(out, dropped);
+            out += '}';
+            return true;
+        }
+        // profiles: every shard stored the same weights, so any answer stands for all
+        out = f.replies[f.single >= 0 ? static_cast<size_t>(f.single) : 0];
+        return true;
+    }
+
+    void cacheStatsJSON(std::string &out)
+    {
+        ResponseCache &cache = system.responses();
+        out += "{\"hits\":";
+        appendNumber(out, static_cast<long long>(cache.hitCount()));
+        out += ",\"misses\":";
+        appendNumber(out, static_cast<long long>(cache.missCount()));
+        out += ",\"entries\":";
+        appendNumber(out, static_cast<long long>(cache.size()));
+        out += ",\"generation\":";
+        appendNumber(out, static_cast<long long>(system.dataGeneration()));
+        out += '}';
+    }
+
+    // Prometheus text exposition of every worker's metrics plus the data and cache counters;
+    // label sets and series names are built in scratch
+    void metricsText(std::string &out, std::pmr::memory_resource *scratch)
+    {
+        using M = RequestMetrics;
+        auto total = [&](auto field)
+        {
+            uint64_t n = 0;
+            for (auto &w : workerStates)
+                n += field(w->metrics).load(std::memory_order_relaxed);
+            return n;
+        };
+        auto help = [&](const char *name, const char *type, const char *text)
+        {
+            out += "# HELP ";
+            out += name;
+            out += ' ';
+            out += text;
+            out += "\n# TYPE ";
+            out += name;
+            out += ' ';
+            out += type;
+            out += '\n';
+        };
+        auto sample = [&](std::string_view name, std::string_view labels, double value)
+        {
+            out += name;
+            if (!labels.empty())
+            {
+                out += '{';
+                out += labels;
+                out += '}';
+            }
+            out += ' ';
+            appendNumber(out, value);
+            out += '\n';
+        };
+        std::pmr::string labels(scratch), series(scratch);
+        auto routeLabels = [&](int r)
+        {
+            labels = "route=\"";
+            labels += M::kRouteNames[r];
+            labels += '"';
+        };
+        // the buckets of one histogram summed over workers, values divided by unit; pick(m)
+        // selects the histogram in a block
+        auto histogram = [&](const char *name, std::string_view labelSet, const auto &bounds, double unit, auto pick)
+        {
+            uint64_t cumulative = 0, sum = 0;
+            series = name;
+            series += "_bucket{";
+            if (!labelSet.empty())
+            {
+                series += labelSet;
+                series += ',';
+            }
+            series += "le=\"";
+            for (size_t b = 0; b <= bounds.size(); b++)
+            {
+                for (auto &w : workerStates)
+                    cumulative += pick(w->metrics).counts[b].load(std::memory_order_relaxed);
+                out += series;
+                if (b < bounds.size())
+                    appendNumber(out, static_cast<double>(bounds[b]) / unit);
+                else
+                    out += "+Inf";
+                out += "\"} ";
+                appendNumber(out, static_cast<double>(cumulative));
+                out += '\n';
+            }
+            for (auto &w : workerStates)
+                sum += pick(w->metrics).sum.load(std::memory_order_relaxed);
+            series = name;
+            series += "_sum";
+            sample(series, labelSet, static_cast<double>(sum) / unit);
+            series = name;
+            series += "_count";
+            sample(series, labelSet, static_cast<double>(cumulative));
+        };
+
+        help("crs_requests_total", "counter", "Requests answered, by route.");
+        for (int r = 0; r < M::RouteCount; r++)
+        {
+            routeLabels(r);
+            sample("crs_requests_total", labels, static_cast<double>(total([r](M &m) -> auto & { return m.requests[r]; })));
+        }
+        help("crs_cached_requests_total", "counter", "Requests answered from the response cache, by route.");
+        for (int r = 0; r < M::RouteCount; r++)
+        {
+            routeLabels(r);
+            sample("crs_cached_requests_total", labels, static_cast<double>(total([r](M &m) -> auto & { return m.cached[r]; })));
+        }
+        help("crs_rejected_requests_total", "counter", "Malformed or oversized requests answered with 400, 413 or 431.");
+        sample("crs_rejected_requests_total", "", static_cast<double>(total([](M &m) -> auto & { return m.rejected; })));
+        help("crs_shed_connections_total", "counter", "Connections closed unanswered because the process ran out of file descriptors.");
+        sample("crs_shed_connections_total", "", static_cast<double>(total([](M &m) -> auto & { return m.shed; })));
+        help("crs_shard_failures_total", "counter", "Router requests answered with 502 because a shard failed or timed out.");
+        sample("crs_shard_failures_total", "", static_cast<double>(total([](M &m) -> auto & { return m.shardFailures; })));
+        uint64_t opened = total([](M &m) -> auto & { return m.streamsOpened; });
+        help("crs_stream_subscribers", "gauge", "Open /api/stream connections.");
+        sample("crs_stream_subscribers", "", static_cast<double>(opened - total([](M &m) -> auto & { return m.streamsClosed; })));
+        help("crs_stream_events_total", "counter", "Events queued to /api/stream subscribers.");
+        sample("crs_stream_events_total", "", static_cast<double>(total([](M &m) -> auto & { return m.streamEvents; })));
+        help("crs_stream_dropped_total", "counter", "Subscribers dropped for falling too far behind.");
+        sample("crs_stream_dropped_total", "", static_cast<double>(total([](M &m) -> auto & { return m.streamsDropped; })));
+        if (allocationsCounted()) // only in `make bench` builds
+        {
+            help("crs_heap_allocations_total", "counter", "Heap allocations made by workers while parsing and answering requests.");
+            sample("crs_heap_allocations_total", "", static_cast<double>(total([](M &m) -> auto & { return m.allocations; })));
+        }
+
+        help("crs_request_stage_seconds", "histogram",
+             "Time per request stage: parse, route (query string and cache lookup), compute (the body), "
+             "serialize (headers and cache store), send, and total.");
+        for (int r = 0; r < M::RouteCount; r++)
+            for (int st = 0; st < M::StageCount; st++)
+            {
+                uint64_t samples = 0;
+                for (auto &w : workerStates)
+                    for (auto &n : w->metrics.stages[r][st].counts)
+                        samples += n.load(std::memory_order_relaxed);
+                if (samples == 0)
+                    continue;
+                routeLabels(r);
+                labels += ",stage=\"";
+                labels += M::kStageNames[st];
+                labels += '"';
+                histogram("crs_request_stage_seconds", labels, M::kTimeBounds, 1e9,
+                          [&](M &m) -> auto & { return m.stages[r][st]; });
+            }
+
+        help("crs_trie_search_depth", "histogram", "Trie depth reached per search (the prefix length unless fuzzy).");
+        histogram("crs_trie_search_depth", "", M::kCountBounds, 1, [](M &m) -> auto & { return m.trieDepth; });
+        help("crs_trie_search_candidates", "histogram", "Ranked-list entries examined per search.");
+        histogram("crs_trie_search_candidates", "", M::kCountBounds, 1, [](M &m) -> auto & { return m.trieCandidates; });
+
+        uint64_t dropped = 0;
+        for (auto &w : workerStates)
+            dropped += w->log.droppedCount();
+        help("crs_access_log_dropped_total", "counter", "Access-log lines dropped because a worker's ring was full.");
+        sample("crs_access_log_dropped_total", "", static_cast<double>(dropped));
+
+        ResponseCache &cache = system.responses();
+        help("crs_response_cache_hits_total", "counter", "Response cache hits.");
+        sample("crs_response_cache_hits_total", "", static_cast<double>(cache.hitCount()));
+        help("crs_response_cache_misses_total", "counter", "Response cache misses.");
+        sample("crs_response_cache_misses_total", "", static_cast<double>(cache.missCount()));
+        help("crs_ticks_applied_total", "counter", "Price ticks applied to the universe.");
+        sample("crs_ticks_applied_total", "", static_cast<double>(system.tickCount()));
+        help("crs_data_generation", "gauge", "Snapshots published since start.");
+        sample("crs_data_generation", "", static_cast<double>(system.dataGeneration()));
+        help("crs_assets", "gauge", "Assets in the current snapshot.");
+        sample("crs_assets", "", static_cast<double>(system.assetCount()));
+        help("crs_profiles", "gauge", "Stored user profiles.");
+        sample("crs_profiles", "", static_cast<double>(system.profileCount()));
+    }
+
+    // drains the workers' access-log rings to stdout in batches, so requests never wait on
+    // the console
+    void logLoop()
+    {
+        std::string lines;
+        char stamp[32];
+        while (true)
+        {
+            bool last = !logging.load(std::memory_order_acquire);
+            lines.clear();
+            for (auto &w : workerStates)
+                w->log.drain([&](const LogRing::Entry &e)
+                             {
+                                 std::time_t secs = static_cast<std::time_t>(e.unixMillis / 1000);
+                                 std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", std::gmtime(&secs));
+                                 lines += stamp;
+                                 lines += '.';
+                                 char millis[8];
+                                 std::snprintf(millis, sizeof(millis), "%03d", static_cast<int>(e.unixMillis % 1000));
+                                 lines += millis;
+                                 lines += "Z ";
+                                 lines.append(e.text, e.length);
+                                 lines += ' ';
+                                 appendNumber(lines, static_cast<long long>(e.status));
+                                 lines += ' ';
+                                 appendNumber(lines, static_cast<long long>(e.bytes));
+                                 lines += "B ";
+                                 appendNumber(lines, static_cast<long long>(e.micros));
+                                 lines += "us\n";
+                             });
+            if (!lines.empty())
+            {
+                std::cout.write(lines.data(), static_cast<std::streamsize>(lines.size()));
+                std::cout.flush();
+            }
+            if (last)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    // one tick per line: SYMBOL,price[,change[,marketCap]]; false on a malformed line,
+    // including a price that is not finite and positive, an infinite or NaN change and a
+    // negative cap
+    static bool parseTicks(std::string_view body, std::vector<Tick> &out)
+    {
+        auto number = [](std::string_view f, auto &v)
+        {
+            auto r = std::from_chars(f.data(), f.data() + f.size(), v);
+            return r.ec == std::errc() && r.ptr == f.data() + f.size();
+        };
+        while (!body.empty())
+        {
+            size_t nl = body.find('\n');
+            std::string_view line = body.substr(0, nl);
+            body = nl == std::string_view::npos ? std::string_view() : body.substr(nl + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty())
+                continue;
+
+            std::string_view fields[4];
+            size_t count = 0;
+            while (count < 4)
+            {
+                size_t comma = line.find(',');
+                fields[count++] = line.substr(0, comma);
+                if (comma == std::string_view::npos)
+                    break;
+                line.remove_prefix(comma + 1);
+            }
+            if (count < 2 || (count == 4 && line.find(',') != std::string_view::npos))
+                return false;
+
+            Tick t;
+            t.symbol.assign(fields[0].data(), fields[0].size());
+            if (!number(fields[1], t.price) || !std::isfinite(t.price) || !(t.price > 0) ||
+                (count > 2 && (!number(fields[2], t.change) || !std::isfinite(t.change))) ||
+                (count > 3 && (!number(fields[3], t.marketCap) || t.marketCap < 0)))
+                return false;
+            out.push_back(std::move(t));
+        }
+        return true;
+    }
+
+    // false, with an error body, on a malformed batch
+    bool ingestTicks(const HttpRequest &req, Connection &c)
+    {
+        std::vector<Tick> ticks;
+        if (!parseTicks(req.body, ticks))
+        {
+            c.body = "{\"error\":\"Bad tick\"}";
+            return false;
+        }
+        size_t received = ticks.size();
+        // through the router every shard sees every tick; it takes its own and ignores the rest
+        if (c.partial)
+        {
+            system.dropForeignTicks(ticks);
+            received = ticks.size();
+        }
+        size_t accepted = system.submitTicks(std::move(ticks));
+        c.body += "{\"accepted\":";
+        appendNumber(c.body, static_cast<long long>(accepted));
+        c.body += ",\"dropped\":";
+        appendNumber(c.body, static_cast<long long>(received - accepted));
+        c.body += '}';
+        return true;
+    }
+
+    // one weight per line: category,weight with |weight| <= 100; false on a malformed line
+    // or more categories than a profile holds. Categories are views into body.
+    static bool parseProfile(std::string_view body, std::pmr::vector<std::pair<std::string_view, float>> &out)
+    {
+        while (!body.empty())
+        {
+            size_t nl = body.find('\n');
+            std::string_view line = body.substr(0, nl);
+            body = nl == std::string_view::npos ? std::string_view() : body.substr(nl + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty())
+                continue;
+
+            size_t comma = line.find(',');
+            if (comma == std::string_view::npos)
+                return false;
+            std::string_view category = line.substr(0, comma), value = line.substr(comma + 1);
+            float weight;
+            auto r = std::from_chars(value.data(), value.data() + value.size(), weight);
+            if (category.empty() || r.ec != std::errc() || r.ptr != value.data() + value.size() || !(std::fabs(weight) <= 100))
+                return false;
+            auto same = std::find_if(out.begin(), out.end(), [&](const auto &w) { return w.first == category; });
+            if (same != out.end())
+                same->second = weight;
+            else if (out.size() == ProfileStore::kMaxWeights)
+                return false;
+            else
+                out.emplace_back(category, weight);
+        }
+        return true;
+    }
+
+    // filters joined by &: <field><op><number> with field price, cap, change or score and
+    // op one of < <= > >= =, plus cat=, type=, sort=<field>, order=asc|desc and
+    // limit=<1..100>; false on anything else. Terms are decoded into the scratch arena.
+    static bool parseAssetQuery(std::string_view query, AssetQuery &q, std::pmr::memory_resource *scratch)
+    {
+        q.clear();
+        std::pmr::string term(scratch);
+        while (!query.empty())
+        {
+            size_t amp = query.find('&');
+            term.clear();
+            urlDecode(query.substr(0, amp), term);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+            if (term.empty())
+                continue;
+
+            std::string_view t = term;
+            size_t at = t.find_first_of("<>=");
+            if (at == std::string_view::npos || at == 0)
+                return false;
+            std::string_view key = t.substr(0, at), value = t.substr(at + 1);
+            char op = t[at];
+            bool inclusive = op == '=';
+            if (op != '=' && !value.empty() && value[0] == '=')
+            {
+                inclusive = true;
+                value.remove_prefix(1);
+            }
+
+            int f = AssetQuery::field(key);
+            if (f >= 0)
+            {
+                double v;
+                auto r = std::from_chars(value.data(), value.data() + value.size(), v);
+                if (r.ec != std::errc() || r.ptr != value.data() + value.size() || v != v)
+                    return false;
+                const double inf = std::numeric_limits<double>::infinity();
+                if (op != '<')
+                    q.low[f] = std::max(q.low[f], inclusive ? v : std::nextafter(v, inf));
+                if (op != '>')
+                    q.high[f] = std::min(q.high[f], inclusive ? v : std::nextafter(v, -inf));
+                continue;
+            }
+            if (op != '=')
+                return false;
+            if (key == "cat")
+                q.category.assign(value.data(), value.size());
+            else if (key == "type")
+                q.type.assign(value.data(), value.size());
+            else if (key == "sort")
+            {
+                int sort = AssetQuery::field(value);
+                if (sort < 0)
+                    return false;
+                q.sort = static_cast<AssetQuery::Field>(sort);
+            }
+            else if (key == "order" && (value == "asc" || value == "desc"))
+                q.ascending = value == "asc";
+            else if (key == "limit")
+            {
+                auto r = std::from_chars(value.data(), value.data() + value.size(), q.limit);
+                if (r.ec != std::errc() || r.ptr != value.data() + value.size() || q.limit < 1 || q.limit > AssetQuery::kMaxLimit)
+                    return false;
+            }
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // false, with an error body, on a malformed or refused profile
+    bool storeProfile(const HttpRequest &req, Connection &c)
+    {
+        std::pmr::vector<std::pair<std::string_view, float>> weights(&c.worker->scratch);
+        weights.reserve(ProfileStore::kMaxWeights);
+        if (!parseProfile(req.body, weights) || !system.setProfile(c.user, weights, c.partial))
+        {
+            c.body = "{\"error\":\"Bad profile\"}";
+            return false;
+        }
+        return system.profileJSON(c.user, c.body);
+    }
+
+    // fills c.body with the response to req and returns its status: 400 for a malformed
+    // request or a window, symbol or user that does not exist, 404 for an unknown route.
+    // known is cleared when req names a type the data does not have, as seen by the
+    // snapshot the body was read from; that is an empty 200 answer, but not one to cache.
+    uint16_t computeBody(const HttpRequest &req, Connection &c, bool &known)
+    {
+        c.body.clear();
+        if (req.method == "POST" && req.path == "/api/ticks")
+        {
+            return ingestTicks(req, c) ? 200 : 400;
+        }
+        else if (req.method == "POST" && req.path == "/api/profile")
+        {
+            return storeProfile(req, c) ? 200 : 400;
+        }
+        else if (req.method != "GET")
+        {
+            c.body = "{\"error\":\"Not found\"}";
+            return 404;
+        }
+        else if (req.path == "/api/search")
+        {
+            system.searchJSON(c.query, c.type, c.fuzzy, c.body, c.partial);
+        }
+        else if (req.path == "/api/stats")
+        {
+            system.getStatsJSON(c.body, c.partial);
+        }
+        else if (req.path == "/api/recommend")
+        {
+            known = system.getRecommendationsJSON(c.type, c.user, c.body, c.partial);
+        }
+        else if (req.path == "/api/profile")
+        {
+            return system.profileJSON(c.user, c.body) ? 200 : 400;
+        }
+        else if (req.path == "/api/movers")
+        {
+            if (!c.window.empty() && PriceStats::window(c.window) < 0)
+            {
+                c.body = "{\"error\":\"Unknown window\"}";
+                return 400;
+            }
+            known = system.moversJSON(c.window, c.type, c.body);
+        }
+        else if (req.path == "/api/similar")
+        {
+            if (c.k == 0)
+            {
+                c.body = "{\"error\":\"Bad k\"}";
+                return 400;
+            }
+            return system.similarJSON(c.symbol, c.k, c.body) ? 200 : 400;
+        }
+        else if (req.path == "/api/query")
+        {
+            if (!parseAssetQuery(req.query, c.filter, &c.worker->scratch))
+            {
+                c.body = "{\"error\":\"Bad query\"}";
+                return 400;
+            }
+            system.queryJSON(c.filter, c.body);
+        }
+        else if (req.path == "/api/cache")
+        {
+            cacheStatsJSON(c.body);
+        }
+        else if (req.path == "/api/metrics")
+        {
+            metricsText(c.body, &c.worker->scratch);
+        }
+        else
+        {
+            c.body = "{\"error\":\"Not found\"}";
+            return 404;
+        }
+        return 200;
+    }
+
+    // sends a then b with one writev when nothing is queued ahead of them;
+    // whatever the socket does not take is queued in c.out
+    static void write(Connection &c, std::string_view a, std::string_view b = {})
+    {
+        size_t done = 0;
+#ifndef _WIN32
+        if (c.sent == c.out.size())
+        {
+            c.out.clear();
+            c.sent = 0;
+            iovec iov[2] = {{const_cast<char *>(a.data()), a.size()}, {const_cast<char *>(b.data()), b.size()}};
+            ssize_t n;
+            do
+                n = writev(c.fd, iov, b.empty() ? 1 : 2);
+            while (n < 0 && errno == EINTR);
+            // on a hard error the queued bytes fail again in onWritable, which drops the connection
+            done = n > 0 ? static_cast<size_t>(n) : 0;
+        }
+#endif
+        if (done < a.size())
+            c.out.append(a.substr(done));
+        done = done > a.size() ? done - a.size() : 0;
+        c.out.append(b.substr(done));
+    }
+
+    void respond(Connection &c, const char *status, bool keepAlive)
+    {
+        buildHead(c.head, status, c.body.size(), keepAlive);
+        write(c, c.head, c.body);
+    }
+
+    static bool setNonBlocking(socket_t fd)
+    {
+#ifdef _WIN32
+        u_long mode = 1;
+        return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+    }
+
+    static bool wouldBlock()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    // true when a non-blocking connect() failed only because it has not finished yet
+    static bool connectPending()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EINPROGRESS;
+#endif
+    }
+
+    socket_t openListener(bool reusePort)
+    {
+        socket_t serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (serverSocket == static_cast<socket_t>(-1))
+        {
+            std::cerr << "Error creating socket\n";
+            return serverSocket;
+        }
+
+        int opt = 1;
+#ifdef _WIN32
+        setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+#else
+        setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#endif
+#ifdef SO_REUSEPORT
+        // every worker binds its own listener and the kernel spreads accepts across them
+        if (reusePort)
+            setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#else
+        (void)reusePort;
+#endif
+
+        sockaddr_in serverAddr;
+        std::memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+        serverAddr.sin_port = htons(config.port);
+
+        if (bind(serverSocket, (sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
+        {
+            std::cerr << "Error binding socket\n";
+            closesocket(serverSocket);
+            return static_cast<socket_t>(-1);
+        }
+        listen(serverSocket, config.backlog);
+        setNonBlocking(serverSocket);
+        return serverSocket;
+    }
+
+    // answers every complete request buffered on the connection, in order
+    void processInput(Connection &c)
+    {
+        uint64_t allocations = allocationCount();
+        size_t offset = 0;
+        while (!c.closing && !c.streaming && c.out.size() - c.sent < kMaxPendingOutput && c.fanout.awaiting == 0)
+        {
+            HttpRequest req;
+            size_t consumed = 0;
+            Clock::time_point at[RequestMetrics::StageCount];
+            at[0] = Clock::now();
+            auto status = c.parser.parse(std::string_view(c.in).substr(offset), req, consumed, kMaxRequestBytes);
+            if (status == HttpParser::Incomplete)
+                break;
+            if (status == HttpParser::HeadersTooLarge || status == HttpParser::BodyTooLarge)
+            {
+                bool headers = status == HttpParser::HeadersTooLarge;
+                c.body = headers ? "{\"error\":\"Headers too large\"}" : "{\"error\":\"Body too large\"}";
+                respond(c, headers ? "431 Request Header Fields Too Large" : "413 Content Too Large", false);
+                RequestMetrics::bump(c.worker->metrics.rejected);
+                logRequest(c, req, headers ? 431 : 413, at[0], c.head.size() + c.body.size());
+                c.closing = true;
+                break;
+            }
+            if (status == HttpParser::Invalid)
+            {
+                c.body = "{\"error\":\"Bad request\"}";
+                respond(c, "400 Bad Request", false);
+                RequestMetrics::bump(c.worker->metrics.rejected);
+                logRequest(c, req, 400, at[0], c.head.size() + c.body.size());
+                c.closing = true;
+                break;
+            }
+            at[RequestMetrics::Parse + 1] = Clock::now();
+            handleRequest(req, c, at);
+            c.worker->scratch.release();
+            offset += consumed;
+            // an event stream ends when the connection does anyway
+            if (!req.keepAlive && !c.streaming)
+                c.closing = true;
+        }
+        c.in.erase(0, offset);
+        RequestMetrics::bump(c.worker->metrics.allocations, allocationCount() - allocations);
+    }
+
+    // returns false once the connection should be closed
+    bool onReadable(Connection &c)
+    {
+        char buffer[8192];
+        while (!c.closing)
+        {
+            int received = static_cast<int>(recv(c.fd, buffer, sizeof(buffer), 0));
+            if (received > 0)
+            {
+                // a subscriber sends no more requests; whatever it sends is dropped
+                if (!c.streaming)
+                    c.in.append(buffer, static_cast<size_t>(received));
+                continue;
+            }
+            if (received == 0)
+            {
+                // peer finished sending: answer what it sent, then close
+                processInput(c);
+                c.closing = true;
+                return c.sent < c.out.size() || c.fanout.awaiting > 0;
+            }
+            if (wouldBlock())
+                break;
+            return false;
+        }
+        processInput(c);
+        return true;
+    }
+
+    bool onWritable(Connection &c)
+    {
+        while (c.sent < c.out.size())
+        {
+#ifdef MSG_NOSIGNAL
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            int n = static_cast<int>(send(c.fd, c.out.data() + c.sent,
+                                          static_cast<int>(c.out.size() - c.sent), flags));
+            if (n > 0)
+            {
+                c.sent += static_cast<size_t>(n);
+                if (c.sent == c.out.size() && !c.closing && !c.in.empty())
+                    processInput(c); // resume pipelined requests held back by kMaxPendingOutput
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+                return true;
+            return false;
+        }
+        c.out.clear();
+        c.sent = 0;
+        // stream events go out straight from their shared buffers
+        while (!c.pushes.empty())
+        {
+            long n;
+#ifndef _WIN32
+            iovec iov[16];
+            int count = 0;
+            for (auto it = c.pushes.begin(); it != c.pushes.end() && count < 16; ++it, ++count)
+            {
+                const std::string &frame = (*it)->frame;
+                size_t skip = count == 0 ? c.pushSent : 0;
+                iov[count] = {const_cast<char *>(frame.data() + skip), frame.size() - skip};
+            }
+            do
+                n = writev(c.fd, iov, count);
+            while (n < 0 && errno == EINTR);
+#else
+            const std::string &frame = c.pushes.front()->frame;
+            n = send(c.fd, frame.data() + c.pushSent, static_cast<int>(frame.size() - c.pushSent), 0);
+#endif
+            if (n <= 0)
+                return n < 0 && wouldBlock();
+            c.pushBytes -= static_cast<size_t>(n);
+            for (size_t done = static_cast<size_t>(n); done > 0;)
+            {
+                size_t left = c.pushes.front()->frame.size() - c.pushSent;
+                if (done < left)
+                {
+                    c.pushSent += done;
+                    break;
+                }
+                done -= left;
+                c.pushSent = 0;
+                c.pushes.pop_front();
+            }
+        }
+        return !c.closing || c.fanout.awaiting > 0;
+    }
+
+    // after c was read or answered: flushes it, asks for EPOLLOUT only while the socket
+    // buffer is full, and closes it once it is done
+    void settle(WorkerState &w, Connection &c, bool alive)
+    {
+        if (alive && (!c.out.empty() || !c.pushes.empty()))
+            alive = onWritable(c);
+        if (alive && c.closing && c.sent == c.out.size() && c.fanout.awaiting == 0)
+            alive = false;
+        bool pending = c.sent < c.out.size() || !c.pushes.empty();
+        if (alive && pending != c.wantWrite)
+        {
+            c.wantWrite = pending;
+            w.poller.modify(c.fd, &c, pending);
+        }
+        if (!alive)
+        {
+            if (c.streaming)
+                unsubscribe(w, c);
+            w.poller.remove(c.fd);
+            closesocket(c.fd);
+            // freed after this round of events, some of which may still name it
+            auto it = w.conns.find(c.fd);
+            w.closed.push_back(std::move(it->second));
+            w.conns.erase(it);
+        }
+    }
+
+    // accepts connections until the listener's queue is empty, which is the only time the
+    // edge-triggered listener fires again; false if accept() failed otherwise, and the
+    // caller tries again shortly
+    bool acceptAll(WorkerState &w, socket_t listener)
+    {
+        while (true)
+        {
+            sockaddr_in clientAddr;
+            socklen_t clientLen = sizeof(clientAddr);
+            socket_t fd = accept(listener, (sockaddr *)&clientAddr, &clientLen);
+            if (fd == static_cast<socket_t>(-1))
+            {
+                if (wouldBlock())
+                    return true;
+#ifndef _WIN32
+                if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                    continue;
+                // out of descriptors: the spare one makes room to accept the client and close
+                // it at once, so the queue drains instead of stalling the listener
+                if ((errno == EMFILE || errno == ENFILE) && w.spareFd >= 0)
+                {
+                    close(w.spareFd);
+                    socket_t shed = accept(listener, nullptr, nullptr);
+                    if (shed != static_cast<socket_t>(-1))
+                        closesocket(shed);
+                    w.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    if (shed != static_cast<socket_t>(-1))
+                    {
+                        RequestMetrics::bump(w.metrics.shed);
+                        continue;
+                    }
+                }
+#endif
+                return false;
+            }
+            setNonBlocking(fd);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            conn->id = ++w.accepted;
+            conn->worker = &w;
+            if (w.poller.add(fd, conn.get(), false))
+                w.conns[fd] = std::move(conn);
+            else
+                closesocket(fd);
+        }
+    }
+
+    void runWorker(socket_t listener, WorkerState *state)
+    {
+        Poller &poller = state->poller;
+        auto &conns = state->conns;
+        std::vector<Poller::Event> events;
+        poller.add(listener, nullptr, false);
+#ifndef _WIN32
+        state->spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+        bool drained = true; // false while accept() is failing and needs another try
+        for (size_t i = 0; i < config.shards.size(); i++)
+        {
+            state->upstreams.push_back(std::make_unique<Upstream>());
+            state->upstreams.back()->shard = i;
+        }
+        auto upstreamOf = [&](void *tag) -> Upstream *
+        {
+            for (auto &u : state->upstreams)
+                if (u.get() == tag)
+                    return u.get();
+            return nullptr;
+        };
+
+        while (true)
+        {
+            // a router wakes up to time out shards that stopped answering; without wake()
+            // subscribers are served at the stream thread's pace
+            int timeout = !config.shards.empty()                         ? 250
+                          : Poller::kWakes || state->subscribers.empty() ? -1
+                                                                         : static_cast<int>(kStreamInterval.count());
+            if (!drained)
+                timeout = timeout < 0 ? kAcceptRetryMs : std::min(timeout, kAcceptRetryMs);
+            poller.wait(events, timeout);
+            if (!drained)
+                drained = acceptAll(*state, listener);
+            for (auto &ev : events)
+            {
+                if (Upstream *u = upstreamOf(ev.tag))
+                {
+                    onUpstreamEvent(*state, *u, ev);
+                    continue;
+                }
+                if (!ev.tag)
+                {
+                    drained = acceptAll(*state, listener);
+                    continue;
+                }
+
+                Connection *c = static_cast<Connection *>(ev.tag);
+                auto it = conns.find(c->fd);
+                if (it == conns.end() || it->second.get() != c)
+                    continue;
+                bool alive = true;
+                if (ev.readable || ev.hangup)
+                    alive = onReadable(*c);
+                settle(*state, *c, alive);
+            }
+            if (!config.shards.empty())
+                sweepUpstreams(*state);
+            if (state->mail.exchange(false, std::memory_order_acquire))
+                deliverStream(*state);
+            state->closed.clear();
+        }
+    }
+
+public:
+    SimpleHTTPServer(InvestmentSystem &sys, const ServerConfig &cfg) : system(sys), config(cfg) {}
+
+    // serves until the process ends; false if the server could not start
+    bool start()
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+        signal(SIGPIPE, SIG_IGN);
+#endif
+        int workers = config.workers > 0 ? config.workers
+                                         : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+#ifndef SO_REUSEPORT
+        workers = 1;
+#endif
+
+        std::vector<socket_t> listeners;
+        for (int i = 0; i < workers; i++)
+        {
+            socket_t l = openListener(workers > 1);
+            if (l == static_cast<socket_t>(-1))
+            {
+                for (socket_t open : listeners)
+                    closesocket(open);
+                return false;
+            }
+            listeners.push_back(l);
+        }
+        for (int i = 0; i < workers; i++)
+        {
+            workerStates.push_back(std::make_unique<WorkerState>());
+            if (int error = workerStates.back()->poller.setupError())
+            {
+                std::cerr << "Cannot create a poller: " << std::strerror(error) << "\n";
+                for (socket_t open : listeners)
+                    closesocket(open);
+                return false;
+            }
+        }
+
+        std::cout << "🚀 Server running on http://localhost:" << config.port
+                  << " (" << workers << " worker" << (workers > 1 ? "s" : "") << ")\n";
+        std::cout << "API Endpoints:\n";
+        std::cout << "  - GET /api/search?q=<query>&type=<crypto|stock>\n";
+        std::cout << "  - GET /api/stats\n";
+        std::cout << "  - GET /api/recommend?type=<crypto|stock>[&user=<id>]\n";
+        std::cout << "  - GET /api/profile?user=<id>\n";
+        std::cout << "  - GET /api/movers?window=<5m|15m|1h>&type=<crypto|stock>\n";
+        std::cout << "  - GET /api/query?cap>1e10&change<0&cat=defi&sort=change&order=asc&limit=20\n";
+        std::cout << "  - GET /api/similar?symbol=SOL&k=10\n";
+        std::cout << "  - GET /api/stream?type=crypto,stock&symbols=BTC,ETH (Server-Sent Events)\n";
+        std::cout << "  - GET /api/cache (response cache hit/miss counters)\n";
+        std::cout << "  - GET /api/metrics (Prometheus text format)\n";
+        std::cout << "  - POST /api/ticks (body: SYMBOL,price[,change[,cap]] per line)\n";
+        std::cout << "  - POST /api/profile?user=<id> (body: category,weight per line)\n";
+        std::cout << "Press Ctrl+C to stop...\n\n";
+
+        logging = true;
+        std::thread logger(&SimpleHTTPServer::logLoop, this);
+        // a router has no data of its own to stream
+        streaming = config.shards.empty();
+        std::thread streamer;
+        if (streaming)
+            streamer = std::thread(&SimpleHTTPServer::streamLoop, this);
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; i++)
+            threads.emplace_back(&SimpleHTTPServer::runWorker, this, listeners[i], workerStates[i].get());
+        runWorker(listeners[0], workerStates[0].get());
+
+        for (auto &t : threads)
+            t.join();
+        logging = false;
+        logger.join();
+        streaming = false;
+        system.wakeDataWaiters();
+        if (streamer.joinable())
+            streamer.join();
+        for (socket_t l : listeners)
+            closesocket(l);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return true;
+    }
+};
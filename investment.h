@@ -0,0 +1,2364 @@
+#pragma once
+
+#include "kernels.h"
+#include "trie.h"
+
+// final HTTP responses keyed by endpoint and parameters. Every entry records the
+// data generation it was computed from and is only served for that generation.
+class ResponseCache
+{
+public:
+    // head and body as they were written, so a hit goes out as one writev of both
+    struct Response
+    {
+        std::string head, body;
+    };
+    using Entry = std::shared_ptr<const Response>;
+
+    static constexpr size_t kMaxEntries = 1024;
+
+private:
+    struct Slot
+    {
+        uint64_t generation;
+        Entry bytes;
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, Slot> slots;
+    // keys in the order they were added; once full, a new key replaces the oldest
+    std::vector<std::string> order;
+    size_t oldest = 0;
+    std::atomic<uint64_t> hits{0}, misses{0};
+
+public:
+    // null when key is absent or was computed from another generation
+    Entry find(const std::string &key, uint64_t generation)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = slots.find(key);
+            if (it != slots.end() && it->second.generation == generation)
+            {
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.bytes;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    void store(const std::string &key, uint64_t generation, const std::string &head, const std::string &body)
+    {
+        auto entry = std::make_shared<const Response>(Response{head, body});
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = slots.find(key);
+        if (it != slots.end())
+        {
+            it->second = {generation, std::move(entry)};
+            return;
+        }
+        if (order.size() < kMaxEntries)
+        {
+            order.push_back(key);
+        }
+        else
+        {
+            slots.erase(order[oldest]);
+            order[oldest] = key;
+            oldest = (oldest + 1) % kMaxEntries;
+        }
+        slots.emplace(key, Slot{generation, std::move(entry)});
+    }
+
+    uint64_t hitCount() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(std::memory_order_relaxed); }
+
+    size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return slots.size();
+    }
+};
+
+// A /api/query request: a closed range per numeric field (unbounded unless a filter set
+// it), an optional category and type, and the order and number of results.
+struct AssetQuery
+{
+    enum Field { Price, Cap, Change, Score, FieldCount };
+    static constexpr const char *kFieldNames[FieldCount] = {"price", "cap", "change", "score"};
+    static constexpr size_t kMaxLimit = 100;
+
+    double low[FieldCount], high[FieldCount];
+    std::string category, type; // empty for any
+    Field sort = Score;
+    bool ascending = false;
+    size_t limit = 20;
+
+    AssetQuery() { clear(); }
+
+    void clear()
+    {
+        std::fill(std::begin(low), std::end(low), -std::numeric_limits<double>::infinity());
+        std::fill(std::begin(high), std::end(high), std::numeric_limits<double>::infinity());
+        category.clear();
+        type.clear();
+        sort = Score;
+        ascending = false;
+        limit = 20;
+    }
+
+    bool bounded(int f) const { return low[f] != -std::numeric_limits<double>::infinity() || high[f] != std::numeric_limits<double>::infinity(); }
+
+    // -1 for a name not in kFieldNames
+    static int field(std::string_view name)
+    {
+        for (int f = 0; f < FieldCount; f++)
+            if (name == kFieldNames[f])
+                return f;
+        return -1;
+    }
+
+    // the column a field filters on; cap is in dollars, score is the rank responses show
+    static const double *column(const AssetColumns &c, int f)
+    {
+        const std::vector<double> *columns[FieldCount] = {&c.price, &c.marketCap, &c.change, &c.rank};
+        return columns[f]->data();
+    }
+};
+
+// Streams an instrument file in fixed-size blocks and appends one Asset per row, its
+// strings copied into `strings`, so a row costs no allocation of its own. CSV needs a
+// header naming the columns (name, symbol, category, type, price, marketCap; change and
+// score are optional); JSONL takes one flat object per line with the same keys.
+// Malformed rows are counted in `skipped` and left out.
+class AssetFileReader
+{
+    enum Field { kName, kSymbol, kCategory, kType, kPrice, kChange, kMarketCap, kScore, kFieldCount };
+    static constexpr size_t kBlockSize = 1 << 20;
+
+    StringArena &strings;
+    std::vector<Asset> &out;
+    std::vector<int> columns; // csv: Field of each column, -1 for columns we ignore
+    bool haveHeader = false;
+    std::string_view cells[kFieldCount];
+    std::string unescaped[kFieldCount]; // backing for cells that needed unescaping
+    bool present[kFieldCount];
+
+    static int fieldOf(std::string_view key)
+    {
+        static const std::pair<const char *, int> names[] = {
+            {"name", kName}, {"symbol", kSymbol}, {"category", kCategory}, {"cat", kCategory},
+            {"type", kType}, {"price", kPrice}, {"change", kChange}, {"marketCap", kMarketCap},
+            {"cap", kMarketCap}, {"score", kScore}};
+        for (auto &n : names)
+            if (key == n.first)
+                return n.second;
+        return -1;
+    }
+
+    template <class T>
+    static bool number(std::string_view s, T &v)
+    {
+        auto r = std::from_chars(s.data(), s.data() + s.size(), v);
+        return r.ec == std::errc() && r.ptr == s.data() + s.size();
+    }
+
+    // integers may arrive in exponent form (2.15e12); false when the value does not fit T
+    template <class T>
+    static bool integer(std::string_view s, T &v)
+    {
+        static_assert(std::is_signed<T>::value, "the range check assumes a signed type");
+        if (number(s, v))
+            return true;
+        double d;
+        // [min, -min) is the range of T, with both bounds exact as doubles
+        if (!number(s, d) || !(d >= static_cast<double>(std::numeric_limits<T>::min()) &&
+                               d < -static_cast<double>(std::numeric_limits<T>::min())))
+            return false;
+        v = static_cast<T>(d);
+        return true;
+    }
+
+    bool finishRow()
+    {
+        for (int f : {kName, kSymbol, kCategory, kType, kPrice, kMarketCap})
+            if (!present[f])
+                return false;
+        Asset a;
+        a.change = 0;
+        a.score = 50;
+        // a price of 0 would divide by zero when a tick scales the cap
+        if (!number(cells[kPrice], a.price) || !std::isfinite(a.price) || !(a.price > 0) ||
+            !integer(cells[kMarketCap], a.marketCap) ||
+            (present[kChange] && (!number(cells[kChange], a.change) || !std::isfinite(a.change))) ||
+            (present[kScore] && !integer(cells[kScore], a.score)))
+            return false;
+        a.name = strings.add(cells[kName]);
+        a.symbol = strings.add(cells[kSymbol]);
+        a.category = strings.add(cells[kCategory]);
+        a.type = strings.add(cells[kType]);
+        out.push_back(a);
+        return true;
+    }
+
+    // one CSV cell from the front of line; quoted cells may contain commas and ""
+    static std::string_view csvCell(std::string_view &line, std::string &buf, bool &ok)
+    {
+        if (line.empty() || line.front() != '"')
+        {
+            size_t comma = line.find(',');
+            std::string_view cell = line.substr(0, comma);
+            line = comma == std::string_view::npos ? std::string_view() : line.substr(comma + 1);
+            return cell;
+        }
+        buf.clear();
+        size_t i = 1;
+        for (;; i++)
+        {
+            if (i >= line.size())
+            {
+                ok = false;
+                return {};
+            }
+            if (line[i] == '"')
+            {
+                if (i + 1 < line.size() && line[i + 1] == '"')
+                    i++;
+                else
+                    break;
+            }
+            buf += line[i];
+        }
+        line.remove_prefix(i + 1);
+        if (!line.empty() && line.front() != ',')
+            ok = false;
+        else if (!line.empty())
+            line.remove_prefix(1);
+        return buf;
+    }
+
+    void csvHeader(std::string_view line)
+    {
+        std::string buf;
+        bool ok = true;
+        while (!line.empty() && ok)
+        {
+            std::string_view name = csvCell(line, buf, ok);
+            columns.push_back(fieldOf(name));
+        }
+        haveHeader = true;
+    }
+
+    bool csvRow(std::string_view line)
+    {
+        std::string ignored;
+        bool ok = true;
+        for (size_t c = 0; ok && c < columns.size(); c++)
+        {
+            int f = columns[c];
+            std::string_view cell = csvCell(line, f >= 0 ? unescaped[f] : ignored, ok);
+            if (f < 0)
+                continue;
+            cells[f] = cell;
+            present[f] = true;
+        }
+        return ok && finishRow();
+    }
+
+    static void skipSpace(std::string_view &s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+    }
+
+    static void appendUtf8(std::string &out, uint32_t cp)
+    {
+        if (cp < 0x80)
+            out += static_cast<char>(cp);
+        else if (cp < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // a JSON string at the front of s (opening quote included); the raw view when it has
+    // no escapes, otherwise the decoded text in buf
+    static bool jsonString(std::string_view &s, std::string &buf, std::string_view &value)
+    {
+        size_t end = 1;
+        while (end < s.size() && s[end] != '"' && s[end] != '\\')
+            end++;
+        if (end < s.size() && s[end] == '"')
+        {
+            value = s.substr(1, end - 1);
+            s.remove_prefix(end + 1);
+            return true;
+        }
+        buf.assign(s.data() + 1, end - 1);
+        for (size_t i = end; i < s.size(); i++)
+        {
+            char ch = s[i];
+            if (ch == '"')
+            {
+                value = buf;
+                s.remove_prefix(i + 1);
+                return true;
+            }
+            if (ch != '\\')
+            {
+                buf += ch;
+                continue;
+            }
+            if (++i >= s.size())
+                return false;
+            switch (s[i])
+            {
+            case 'n': buf += '\n'; break;
+            case 't': buf += '\t'; break;
+            case 'r': buf += '\r'; break;
+            case 'b': buf += '\b'; break;
+            case 'f': buf += '\f'; break;
+            case 'u':
+            {
+                auto hex4 = [&](size_t at, uint32_t &cp)
+                {
+                    auto r = std::from_chars(s.data() + at, s.data() + std::min(s.size(), at + 4), cp, 16);
+                    return r.ec == std::errc() && r.ptr == s.data() + at + 4;
+                };
+                uint32_t cp, low;
+                if (!hex4(i + 1, cp))
+                    return false;
+                i += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && i + 2 < s.size() && s[i + 1] == '\\' && s[i + 2] == 'u' &&
+                    hex4(i + 3, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                appendUtf8(buf, cp);
+                break;
+            }
+            default: buf += s[i]; break; // \" \\ \/
+            }
+        }
+        return false;
+    }
+
+    bool jsonRow(std::string_view line)
+    {
+        std::string key, ignored;
+        line.remove_prefix(1); // '{'
+        while (true)
+        {
+            skipSpace(line);
+            if (!line.empty() && line.front() == '}')
+                return finishRow();
+            std::string_view k;
+            if (line.empty() || line.front() != '"' || !jsonString(line, key, k))
+                return false;
+            int f = fieldOf(k);
+            skipSpace(line);
+            if (line.empty() || line.front() != ':')
+                return false;
+            line.remove_prefix(1);
+            skipSpace(line);
+            std::string_view value;
+            if (!line.empty() && line.front() == '"')
+            {
+                if (!jsonString(line, f >= 0 ? unescaped[f] : ignored, value))
+                    return false;
+            }
+            else
+            {
+                size_t end = line.find_first_of(",} \t");
+                value = line.substr(0, end);
+                line.remove_prefix(value.size());
+            }
+            if (f >= 0)
+            {
+                cells[f] = value;
+                present[f] = true;
+            }
+            skipSpace(line);
+            if (!line.empty() && line.front() == ',')
+                line.remove_prefix(1);
+            else if (line.empty() || line.front() != '}')
+                return false;
+        }
+    }
+
+    void row(std::string_view line)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        skipSpace(line);
+        if (line.empty())
+            return;
+        std::fill(std::begin(present), std::end(present), false);
+        if (line.front() == '{')
+        {
+            rows++;
+            if (!jsonRow(line))
+                skipped++;
+        }
+        else if (!haveHeader)
+            csvHeader(line);
+        else
+        {
+            rows++;
+            if (!csvRow(line))
+                skipped++;
+        }
+    }
+
+public:
+    size_t rows = 0, skipped = 0;
+
+    AssetFileReader(StringArena &arena, std::vector<Asset> &assets) : strings(arena), out(assets) {}
+
+    bool read(const std::string &path)
+    {
+        std::FILE *f = std::fopen(path.c_str(), "rb");
+        if (!f)
+            return false;
+        std::unique_ptr<char[]> block(new char[kBlockSize]);
+        size_t have = 0;
+        bool discarding = false; // inside a line longer than a whole block
+        while (true)
+        {
+            size_t n = std::fread(block.get() + have, 1, kBlockSize - have, f);
+            have += n;
+            size_t start = 0;
+            while (true)
+            {
+                const char *nl = static_cast<const char *>(std::memchr(block.get() + start, '\n', have - start));
+                if (!nl)
+                    break;
+                size_t end = static_cast<size_t>(nl - block.get());
+                if (!discarding)
+                    row(std::string_view(block.get() + start, end - start));
+                discarding = false;
+                start = end + 1;
+            }
+            if (n == 0)
+            {
+                if (start < have && !discarding)
+                    row(std::string_view(block.get() + start, have - start));
+                break;
+            }
+            if (start == 0 && have == kBlockSize)
+            {
+                if (!discarding)
+                {
+                    rows++;
+                    skipped++;
+                }
+                discarding = true;
+                have = 0;
+                continue;
+            }
+            std::memmove(block.get(), block.get() + start, have - start);
+            have -= start;
+        }
+        bool ok = !std::ferror(f);
+        std::fclose(f);
+        return ok;
+    }
+};
+
+// Per-user category weights. Users hash to one of kShards independently locked maps,
+// so lookups from many workers rarely meet on a lock and a write only blocks its own
+// shard. Category names are interned once for the whole store and a profile is a
+// fixed-size record, so a profile costs one map node and no allocation of its own.
+class ProfileStore
+{
+public:
+    static constexpr size_t kMaxWeights = 8;
+    static constexpr size_t kMaxCategories = 256;
+
+    struct Profile
+    {
+        uint8_t count = 0;
+        uint8_t categories[kMaxWeights]; // store category ids
+        float weights[kMaxWeights];
+    };
+
+private:
+    static constexpr size_t kShards = 64;
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Profile> users;
+    };
+
+    std::array<Shard, kShards> shards;
+    // names below namesUsed never change again, so readers take no lock for them
+    std::array<std::string, kMaxCategories> names;
+    std::atomic<size_t> namesUsed{0};
+    std::mutex namesMutex;
+
+    Shard &shardOf(const std::string &user) { return shards[std::hash<std::string>{}(user) % kShards]; }
+    const Shard &shardOf(const std::string &user) const { return shards[std::hash<std::string>{}(user) % kShards]; }
+
+public:
+    // -1 once kMaxCategories names are taken
+    int categoryId(std::string_view name)
+    {
+        std::lock_guard<std::mutex> lock(namesMutex);
+        size_t used = namesUsed.load(std::memory_order_relaxed);
+        for (size_t id = 0; id < used; id++)
+            if (names[id] == name)
+                return static_cast<int>(id);
+        if (used == kMaxCategories)
+            return -1;
+        names[used].assign(name.data(), name.size());
+        namesUsed.store(used + 1, std::memory_order_release);
+        return static_cast<int>(used);
+    }
+
+    const std::string &categoryName(uint8_t id) const { return names[id]; }
+
+    // replaces user's profile
+    void set(const std::string &user, const Profile &p)
+    {
+        Shard &shard = shardOf(user);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.users[user] = p;
+    }
+
+    // calls fn(profile) under the shard's read lock; false for an unknown user
+    template <class Fn>
+    bool read(const std::string &user, Fn &&fn) const
+    {
+        const Shard &shard = shardOf(user);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.users.find(user);
+        if (it == shard.users.end())
+            return false;
+        fn(it->second);
+        return true;
+    }
+
+    size_t size() const
+    {
+        size_t n = 0;
+        for (auto &shard : shards)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            n += shard.users.size();
+        }
+        return n;
+    }
+};
+
+// Which assets a shard process keeps: those whose symbol hashes to index mod count, and
+// only the listed types if any. The hash is FNV-1a, so every process and build agrees.
+struct ShardSpec
+{
+    uint32_t index = 0, count = 1;
+    std::vector<std::string> types;
+
+    bool sharded() const { return count > 1 || !types.empty(); }
+
+    static uint64_t hash(std::string_view symbol)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char ch : symbol)
+            h = (h ^ ch) * 1099511628211ull;
+        return h;
+    }
+
+    bool keeps(const Asset &a) const
+    {
+        return hash(a.symbol) % count == index && (types.empty() || std::find(types.begin(), types.end(), a.type) != types.end());
+    }
+
+    // "i/N" with i < N
+    bool parse(std::string_view spec)
+    {
+        size_t slash = spec.find('/');
+        if (slash == std::string_view::npos)
+            return false;
+        auto a = std::from_chars(spec.data(), spec.data() + slash, index);
+        auto b = std::from_chars(spec.data() + slash + 1, spec.data() + spec.size(), count);
+        return a.ec == std::errc() && a.ptr == spec.data() + slash && b.ec == std::errc() &&
+               b.ptr == spec.data() + spec.size() && count > 0 && index < count;
+    }
+};
+
+class InvestmentSystem
+{
+    friend struct MicroBench;
+    friend struct ServerTest;
+
+    static constexpr size_t kMaxCategories = 256;
+    static constexpr size_t kMaxPendingTicks = 1 << 20;
+    static constexpr size_t kMaxUserLength = 64;
+    static constexpr std::chrono::seconds kBarLength{60};
+    static constexpr int kTrendWindow = 2; // the PriceStats window whose momentum feeds the score
+    static constexpr size_t kMovers = 10;  // gainers and losers each
+    static constexpr size_t kMaxLinkedAssets = 32768; // larger universes answer /api/similar by a scan
+    static constexpr char kSnapshotMagic[8] = {'C', 'R', 'S', 'N', 'A', 'P', '\0', '\0'};
+    static constexpr uint32_t kSnapshotVersion = 1;
+
+    // one asset in a binary snapshot; strings are (offset, length) into the string section
+    struct SnapshotRecord
+    {
+        uint32_t offsets[5], lengths[5]; // name, symbol, category, type, json
+        double price, change, rank;
+        int64_t marketCap;
+        int32_t score, reserved;
+    };
+
+    struct Group
+    {
+        int32_t typeId, categoryId;
+        std::vector<uint32_t> assets;
+    };
+
+    // Everything a request reads. A published snapshot is never modified: writers
+    // copy the current one, change the copy and swap the pointer, so readers never
+    // wait for a writer.
+    struct Snapshot
+    {
+        std::shared_ptr<StringArena> strings = std::make_shared<StringArena>(); // shared by later copies
+        std::vector<Asset> assets;
+        AssetColumns columns; // numeric fields of assets, column-wise, for scans
+        Trie trie{[](const Asset &a) { return a.rank; }};
+        Interner categories, types;
+        std::bitset<kMaxCategories> prefs; // preferred category ids
+        // the assets of every (type, category) pair, sorted by (typeId, categoryId);
+        // each list is in personal-rank order, which a per-category weight cannot change
+        std::vector<Group> groups;
+        std::shared_ptr<const PriceStats> stats; // as of the last closed bar, sized like assets
+        // secondary indexes for AssetQuery: per field the rows in (value, index) order with
+        // the values alongside, so a range is two binary searches; per category and per
+        // type the rows in index order
+        std::vector<double> keys[AssetQuery::FieldCount];
+        std::vector<uint32_t> sorted[AssetQuery::FieldCount];
+        std::vector<std::vector<uint32_t>> byCategory, byType;
+        std::vector<uint32_t> symbolOrder;              // rows by symbol
+        std::vector<uint32_t> wholeRow;                 // sharded: each row's index in the whole universe
+        std::shared_ptr<const SimilarityIndex> similar; // as of the last closed bar
+    };
+
+    // pins the current snapshot for its lifetime
+    class Reader
+    {
+        Epochs::Guard guard;
+        const Snapshot *snap;
+
+    public:
+        explicit Reader(const InvestmentSystem &sys) : snap(sys.current.load()) {}
+        const Snapshot *operator->() const { return snap; }
+        const Snapshot &operator*() const { return *snap; }
+    };
+
+    std::atomic<Snapshot *> current{nullptr};
+    std::atomic<uint64_t> generation{0}; // bumped by every published snapshot
+    std::mutex changeMutex;
+    std::condition_variable dataChanged; // notified by every published snapshot
+    ResponseCache cache;
+
+    // writer side, never touched by readers
+    std::mutex writeMutex;
+    std::vector<std::pair<uint64_t, std::unique_ptr<Snapshot>>> retired;
+    std::vector<std::pair<std::string_view, uint32_t>> bySymbol; // sorted (symbol, asset index)
+    std::vector<std::string> prefNames = {"defi", "ai", "tech"};
+    ProfileStore profiles;
+    ShardSpec shard; // the assets builds keep
+    PriceHistory history;
+    std::chrono::steady_clock::time_point historyStart; // bar b closes at historyStart + (b + 1) * kBarLength
+    size_t liveStringBytes = 0; // arena size after the last build or compaction
+    std::atomic<uint64_t> ticksApplied{0}, batchesApplied{0};
+
+    std::mutex tickMutex;
+    std::condition_variable tickReady;
+    std::vector<Tick> pendingTicks;
+    bool stopping = false;
+    std::thread ingester;
+    std::condition_variable linkReady; // under tickMutex, like stopping
+    bool linkWanted = false;
+    std::thread linker;
+
+    void initData()
+    {
+        auto s = std::make_unique<Snapshot>();
+        std::vector<Asset> &assets = s->assets;
+            assets = {
+            // Cryptocurrencies (50 samples)
+            {"Bitcoin", "BTC", "layer1", "crypto", 107772.53, -0.14, 2150000000000LL, 92},
+            {"Ethereum", "ETH", "layer1", "crypto", 3874.64, -0.30, 468410000000LL, 88},
+            {"Tether", "USDT", "stablecoin", "crypto", 1.00, 0.0, 182000000000LL, 85},
+            {"Binance Coin", "BNB", "layer1", "crypto", 1068.77, -0.23, 148860000000LL, 84},
+            {"XRP", "XRP", "crypto", "crypto", 2.41, -0.79, 144660000000LL, 80},
+            {"Solana", "SOL", "layer1", "crypto", 184.46, -0.13, 100820000000LL, 86},
+            {"USD Coin", "USDC", "stablecoin", "crypto", 1.00, 0.02, 76270000000LL, 83},
+            {"TRON", "TRX", "crypto", "crypto", 0.3206, 0.04, 30350000000LL, 78},
+            {"Dogecoin", "DOGE", "meme", "crypto", 0.1932, -0.43, 29270000000LL, 78},
+            {"Cardano", "ADA", "layer1", "crypto", 0.64, -0.44, 22940000000LL, 77},
+            {"Chainlink", "LINK", "defi", "crypto", 17.98, 0.49, 12200000000LL, 78},
+            {"Hypersign", "HYPE", "crypto", "crypto", 35.67, -0.55, 12010000000LL, 77},
+            {"Stellar", "XLM", "layer1", "crypto", 0.3148, -0.38, 10080000000LL, 75},
+            {"Bitcoin Cash", "BCH", "layer1", "crypto", 465.86, -0.53, 9290000000LL, 75},
+            {"Sui", "SUI", "layer1", "crypto", 2.48, -0.58, 9019000000LL, 75},
+            {"Avalanche", "AVAX", "defi", "crypto", 19.70, -0.04, 8400000000LL, 76},
+            {"LEO Token", "LEO", "crypto", "crypto", 8.97, -0.01, 8200000000LL, 75},
+            {"Hedera", "HBAR", "crypto", "crypto", 0.1701, -0.20, 7200000000LL, 74},
+            {"Litecoin", "LTC", "layer1", "crypto", 92.32, -0.64, 7050000000LL, 76},
+            {"Shiba Inu", "SHIB", "meme", "crypto", 0.00001, 1.2, 6000000000LL, 72},
+            {"Polygon", "MATIC", "layer1", "crypto", 0.87, 3.45, 8100000000LL, 80},
+            {"Uniswap", "UNI", "defi", "crypto", 8.34, 6.78, 5100000000LL, 82},
+            {"Aave", "AAVE", "defi", "crypto", 78.90, -0.56, 1100000000LL, 83},
+            {"Render", "RNDR", "ai", "crypto", 7.89, 8.45, 2900000000LL, 85},
+            {"Sandbox", "SAND", "gaming", "crypto", 0.45, 12.34, 1200000000LL, 76},
+            {"Basic Attention Token", "BAT", "defi", "crypto", 0.28, -1.2, 1500000000LL, 75},
+            {"Theta Network", "THETA", "media", "crypto", 1.89, -0.9, 3000000000LL, 74},
+            {"VeChain", "VET", "layer1", "crypto", 0.11, -0.5, 6800000000LL, 73},
+            {"Filecoin", "FIL", "storage", "crypto", 4.01, -0.3, 1700000000LL, 75},
+            {"Algorand", "ALGO", "layer1", "crypto", 1.23, -0.7, 2500000000LL, 75},
+            {"Cosmos", "ATOM", "layer1", "crypto", 12.34, -0.9, 3300000000LL, 74},
+            {"Internet Computer", "ICP", "layer1", "crypto", 6.78, -1.1, 1500000000LL, 73},
+            {"Kusama", "KSM", "layer1", "crypto", 180.00, -0.8, 1000000000LL, 74},
+            {"Zcash", "ZEC", "privacy", "crypto", 60.00, -0.4, 900000000LL, 75},
+            {"Dash", "DASH", "privacy", "crypto", 130.00, -0.6, 800000000LL, 73},
+            {"PancakeSwap", "CAKE", "defi", "crypto", 4.50, -1.5, 700000000LL, 70},
+            {"Gala", "GALA", "gaming", "crypto", 0.15, -0.7, 600000000LL, 72},
+            {"Axie Infinity", "AXS", "gaming", "crypto", 10.50, -0.9, 500000000LL, 73},
+            {"Compound", "COMP", "defi", "crypto", 90.00, -1.3, 250000000LL, 74},
+            {"Maker", "MKR", "defi", "crypto", 1500.00, -0.7, 100000000LL, 75},
+            {"Synthetix", "SNX", "defi", "crypto", 3.20, -1.0, 300000000LL, 70},
+            {"Ocean Protocol", "OCEAN", "defi", "crypto", 0.60, -0.5, 250000000LL, 72},
+            {"Storj", "STORJ", "storage", "crypto", 0.95, -0.9, 200000000LL, 70},
+            {"Enjin Coin", "ENJ", "gaming", "crypto", 1.45, -0.9, 250000000LL, 71},
+            {"Celo", "CELO", "layer1", "crypto", 2.50, -1.1, 150000000LL, 72},
+            {"Ren", "REN", "defi", "crypto", 0.90, -1.4, 120000000LL, 70},
+
+            // Stocks (50 samples)
+            {"Apple Inc", "AAPL", "tech", "stock", 178.25, 1.85, 2800000000000LL, 90},
+            {"Microsoft Corp", "MSFT", "tech", "stock", 412.30, 2.14, 3100000000000LL, 92},
+            {"NVIDIA Corp", "NVDA", "tech", "stock", 495.80, 5.67, 1230000000000LL, 95},
+            {"Amazon.com Inc", "AMZN", "tech", "stock", 145.60, 1.23, 1510000000000LL, 88},
+            {"Tesla Inc", "TSLA", "auto", "stock", 242.50, 3.45, 770000000000LL, 82},
+            {"Alphabet Inc", "GOOGL", "tech", "stock", 139.80, 1.89, 1750000000000LL, 89},
+            {"Meta Platforms", "META", "tech", "stock", 485.20, 2.67, 1240000000000LL, 87},
+            {"Netflix Inc", "NFLX", "media", "stock", 478.30, 3.12, 210000000000LL, 81},
+            {"Adobe Inc", "ADBE", "tech", "stock", 567.90, 2.89, 260000000000LL, 88},
+            {"Salesforce Inc", "CRM", "tech", "stock", 267.40, 2.45, 260000000000LL, 84},
+            {"Visa Inc", "V", "financial", "stock", 220.50, 1.30, 487000000000LL, 87},
+            {"Johnson & Johnson", "JNJ", "healthcare", "stock", 165.30, 0.75, 435000000000LL, 83},
+            {"Walmart Inc", "WMT", "retail", "stock", 140.20, 0.58, 395000000000LL, 80},
+            {"Procter & Gamble", "PG", "consumer", "stock", 150.55, 1.10, 345000000000LL, 82},
+            {"Mastercard Inc", "MA", "financial", "stock", 370.10, 1.50, 390000000000LL, 85},
+            {"Intel Corp", "INTC", "tech", "stock", 60.35, 0.80, 250000000000LL, 75},
+            {"Cisco Systems", "CSCO", "tech", "stock", 50.20, 0.45, 210000000000LL, 76},
+            {"PepsiCo Inc", "PEP", "consumer", "stock", 180.25, 0.90, 230000000000LL, 78},
+            {"Coca-Cola Co", "KO", "consumer", "stock", 60.10, 0.60, 260000000000LL, 77},
+            {"Berkshire Hathaway", "BRK.B", "financial", "stock", 540.15, 1.05, 650000000000LL, 88},
+            {"Home Depot", "HD", "retail", "stock", 300.40, 2.00, 350000000000LL, 84},
+            {"Pfizer Inc", "PFE", "healthcare", "stock", 40.10, 0.30, 230000000000LL, 79},
+            {"Abbott Laboratories", "ABT", "healthcare", "stock", 115.20, 1.10, 200000000000LL, 79},
+            {"Nike Inc", "NKE", "consumer", "stock", 115.00, 1.50, 220000000000LL, 80},
+            {"Walt Disney Co", "DIS", "media", "stock", 135.60, 1.20, 330000000000LL, 81},
+            {"ExxonMobil", "XOM", "energy", "stock", 70.10, 0.55, 400000000000LL, 80},
+            {"Chevron Corp", "CVX", "energy", "stock", 105.20, 0.65, 300000000000LL, 79},
+            {"IBM Corp", "IBM", "tech", "stock", 135.00, 0.40, 120000000000LL, 74},
+            {"Boeing Co", "BA", "industrial", "stock", 145.00, 1.10, 140000000000LL, 77},
+            {"Qualcomm Inc", "QCOM", "tech", "stock", 140.00, 1.25, 160000000000LL, 78},
+            {"McDonald's Corp", "MCD", "consumer", "stock", 230.00, 0.90, 190000000000LL, 79},
+            {"American Airlines", "AAL", "industrial", "stock", 18.50, 1.40, 13000000000LL, 65},
+            {"General Electric", "GE", "industrial", "stock", 100.00, 0.75, 120000000000LL, 74},
+            {"Ford Motor Co", "F", "auto", "stock", 15.00, 1.10, 44000000000LL, 70},
+            {"Caterpillar Inc", "CAT", "industrial", "stock", 190.00, 1.20, 110000000000LL, 76},
+            {"Oracle Corp", "ORCL", "tech", "stock", 90.00, 0.85, 200000000000LL, 75}
+        };
+
+        std::lock_guard<std::mutex> lock(writeMutex);
+        buildUniverse(std::move(s));
+    }
+
+    // keeps the last row of every symbol; survivors stay in file order
+    static size_t dedupeBySymbol(std::vector<Asset> &assets)
+    {
+        std::vector<uint32_t> order(assets.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                         { return assets[a].symbol < assets[b].symbol; });
+        std::vector<uint32_t> keep;
+        for (size_t i = 0; i < order.size(); i++)
+            if (i + 1 == order.size() || assets[order[i + 1]].symbol != assets[order[i]].symbol)
+                keep.push_back(order[i]);
+        std::sort(keep.begin(), keep.end());
+        size_t removed = assets.size() - keep.size();
+        for (size_t i = 0; i < keep.size(); i++)
+            assets[i] = assets[keep[i]];
+        assets.resize(keep.size());
+        return removed;
+    }
+
+    // writer only
+    void indexSymbols(Snapshot &s)
+    {
+        bySymbol.clear();
+        bySymbol.reserve(s.assets.size());
+        for (uint32_t i = 0; i < s.assets.size(); i++)
+            bySymbol.emplace_back(s.assets[i].symbol, i);
+        std::sort(bySymbol.begin(), bySymbol.end());
+        s.symbolOrder.clear();
+        for (auto &entry : bySymbol)
+            s.symbolOrder.push_back(entry.second);
+    }
+
+    // writer only: dedupes s->assets, ranks them, builds the index and publishes the result
+    void buildUniverse(std::unique_ptr<Snapshot> s)
+    {
+        std::vector<Asset> &assets = s->assets;
+        dedupeBySymbol(assets);
+        s->wholeRow.clear();
+        if (shard.sharded())
+        {
+            // every shard dedupes the same input the same way, so the rows agree across them
+            size_t kept = 0;
+            for (size_t i = 0; i < assets.size(); i++)
+                if (shard.keeps(assets[i]))
+                {
+                    s->wholeRow.push_back(static_cast<uint32_t>(i));
+                    if (kept != i)
+                        assets[kept] = std::move(assets[i]);
+                    kept++;
+                }
+            assets.resize(kept);
+        }
+        setPrefs(*s, prefNames);
+        for (auto &a : assets)
+        {
+            a.categoryId = s->categories.intern(a.category);
+            a.typeId = s->types.intern(a.type);
+        }
+        rankAll(*s);
+        for (size_t i = 0; i < assets.size(); i++)
+        {
+            assets[i].rank = s->columns.rank[i];
+            toJSON(assets[i], *s->strings);
+        }
+
+        // insert into trie
+        for (auto &a : assets)
+        {
+            s->trie.insert(a.name, &a);
+            s->trie.insert(a.symbol, &a);
+            s->trie.insert(a.category, &a);
+        }
+        s->trie.build();
+        indexSymbols(*s);
+        resetHistory(*s);
+        liveStringBytes = s->strings->bytes();
+        publish(std::move(s));
+    }
+
+    // writer only: starts the price history over for s's assets, its statistics empty
+    void resetHistory(Snapshot &s)
+    {
+        history.reset(s.assets.size());
+        historyStart = std::chrono::steady_clock::now();
+        s.stats = history.stats();
+        setSimilarity(s);
+    }
+
+    // writer only: gives s unlinked similarity features from the history so far and has
+    // the linker thread link them
+    void setSimilarity(Snapshot &s)
+    {
+        s.similar = similarityFeatures(s);
+        {
+            std::lock_guard<std::mutex> lock(tickMutex);
+            linkWanted = true;
+        }
+        linkReady.notify_one();
+    }
+
+    // writer only: the SimilarityIndex features of s's assets. Return steps end at the
+    // last closed bar; an asset needs 3 steps and a price that moved to get return features.
+    std::shared_ptr<SimilarityIndex> similarityFeatures(const Snapshot &s) const
+    {
+        using X = SimilarityIndex;
+        auto x = std::make_shared<X>();
+        const size_t n = s.assets.size(), stride = (n + 7) / 8 * 8;
+        x->n = n;
+        x->stride = stride;
+        x->features.assign(X::kDims * stride, 0.0f);
+        x->categoryId.assign(stride, -1);
+        const uint64_t closed = history.barsClosed();
+        const size_t steps = closed > 0 ? std::min<uint64_t>(X::kSteps, (closed - 1) / X::kStepBars) : 0;
+        const uint64_t first = closed - 1 - steps * X::kStepBars;
+        const float capWeight = std::sqrt(X::kCapWeight);
+        double step[X::kSteps];
+        for (size_t i = 0; i < n; i++)
+        {
+            x->categoryId[i] = s.columns.categoryId[i];
+            if (steps >= 3)
+            {
+                double mean = 0, norm = 0;
+                for (size_t t = 0; t < steps; t++)
+                {
+                    step[t] = history.move(i, first + t * X::kStepBars, first + (t + 1) * X::kStepBars);
+                    mean += step[t];
+                }
+                mean /= static_cast<double>(steps);
+                for (size_t t = 0; t < steps; t++)
+                {
+                    step[t] -= mean;
+                    norm += step[t] * step[t];
+                }
+                norm = std::sqrt(norm);
+                // below float resolution the direction is noise
+                if (norm > 1e-7)
+                    for (size_t t = 0; t < steps; t++)
+                        x->features[t * stride + i] = static_cast<float>(step[t] / norm);
+            }
+            double cap = s.columns.marketCap[i];
+            double decades = cap > 0 ? std::clamp(std::log10(cap) - 6, 0.0, 7.0) : 0.0;
+            double angle = decades / 7 * std::acos(0.0);
+            x->features[X::kSteps * stride + i] = capWeight * static_cast<float>(std::cos(angle));
+            x->features[(X::kSteps + 1) * stride + i] = capWeight * static_cast<float>(std::sin(angle));
+        }
+        return x;
+    }
+
+    // links the current snapshot's similarity features, if not linked yet, off the write
+    // lock, and publishes them unless a newer bar replaced them meanwhile
+    void linkSimilar()
+    {
+        std::shared_ptr<const SimilarityIndex> features;
+        {
+            std::lock_guard<std::mutex> writer(writeMutex);
+            features = current.load()->similar;
+        }
+        if (!features || features->linked || features->n > kMaxLinkedAssets)
+            return;
+        auto linked = std::make_shared<SimilarityIndex>(*features);
+        kernels::similarNeighbors(*linked, std::min(8u, std::max(1u, std::thread::hardware_concurrency())));
+        std::lock_guard<std::mutex> writer(writeMutex);
+        if (current.load()->similar != features)
+            return;
+        auto next = copyCurrent();
+        next->similar = std::move(linked);
+        publish(std::move(next));
+    }
+
+    void linkLoop()
+    {
+        std::unique_lock<std::mutex> lock(tickMutex);
+        while (true)
+        {
+            linkReady.wait(lock, [this] { return stopping || linkWanted; });
+            if (stopping)
+                return;
+            linkWanted = false;
+            lock.unlock();
+            linkSimilar();
+            lock.lock();
+        }
+    }
+
+    // writer only: moves the live strings of s into a fresh arena. Fragments rewritten by
+    // ticks leave dead bytes behind; the old arena lives on with the snapshots using it.
+    void compactStrings(Snapshot &s)
+    {
+        auto fresh = std::make_shared<StringArena>();
+        for (auto &a : s.assets)
+        {
+            a.name = fresh->add(a.name);
+            a.symbol = fresh->add(a.symbol);
+            a.category = fresh->add(a.category);
+            a.type = fresh->add(a.type);
+            a.json = fresh->add(a.json);
+        }
+        s.strings = std::move(fresh);
+        indexSymbols(s);
+        liveStringBytes = s.strings->bytes();
+    }
+
+    static double calcScore(const Snapshot &s, const Asset &a)
+    {
+        double score = a.score + a.trend;
+        if (a.categoryId < kMaxCategories && s.prefs.test(a.categoryId))
+            score += 15;
+        if (a.marketCap > 50000000000LL)
+            score += 10;
+        return std::min(100.0, score);
+    }
+
+    // score points from the last hour's momentum: one per percent, at most 5 either way
+    static double trendPoints(double momentum)
+    {
+        return momentum == momentum ? std::max(-5.0, std::min(5.0, momentum * 100)) : 0;
+    }
+
+    // momentum columns and trend of asset i from s.stats and its current price
+    static void updateTrend(Snapshot &s, uint32_t i)
+    {
+        Asset &a = s.assets[i];
+        for (int w = 0; w < PriceStats::kWindows; w++)
+            s.columns.momentum[w][i] = s.stats->momentum(w, i, a.price);
+        a.trend = trendPoints(s.columns.momentum[kTrendWindow][i]);
+    }
+
+    static void setPrefs(Snapshot &s, const std::vector<std::string> &names)
+    {
+        s.prefs.reset();
+        for (auto &n : names)
+        {
+            uint16_t id = s.categories.intern(n);
+            if (id < kMaxCategories)
+                s.prefs.set(id);
+        }
+    }
+
+    // refills every column from the assets and computes columns.rank for all of them
+    // with the rank kernel; the assets' own rank is left for the caller to compare
+    static void rankAll(Snapshot &s)
+    {
+        s.columns.resize(s.assets.size());
+        for (size_t i = 0; i < s.assets.size(); i++)
+            s.columns.set(i, s.assets[i]);
+        std::vector<double> bonus(std::max<size_t>(s.categories.size(), 1), 0.0);
+        for (size_t id = 0; id < std::min(bonus.size(), kMaxCategories); id++)
+            if (s.prefs.test(id))
+                bonus[id] = 15;
+        kernels::ranks(s.columns, bonus.data(), s.assets.size(), s.columns.rank.data());
+        groupAll(s);
+        indexAll(s);
+    }
+
+    // NaN sorts first in the field indexes and never matches a filter
+    static double indexKey(double v) { return v == v ? v : -std::numeric_limits<double>::infinity(); }
+
+    // rebuilds the category and type lists and every field index from the columns
+    static void indexAll(Snapshot &s)
+    {
+        const AssetColumns &c = s.columns;
+        s.byCategory.assign(s.categories.size(), {});
+        s.byType.assign(s.types.size(), {});
+        std::vector<uint32_t> all(s.assets.size());
+        for (uint32_t i = 0; i < all.size(); i++)
+        {
+            s.byCategory[c.categoryId[i]].push_back(i);
+            s.byType[c.typeId[i]].push_back(i);
+            all[i] = i;
+        }
+        for (int f = 0; f < AssetQuery::FieldCount; f++)
+        {
+            s.keys[f].clear();
+            s.sorted[f].clear();
+        }
+        reindex(s, all);
+    }
+
+    // puts the dirty assets (sorted by index) back in order in every field index: a few
+    // are moved one by one, more by one pass that drops them and a merge from the back
+    // that puts them in at their new values
+    static void reindex(Snapshot &s, const std::vector<uint32_t> &dirty)
+    {
+        const size_t n = s.assets.size();
+        if (dirty.size() <= 8 && s.sorted[0].size() == n)
+        {
+            for (int f = 0; f < AssetQuery::FieldCount; f++)
+            {
+                const double *column = AssetQuery::column(s.columns, f);
+                std::vector<double> &keys = s.keys[f];
+                std::vector<uint32_t> &rows = s.sorted[f];
+                for (uint32_t i : dirty)
+                {
+                    size_t from = static_cast<size_t>(std::find(rows.begin(), rows.end(), i) - rows.begin());
+                    double key = indexKey(column[i]);
+                    // the first entry (key, i) sorts before, skipping i's own entry
+                    size_t lo = 0, hi = n - 1;
+                    while (lo < hi)
+                    {
+                        size_t mid = (lo + hi) / 2;
+                        size_t at = mid < from ? mid : mid + 1;
+                        if (std::make_pair(keys[at], rows[at]) < std::make_pair(key, i))
+                            lo = mid + 1;
+                        else
+                            hi = mid;
+                    }
+                    // lo is i's position once its old entry is gone
+                    if (lo < from)
+                    {
+                        std::copy_backward(keys.begin() + lo, keys.begin() + from, keys.begin() + from + 1);
+                        std::copy_backward(rows.begin() + lo, rows.begin() + from, rows.begin() + from + 1);
+                    }
+                    else
+                    {
+                        std::copy(keys.begin() + from + 1, keys.begin() + lo + 1, keys.begin() + from);
+                        std::copy(rows.begin() + from + 1, rows.begin() + lo + 1, rows.begin() + from);
+                    }
+                    keys[lo] = key;
+                    rows[lo] = i;
+                }
+            }
+            return;
+        }
+        std::vector<uint8_t> isDirty(n, 0);
+        for (uint32_t i : dirty)
+            isDirty[i] = 1;
+        std::vector<std::pair<double, uint32_t>> fresh(dirty.size());
+        for (int f = 0; f < AssetQuery::FieldCount; f++)
+        {
+            const double *column = AssetQuery::column(s.columns, f);
+            std::vector<double> &keys = s.keys[f];
+            std::vector<uint32_t> &rows = s.sorted[f];
+            size_t kept = 0;
+            for (size_t j = 0; j < rows.size(); j++)
+                if (!isDirty[rows[j]])
+                {
+                    keys[kept] = keys[j];
+                    rows[kept++] = rows[j];
+                }
+            for (size_t j = 0; j < dirty.size(); j++)
+                fresh[j] = {indexKey(column[dirty[j]]), dirty[j]};
+            std::sort(fresh.begin(), fresh.end());
+            keys.resize(n);
+            rows.resize(n);
+            for (size_t to = n, a = kept, b = fresh.size(); b > 0;)
+            {
+                if (a > 0 && std::make_pair(keys[a - 1], rows[a - 1]) > fresh[b - 1])
+                {
+                    a--;
+                    keys[--to] = keys[a];
+                    rows[to] = rows[a];
+                }
+                else
+                {
+                    b--;
+                    keys[--to] = fresh[b].first;
+                    rows[to] = fresh[b].second;
+                }
+            }
+        }
+    }
+
+    // rank without the category bonus and without the cap at 100
+    static double baseRank(const AssetColumns &c, size_t i)
+    {
+        double r = c.score[i] + c.trend[i];
+        return c.marketCap[i] > 50000000000.0 ? r + 10 : r;
+    }
+
+    // the base rank plus the user's weight for the asset's category, capped at 100 like the
+    // shared rank
+    static double personalRank(const AssetColumns &c, size_t i, const std::vector<double> &bonus)
+    {
+        return std::min(100.0, baseRank(c, i) + bonus[static_cast<size_t>(c.categoryId[i])]);
+    }
+
+    // best base rank first, ties to the lower index
+    static bool baseOrder(const AssetColumns &c, uint32_t a, uint32_t b)
+    {
+        double ra = baseRank(c, a), rb = baseRank(c, b);
+        return ra > rb || (ra == rb && a < b);
+    }
+
+    static bool groupBefore(const Group &g, int32_t typeId, int32_t categoryId)
+    {
+        return g.typeId < typeId || (g.typeId == typeId && g.categoryId < categoryId);
+    }
+
+    // rebuilds s.groups from the columns
+    static void groupAll(Snapshot &s)
+    {
+        const AssetColumns &c = s.columns;
+        std::vector<uint32_t> order(s.assets.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                  {
+                      if (c.typeId[a] != c.typeId[b])
+                          return c.typeId[a] < c.typeId[b];
+                      if (c.categoryId[a] != c.categoryId[b])
+                          return c.categoryId[a] < c.categoryId[b];
+                      return baseOrder(c, a, b);
+                  });
+        s.groups.clear();
+        for (uint32_t i : order)
+        {
+            if (s.groups.empty() || s.groups.back().typeId != c.typeId[i] || s.groups.back().categoryId != c.categoryId[i])
+                s.groups.push_back({c.typeId[i], c.categoryId[i], {}});
+            s.groups.back().assets.push_back(i);
+        }
+    }
+
+    // puts assets whose base rank changed (sorted by index) back in order in their groups:
+    // one pass drops them from a group and a merge puts them back
+    static void regroup(Snapshot &s, const std::vector<uint32_t> &shifted)
+    {
+        const AssetColumns &c = s.columns;
+        std::vector<std::pair<uint32_t, uint32_t>> byGroup; // (group, asset)
+        for (uint32_t i : shifted)
+        {
+            auto g = std::lower_bound(s.groups.begin(), s.groups.end(), std::make_pair(c.typeId[i], c.categoryId[i]),
+                                      [](const Group &g, const std::pair<int32_t, int32_t> &key)
+                                      { return groupBefore(g, key.first, key.second); });
+            byGroup.emplace_back(static_cast<uint32_t>(g - s.groups.begin()), i);
+        }
+        std::sort(byGroup.begin(), byGroup.end());
+        std::vector<uint32_t> moved, kept, merged;
+        for (size_t from = 0, to; from < byGroup.size(); from = to)
+        {
+            Group &g = s.groups[byGroup[from].first];
+            moved.clear();
+            for (to = from; to < byGroup.size() && byGroup[to].first == byGroup[from].first; to++)
+                moved.push_back(byGroup[to].second);
+            kept.clear();
+            for (uint32_t i : g.assets)
+                if (!std::binary_search(moved.begin(), moved.end(), i))
+                    kept.push_back(i);
+            std::sort(moved.begin(), moved.end(), [&](uint32_t a, uint32_t b) { return baseOrder(c, a, b); });
+            merged.resize(g.assets.size());
+            std::merge(kept.begin(), kept.end(), moved.begin(), moved.end(), merged.begin(),
+                       [&](uint32_t a, uint32_t b) { return baseOrder(c, a, b); });
+            g.assets.swap(merged);
+        }
+    }
+
+    // user's weights indexed by s's category ids; false for an unknown user. The profile
+    // is copied out under the shard lock and looked up in s after it is released.
+    bool profileBonus(const Snapshot &s, const std::string &user, std::vector<double> &bonus) const
+    {
+        ProfileStore::Profile p;
+        if (!profiles.read(user, [&](const ProfileStore::Profile &stored) { p = stored; }))
+            return false;
+        bonus.assign(s.categories.size(), 0.0);
+        for (size_t j = 0; j < p.count; j++)
+        {
+            int id = s.categories.find(profiles.categoryName(p.categories[j]));
+            if (id >= 0)
+                bonus[static_cast<size_t>(id)] = p.weights[j];
+        }
+        return true;
+    }
+
+    // the k best personal ranks among assets of type typeId (any when kAnyType), best
+    // first, ties to the lower index. bonus holds the user's weight per category id.
+    // Every group is already in personal-rank order, so a heap over the group heads
+    // yields the answer after k pops instead of ranking the whole universe. The assets a
+    // group has at the cap form a prefix of it and tie there, so the lowest indices among
+    // them go first: picked from the prefixes when they are few, else by walking the
+    // assets in index order until k are found at the cap.
+    static void personalTop(const Snapshot &s, const std::vector<double> &bonus, int typeId, size_t k,
+                            std::vector<uint32_t> &out)
+    {
+        struct Head
+        {
+            double rank;
+            uint32_t asset, group, pos;
+        };
+        static thread_local std::vector<Head> heap;
+        static thread_local std::vector<uint32_t> cappedEnd; // per group
+        const AssetColumns &c = s.columns;
+        auto worse = [](const Head &a, const Head &b)
+        { return a.rank < b.rank || (a.rank == b.rank && a.asset > b.asset); };
+        auto head = [&](uint32_t group, uint32_t pos)
+        {
+            uint32_t i = s.groups[group].assets[pos];
+            return Head{personalRank(c, i, bonus), i, group, pos};
+        };
+        auto atCap = [&](uint32_t i) { return personalRank(c, i, bonus) >= 100.0; };
+        auto wanted = [&](const Group &g) { return typeId == Trie::kAnyType || g.typeId == typeId; };
+
+        heap.clear();
+        out.clear();
+        cappedEnd.assign(s.groups.size(), 0);
+        size_t capped = 0, candidates = 0;
+        for (uint32_t g = 0; g < s.groups.size(); g++)
+        {
+            const Group &group = s.groups[g];
+            if (!wanted(group))
+                continue;
+            auto end = std::partition_point(group.assets.begin(), group.assets.end(), atCap);
+            cappedEnd[g] = static_cast<uint32_t>(end - group.assets.begin());
+            capped += cappedEnd[g];
+            candidates += group.assets.size();
+            if (end != group.assets.end())
+                heap.push_back(head(g, cappedEnd[g]));
+        }
+        if (capped > 0 && capped * capped <= k * candidates)
+        {
+            // out stays a max-heap of the k lowest indices seen
+            for (uint32_t g = 0; g < s.groups.size(); g++)
+                for (uint32_t pos = 0; pos < cappedEnd[g]; pos++)
+                {
+                    uint32_t i = s.groups[g].assets[pos];
+                    if (out.size() == k && i > out.front())
+                        continue;
+                    if (out.size() == k)
+                    {
+                        std::pop_heap(out.begin(), out.end());
+                        out.pop_back();
+                    }
+                    out.push_back(i);
+                    std::push_heap(out.begin(), out.end());
+                }
+            std::sort_heap(out.begin(), out.end());
+        }
+        else if (capped > 0)
+        {
+            for (uint32_t i = 0; i < s.assets.size() && out.size() < k; i++)
+                if ((typeId == Trie::kAnyType || c.typeId[i] == typeId) && atCap(i))
+                    out.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), worse);
+        while (out.size() < k && !heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            Head h = heap.back();
+            heap.pop_back();
+            out.push_back(h.asset);
+            if (h.pos + 1 < s.groups[h.group].assets.size())
+            {
+                heap.push_back(head(h.group, h.pos + 1));
+                std::push_heap(heap.begin(), heap.end(), worse);
+            }
+        }
+    }
+
+    // recomputes rank, columns and fragment of the dirty assets and the trie lists and
+    // groups they can move; dirty is sorted
+    static void refresh(Snapshot &s, const std::vector<uint32_t> &dirty)
+    {
+        for (uint32_t i : dirty)
+            updateTrend(s, i);
+        if (dirty.size() == s.assets.size())
+            rankAll(s);
+        else
+        {
+            std::vector<uint32_t> shifted;
+            for (uint32_t i : dirty)
+            {
+                double before = baseRank(s.columns, i);
+                s.columns.set(i, s.assets[i]);
+                s.columns.rank[i] = calcScore(s, s.assets[i]);
+                if (baseRank(s.columns, i) != before)
+                    shifted.push_back(i);
+            }
+            regroup(s, shifted);
+            reindex(s, dirty);
+        }
+
+        std::vector<const Asset *> moved;
+        for (uint32_t i : dirty)
+        {
+            Asset &a = s.assets[i];
+            double r = s.columns.rank[i];
+            if (r != a.rank)
+                moved.push_back(&a);
+            a.rank = r;
+            toJSON(a, *s.strings);
+        }
+        // past a few percent of the universe one bottom-up pass beats per-path updates
+        if (moved.size() * 16 > s.assets.size())
+        {
+            s.trie.buildTopLists();
+            return;
+        }
+        for (const Asset *a : moved)
+        {
+            s.trie.rerank(a->name);
+            s.trie.rerank(a->symbol);
+            s.trie.rerank(a->category);
+        }
+    }
+
+    // the assets' fragments with the window's statistics added: moves in percent, prices
+    // at the float precision the history keeps
+    static void appendMovers(const Snapshot &s, int w, const std::vector<uint32_t> &rows, std::string &out)
+    {
+        const PriceStats &st = *s.stats;
+        auto percent = [](double v) { return std::round(v * 1e4) / 1e2; };
+        out += '[';
+        for (size_t j = 0; j < rows.size(); j++)
+        {
+            uint32_t i = rows[j];
+            const Asset &a = s.assets[i];
+            if (j > 0)
+                out += ',';
+            out.append(a.json.data(), a.json.size() - 1);
+            out += ",\"momentum\":";
+            appendNumber(out, percent(s.columns.momentum[w][i]));
+            out += ",\"volatility\":";
+            appendNumber(out, percent(st.volatility[w][i]));
+            out += ",\"sma\":";
+            appendNumber(out, static_cast<float>(st.sma[w][i]));
+            out += ",\"ema\":";
+            appendNumber(out, static_cast<float>(st.ema[w][i]));
+            out += ",\"high\":";
+            appendNumber(out, static_cast<float>(st.high[w][i]));
+            out += ",\"drawdown\":";
+            appendNumber(out, percent(st.drawdown(w, i, a.price)));
+            out += '}';
+        }
+        out += ']';
+    }
+
+    // the row of the asset with this symbol, -1 if none
+    static long symbolRow(const Snapshot &s, const std::string &symbol)
+    {
+        auto it = std::lower_bound(s.symbolOrder.begin(), s.symbolOrder.end(), symbol, [&](uint32_t i, const std::string &key)
+                                   { return s.assets[i].symbol < std::string_view(key); });
+        return it != s.symbolOrder.end() && s.assets[*it].symbol == symbol ? static_cast<long>(*it) : -1;
+    }
+
+    // kAnyType for "", -2 for a type no asset has (matches nothing)
+    static int typeFilter(const Snapshot &s, const std::string &type)
+    {
+        if (type.empty())
+            return Trie::kAnyType;
+        int id = s.types.find(type);
+        return id < 0 ? -2 : id;
+    }
+
+    // writer only: a private, mutable copy of the published snapshot
+    std::unique_ptr<Snapshot> copyCurrent() const
+    {
+        const Snapshot &cur = *current.load();
+        auto s = std::make_unique<Snapshot>(cur);
+        s->trie.rebase(cur.assets.data(), s->assets.data());
+        return s;
+    }
+
+    // writer only (or before any reader exists)
+    void publish(std::unique_ptr<Snapshot> next)
+    {
+        Snapshot *old = current.exchange(next.release());
+        {
+            // under changeMutex, so a waitForData() between its check and its wait still hears it
+            std::lock_guard<std::mutex> lock(changeMutex);
+            generation.fetch_add(1, std::memory_order_release);
+        }
+        dataChanged.notify_all();
+        if (old)
+            retired.emplace_back(Epochs::global().advance(), std::unique_ptr<Snapshot>(old));
+        reclaim();
+    }
+
+    void reclaim()
+    {
+        Epochs &epochs = Epochs::global();
+        retired.erase(std::remove_if(retired.begin(), retired.end(), [&](const auto &r)
+                                     { return epochs.quiescent(r.first); }),
+                      retired.end());
+    }
+
+    bool loadSnapshot(const std::string &path)
+    {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(path))
+        {
+            std::cerr << "Cannot map " << path << "\n";
+            return false;
+        }
+        BinaryReader r(file->data(), file->size());
+        char magic[sizeof(kSnapshotMagic)];
+        uint32_t version, recordSize;
+        const SnapshotRecord *records;
+        const char *blob;
+        size_t count, blobSize;
+        for (char &c : magic)
+            r.value(c);
+        if (!r.value(version) || !r.value(recordSize) || version != kSnapshotVersion ||
+            recordSize != sizeof(SnapshotRecord) || !r.array(records, count) || !r.array(blob, blobSize))
+        {
+            std::cerr << path << ": not a snapshot of this build\n";
+            return false;
+        }
+
+        auto s = std::make_unique<Snapshot>();
+        s->strings->pin(file);
+        s->assets.resize(count);
+        setPrefs(*s, prefNames);
+        bool stale = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            const SnapshotRecord &rec = records[i];
+            std::string_view fields[5];
+            for (int f = 0; f < 5; f++)
+            {
+                if (rec.offsets[f] > blobSize || rec.lengths[f] > blobSize - rec.offsets[f])
+                {
+                    std::cerr << path << ": corrupt record " << i << "\n";
+                    return false;
+                }
+                fields[f] = std::string_view(blob + rec.offsets[f], rec.lengths[f]);
+            }
+            Asset &a = s->assets[i];
+            a.name = fields[0];
+            a.symbol = fields[1];
+            a.category = fields[2];
+            a.type = fields[3];
+            a.json = fields[4];
+            a.price = rec.price;
+            a.change = rec.change;
+            a.marketCap = rec.marketCap;
+            a.score = rec.score;
+            a.categoryId = s->categories.intern(a.category);
+            a.typeId = s->types.intern(a.type);
+            a.rank = rec.rank;
+        }
+        rankAll(*s);
+        for (size_t i = 0; i < count; i++)
+        {
+            Asset &a = s->assets[i];
+            // saved under other preferences: re-rank instead of trusting the saved lists
+            if (a.rank != s->columns.rank[i])
+            {
+                a.rank = s->columns.rank[i];
+                toJSON(a, *s->strings);
+                stale = true;
+            }
+        }
+        if (!s->trie.load(r, s->assets.data(), count))
+        {
+            std::cerr << path << ": corrupt index\n";
+            return false;
+        }
+        if (stale)
+            s->trie.buildTopLists();
+
+        std::lock_guard<std::mutex> lock(writeMutex);
+        indexSymbols(*s);
+        resetHistory(*s);
+        liveStringBytes = s->strings->bytes() + blobSize;
+        publish(std::move(s));
+        return true;
+    }
+
+    // drains pendingTicks; everything queued while a batch is applied becomes the next batch
+    void ingestLoop()
+    {
+        std::vector<Tick> batch;
+        std::unique_lock<std::mutex> lock(tickMutex);
+        while (true)
+        {
+            // the timeout also reclaims snapshots retired by the last batch once readers move on
+            tickReady.wait_for(lock, std::chrono::milliseconds(100), [this]
+                               { return stopping || !pendingTicks.empty(); });
+            if (stopping)
+                return;
+            batch.swap(pendingTicks);
+            lock.unlock();
+            if (!batch.empty())
+                applyTicks(batch);
+            else
+            {
+                std::lock_guard<std::mutex> writer(writeMutex);
+                reclaim();
+            }
+            closeBars();
+            batch.clear();
+            lock.lock();
+        }
+    }
+
+    // closes the bars the clock has passed at the current prices and publishes their
+    // statistics with the momentum, trend and rank they move. After a gap longer than the
+    // history holds the history starts over rather than filling it with one price.
+    void closeBars()
+    {
+        std::lock_guard<std::mutex> writer(writeMutex);
+        uint64_t due = static_cast<uint64_t>((std::chrono::steady_clock::now() - historyStart) / kBarLength);
+        if (due <= history.barsClosed())
+            return;
+        auto next = copyCurrent();
+        if (due - history.barsClosed() > PriceHistory::kBars)
+            resetHistory(*next);
+        else
+        {
+            while (history.barsClosed() < due)
+                history.close(next->columns.price);
+            next->stats = history.stats();
+            setSimilarity(*next);
+        }
+        std::vector<uint32_t> moved;
+        for (uint32_t i = 0; i < next->assets.size(); i++)
+        {
+            double before = next->assets[i].trend;
+            updateTrend(*next, i);
+            if (next->assets[i].trend != before)
+                moved.push_back(i);
+        }
+        refresh(*next, moved);
+        if (next->strings->bytes() > 2 * liveStringBytes + (1u << 20))
+            compactStrings(*next);
+        publish(std::move(next));
+    }
+
+    // rebuilds a's cached fragment in strings; responses only ever copy a.json
+    static void toJSON(Asset &a, StringArena &strings)
+    {
+        static thread_local std::string out;
+        out.clear();
+        out += "{\"name\":";
+        appendString(out, a.name);
+        out += ",\"symbol\":";
+        appendString(out, a.symbol);
+        out += ",\"price\":";
+        appendNumber(out, a.price);
+        out += ",\"change\":";
+        appendNumber(out, a.change);
+        out += ",\"cap\":";
+        appendNumber(out, a.marketCap / 1e9);
+        out += ",\"cat\":";
+        appendString(out, a.category);
+        out += ",\"type\":";
+        appendString(out, a.type);
+        out += ",\"score\":";
+        appendNumber(out, static_cast<long long>(a.rank));
+        out += '}';
+        a.json = strings.add(out);
+    }
+
+    // {"keys":[...],"typos":[...],"rows":[...],"results":[...]}: a shard's ranked results with
+    // what the router merges them by, fewest typos first (when typos is given), then the
+    // highest key, then the lowest row in the whole universe as a single process would
+    template <class List>
+    static void appendPartial(const Snapshot &s, std::string &out, const List &list, const std::vector<double> &keys,
+                              const std::vector<uint32_t> *typos)
+    {
+        out += "{\"keys\":[";
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (i > 0)
+                out += ',';
+            appendNumber(out, keys[i]);
+        }
+        if (typos)
+        {
+            out += "],\"typos\":[";
+            for (size_t i = 0; i < typos->size(); i++)
+            {
+                if (i > 0)
+                    out += ',';
+                appendNumber(out, static_cast<long long>((*typos)[i]));
+            }
+        }
+        out += "],\"rows\":[";
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            if (i > 0)
+                out += ',';
+            size_t row = static_cast<size_t>(list[i] - s.assets.data());
+            appendNumber(out, static_cast<long long>(s.wholeRow.empty() ? row : s.wholeRow[row]));
+        }
+        out += "],\"results\":";
+        appendArray(out, list, list.size());
+        out += '}';
+    }
+
+    template <class List>
+    static void appendArray(std::string &out, const List &list, size_t limit)
+    {
+        out += '[';
+        for (size_t i = 0; i < limit && i < list.size(); i++)
+        {
+            if (i > 0)
+                out += ',';
+            out += list[i]->json;
+        }
+        out += ']';
+    }
+
+public:
+    static constexpr size_t kSearchResults = 50, kRecommendations = 5;
+
+    InvestmentSystem()
+    {
+        initData();
+        ingester = std::thread(&InvestmentSystem::ingestLoop, this);
+        linker = std::thread(&InvestmentSystem::linkLoop, this);
+    }
+
+    ~InvestmentSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(tickMutex);
+            stopping = true;
+        }
+        tickReady.notify_one();
+        linkReady.notify_one();
+        ingester.join();
+        linker.join();
+        delete current.load();
+    }
+
+    InvestmentSystem(const InvestmentSystem &) = delete;
+    InvestmentSystem &operator=(const InvestmentSystem &) = delete;
+
+    // replaces the preferred categories and re-ranks everything once
+    void setPreferences(const std::vector<std::string> &names)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto next = copyCurrent();
+        prefNames = names;
+        setPrefs(*next, names);
+        std::vector<uint32_t> all(next->assets.size());
+        for (uint32_t i = 0; i < all.size(); i++)
+            all[i] = i;
+        refresh(*next, all);
+        publish(std::move(next));
+    }
+
+    // applies a batch to a copy of the current snapshot and publishes it in one swap;
+    // returns how many ticks named a known symbol and were applied. Ticks with a price that
+    // is not finite and positive, an infinite change (NaN keeps the current one), or a cap
+    // that would not fit are skipped.
+    size_t applyTicks(const std::vector<Tick> &ticks)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        std::unique_ptr<Snapshot> next;
+        std::vector<uint32_t> dirty;
+        size_t matched = 0;
+        for (auto &t : ticks)
+        {
+            auto it = std::lower_bound(bySymbol.begin(), bySymbol.end(), std::string_view(t.symbol),
+                                       [](const auto &e, std::string_view sym) { return e.first < sym; });
+            if (it == bySymbol.end() || it->first != t.symbol || !std::isfinite(t.price) || !(t.price > 0) ||
+                std::isinf(t.change))
+                continue;
+            // writer only, so the current snapshot stays put while we read it
+            const Asset &was = next ? next->assets[it->second] : current.load()->assets[it->second];
+            long long cap = t.marketCap;
+            if (cap < 0)
+            {
+                double scaled = was.price > 0 ? static_cast<double>(was.marketCap) * (t.price / was.price) : -1;
+                if (!(scaled >= 0 && scaled < static_cast<double>(std::numeric_limits<long long>::max())))
+                    continue;
+                cap = static_cast<long long>(scaled);
+            }
+            if (!next)
+                next = copyCurrent();
+            matched++;
+            Asset &a = next->assets[it->second];
+            a.marketCap = cap;
+            if (!std::isnan(t.change))
+                a.change = t.change;
+            a.price = t.price;
+            dirty.push_back(it->second);
+        }
+        if (!next)
+            return 0;
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        refresh(*next, dirty);
+        if (next->strings->bytes() > 2 * liveStringBytes + (1u << 20))
+            compactStrings(*next);
+        publish(std::move(next));
+        ticksApplied.fetch_add(matched, std::memory_order_relaxed);
+        batchesApplied.fetch_add(1, std::memory_order_relaxed);
+        return matched;
+    }
+
+    // queues ticks for the ingest thread without waiting for them to be applied;
+    // returns how many were accepted (the queue is bounded)
+    size_t submitTicks(std::vector<Tick> &&ticks)
+    {
+        size_t accepted;
+        {
+            std::lock_guard<std::mutex> lock(tickMutex);
+            accepted = std::min(ticks.size(), kMaxPendingTicks - std::min(kMaxPendingTicks, pendingTicks.size()));
+            pendingTicks.insert(pendingTicks.end(), std::make_move_iterator(ticks.begin()),
+                                std::make_move_iterator(ticks.begin() + static_cast<std::ptrdiff_t>(accepted)));
+        }
+        tickReady.notify_one();
+        return accepted;
+    }
+
+    uint64_t tickCount() const { return ticksApplied.load(std::memory_order_relaxed); }
+    uint64_t batchCount() const { return batchesApplied.load(std::memory_order_relaxed); }
+
+    std::vector<std::string> symbols() const
+    {
+        Reader s(*this);
+        std::vector<std::string> out;
+        for (auto &a : s->assets)
+            out.emplace_back(a.symbol);
+        return out;
+    }
+
+    std::vector<std::string> names() const
+    {
+        Reader s(*this);
+        std::vector<std::string> out;
+        for (auto &a : s->assets)
+            out.emplace_back(a.name);
+        return out;
+    }
+
+    size_t assetCount() const
+    {
+        Reader s(*this);
+        return s->assets.size();
+    }
+
+    // replaces the universe with a CSV/JSONL file or a binary snapshot (told apart by
+    // its magic); the current data stays published if loading fails
+    bool loadFile(const std::string &path)
+    {
+        char magic[sizeof(kSnapshotMagic)] = {};
+        if (std::FILE *f = std::fopen(path.c_str(), "rb"))
+        {
+            size_t n = std::fread(magic, 1, sizeof(magic), f);
+            std::fclose(f);
+            if (n == sizeof(magic) && std::memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0)
+            {
+                std::unique_lock<std::mutex> lock(writeMutex);
+                if (shard.sharded())
+                {
+                    std::cerr << path << ": a snapshot is written after sharding; load it without --shard\n";
+                    return false;
+                }
+                lock.unlock();
+                return loadSnapshot(path);
+            }
+        }
+
+        auto s = std::make_unique<Snapshot>();
+        AssetFileReader reader(*s->strings, s->assets);
+        if (!reader.read(path))
+        {
+            std::cerr << "Cannot read " << path << "\n";
+            return false;
+        }
+        if (reader.skipped)
+            std::cerr << path << ": skipped " << reader.skipped << " of " << reader.rows << " rows\n";
+        std::lock_guard<std::mutex> lock(writeMutex);
+        buildUniverse(std::move(s));
+        return true;
+    }
+
+    // writes the current universe, index included, in the layout loadSnapshot() maps back
+    bool saveSnapshot(const std::string &path) const
+    {
+        Reader s(*this);
+        std::vector<SnapshotRecord> records(s->assets.size());
+        std::string blob;
+        for (size_t i = 0; i < s->assets.size(); i++)
+        {
+            const Asset &a = s->assets[i];
+            SnapshotRecord &r = records[i];
+            std::string_view fields[5] = {a.name, a.symbol, a.category, a.type, a.json};
+            for (int f = 0; f < 5; f++)
+            {
+                r.offsets[f] = static_cast<uint32_t>(blob.size());
+                r.lengths[f] = static_cast<uint32_t>(fields[f].size());
+                blob.append(fields[f]);
+            }
+            r.price = a.price;
+            r.change = a.change;
+            r.rank = a.rank;
+            r.marketCap = a.marketCap;
+            r.score = a.score;
+            r.reserved = 0;
+        }
+        if (blob.size() > UINT32_MAX)
+            return false;
+
+        std::FILE *f = std::fopen(path.c_str(), "wb");
+        if (!f)
+            return false;
+        BinaryWriter w(f);
+        w.bytes(kSnapshotMagic, sizeof(kSnapshotMagic));
+        w.value<uint32_t>(kSnapshotVersion);
+        w.value<uint32_t>(sizeof(SnapshotRecord));
+        w.array(records.data(), records.size());
+        w.array(blob.data(), blob.size());
+        s->trie.save(w, s->assets.data());
+        bool ok = w.good();
+        return std::fclose(f) == 0 && ok;
+    }
+
+    uint64_t dataGeneration() const { return generation.load(std::memory_order_acquire); }
+
+    // blocks until the data generation is no longer seen, deadline passes or running is
+    // cleared (and wakeDataWaiters() called); returns the generation then
+    uint64_t waitForData(uint64_t seen, std::chrono::steady_clock::time_point deadline, const std::atomic<bool> &running)
+    {
+        std::unique_lock<std::mutex> lock(changeMutex);
+        dataChanged.wait_until(lock, deadline, [&]
+                               { return dataGeneration() != seen || !running.load(std::memory_order_acquire); });
+        return dataGeneration();
+    }
+
+    void wakeDataWaiters()
+    {
+        std::lock_guard<std::mutex> lock(changeMutex);
+        dataChanged.notify_all();
+    }
+    ResponseCache &responses() { return cache; }
+
+    // keeps only the assets spec assigns to this process, in the current universe and in
+    // every one loaded later
+    void setShard(const ShardSpec &spec)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        shard = spec;
+        const Snapshot &cur = *current.load();
+        auto s = std::make_unique<Snapshot>();
+        s->strings = cur.strings;
+        s->assets.reserve(cur.assets.size());
+        for (Asset a : cur.assets)
+        {
+            a.trend = 0;
+            s->assets.push_back(a);
+        }
+        buildUniverse(std::move(s));
+    }
+
+    // drops the ticks for symbols this process does not hold
+    void dropForeignTicks(std::vector<Tick> &ticks) const
+    {
+        Reader s(*this);
+        ticks.erase(std::remove_if(ticks.begin(), ticks.end(), [&](const Tick &t) { return symbolRow(*s, t.symbol) < 0; }),
+                    ticks.end());
+    }
+
+    // false for a type no asset has
+    bool knownType(const std::string &type) const
+    {
+        Reader s(*this);
+        return typeFilter(*s, type) != -2;
+    }
+
+    bool knownSymbol(const std::string &symbol) const
+    {
+        Reader s(*this);
+        return symbolRow(*s, symbol) >= 0;
+    }
+
+    // appends symbol's JSON fragment; false for an unknown symbol
+    bool assetJSON(const std::string &symbol, std::string &out) const
+    {
+        Reader s(*this);
+        long row = symbolRow(*s, symbol);
+        if (row < 0)
+            return false;
+        out += s->assets[static_cast<size_t>(row)].json;
+        return true;
+    }
+
+    // appends the symbols getRecommendationsJSON returns for type without a user, in order
+    // and comma-separated: what tells a change of the top list from a change of its prices
+    void recommendedSymbols(const std::string &type, std::string &out) const
+    {
+        static thread_local std::vector<uint32_t> best;
+        Reader s(*this);
+        int typeId = typeFilter(*s, type);
+        best.clear();
+        if (typeId != -2)
+            kernels::topByRank(s->columns, s->assets.size(), typeId, kRecommendations, best);
+        for (size_t i = 0; i < best.size(); i++)
+        {
+            if (i > 0)
+                out += ',';
+            out += s->assets[best[i]].symbol;
+        }
+    }
+
+    // the *JSON methods append to out; worker threads keep their scratch between calls
+    // partial: a shard's answer for the router, see appendPartial()
+    void searchJSON(const std::string &query, const std::string &type, bool fuzzy, std::string &out,
+                    bool partial = false) const
+    {
+        static thread_local std::vector<Asset *> unique;
+        static thread_local std::vector<uint32_t> typos;
+        static thread_local std::vector<double> keys;
+        Reader s(*this);
+        int typeId = typeFilter(*s, type);
+        // an empty query ranks from the root, i.e. the whole universe
+        if (fuzzy)
+            s->trie.fuzzyTop(query, Trie::typoBudget(query.size()), kSearchResults, typeId, unique, &typos);
+        else
+            s->trie.top(query, kSearchResults, typeId, unique);
+        if (!partial)
+        {
+            appendArray(out, unique, unique.size());
+            return;
+        }
+        keys.clear();
+        for (const Asset *a : unique)
+            keys.push_back(a->rank);
+        appendPartial(*s, out, unique, keys, fuzzy ? &typos : nullptr);
+    }
+
+    // false for an empty or overlong user, too many weights, or a category the current
+    // universe does not have (unless anyCategory: a shard takes the categories of the
+    // others too, which the router has checked)
+    bool validProfile(const std::string &user, const std::pmr::vector<std::pair<std::string_view, float>> &weights,
+                      bool anyCategory = false) const
+    {
+        if (user.empty() || user.size() > kMaxUserLength || weights.size() > ProfileStore::kMaxWeights)
+            return false;
+        if (anyCategory)
+            return true;
+        Reader s(*this);
+        for (auto &w : weights)
+            if (s->categories.find(std::string(w.first)) < 0)
+                return false;
+        return true;
+    }
+
+    // replaces user's category weights; false, storing nothing, unless validProfile()
+    bool setProfile(const std::string &user, const std::pmr::vector<std::pair<std::string_view, float>> &weights,
+                    bool anyCategory = false)
+    {
+        if (!validProfile(user, weights, anyCategory))
+            return false;
+        ProfileStore::Profile p;
+        for (auto &w : weights)
+        {
+            int id = profiles.categoryId(w.first);
+            if (id < 0)
+                return false;
+            p.categories[p.count] = static_cast<uint8_t>(id);
+            p.weights[p.count++] = w.second;
+        }
+        profiles.set(user, p);
+        return true;
+    }
+
+    size_t profileCount() const { return profiles.size(); }
+
+    // {"user":...,"weights":{category:weight,...}}; false, with an error, for an unknown user
+    bool profileJSON(const std::string &user, std::string &out) const
+    {
+        size_t start = out.size();
+        out += "{\"user\":";
+        appendString(out, user);
+        out += ",\"weights\":{";
+        bool known = profiles.read(user, [&](const ProfileStore::Profile &p)
+                                   {
+                                       for (size_t j = 0; j < p.count; j++)
+                                       {
+                                           if (j > 0)
+                                               out += ',';
+                                           appendString(out, profiles.categoryName(p.categories[j]));
+                                           out += ':';
+                                           appendNumber(out, static_cast<double>(p.weights[j]));
+                                       }
+                                   });
+        if (!known)
+        {
+            out.resize(start);
+            out += "{\"error\":\"Unknown user\"}";
+            return false;
+        }
+        out += "}}";
+        return true;
+    }
+
+    // top 5 by the shared rank, or by personal rank (base rank plus the user's category
+    // weights) when user has a profile; the fragments keep the shared score either way.
+    // False, with an empty list, for a type the data does not have.
+    bool getRecommendationsJSON(const std::string &type, const std::string &user, std::string &out,
+                                bool partial = false) const
+    {
+        static thread_local std::vector<uint32_t> best;
+        static thread_local std::vector<double> bonus, keys;
+        static thread_local std::vector<const Asset *> picks;
+        Reader s(*this);
+        const AssetColumns &c = s->columns;
+        int typeId = typeFilter(*s, type);
+        bool personal = !user.empty() && profileBonus(*s, user, bonus);
+        if (typeId == -2)
+            best.clear();
+        else if (personal)
+            personalTop(*s, bonus, typeId, kRecommendations, best);
+        else
+            kernels::topByRank(c, s->assets.size(), typeId, kRecommendations, best);
+        picks.clear();
+        keys.clear();
+        for (uint32_t i : best)
+        {
+            picks.push_back(&s->assets[i]);
+            keys.push_back(personal ? personalRank(c, i, bonus) : c.rank[i]);
+        }
+        if (partial)
+            appendPartial(*s, out, picks, keys, nullptr);
+        else
+            appendArray(out, picks, picks.size());
+        return typeId != -2;
+    }
+
+    // {"window":...,"bars":...,"gainers":[...],"losers":[...]}: the assets that moved most
+    // up and down over a PriceStats window (default 1h), read off the momentum columns.
+    // False for an unknown window (an error instead) or type (empty lists).
+    bool moversJSON(const std::string &window, const std::string &type, std::string &out) const
+    {
+        static thread_local std::vector<uint32_t> gainers, losers;
+        int w = PriceStats::window(window.empty() ? "1h" : window);
+        if (w < 0)
+        {
+            out += "{\"error\":\"Unknown window\"}";
+            return false;
+        }
+        Reader s(*this);
+        const AssetColumns &c = s->columns;
+        const size_t n = s->assets.size();
+        int typeId = typeFilter(*s, type);
+        gainers.clear();
+        losers.clear();
+        if (typeId != -2)
+        {
+            kernels::topBy(c.momentum[w].data(), 1, 0, c.typeId.data(), n, typeId, kMovers, gainers);
+            kernels::topBy(c.momentum[w].data(), -1, 0, c.typeId.data(), n, typeId, kMovers, losers);
+        }
+        out += "{\"window\":";
+        appendString(out, PriceStats::kWindowNames[w]);
+        out += ",\"bars\":";
+        appendNumber(out, static_cast<long long>(s->stats->bars));
+        out += ",\"gainers\":";
+        appendMovers(*s, w, gainers, out);
+        out += ",\"losers\":";
+        appendMovers(*s, w, losers, out);
+        out += '}';
+        return typeId != -2;
+    }
+
+    // {"symbol":...,"results":[...]}: the k (at most SimilarityIndex::kNeighbors) assets most
+    // similar to symbol's, best first, each with its "similarity"; read off the linked
+    // neighbours, or found by a scan while they are not linked; false for an unknown symbol
+    bool similarJSON(const std::string &symbol, size_t k, std::string &out) const
+    {
+        static thread_local kernels::SimilarBest best;
+        Reader s(*this);
+        long found = symbolRow(*s, symbol);
+        if (found < 0)
+        {
+            out += "{\"error\":\"Unknown symbol\"}";
+            return false;
+        }
+        const uint32_t row = static_cast<uint32_t>(found);
+        const SimilarityIndex &x = *s->similar;
+        const uint32_t *rows = best.rows;
+        const float *scores = best.scores;
+        size_t count;
+        if (x.linked)
+        {
+            rows = x.neighbors.data() + row * x.width;
+            scores = x.scores.data() + row * x.width;
+            count = std::min(k, x.width);
+        }
+        else
+        {
+            kernels::similarTo(x, row, k, best);
+            count = best.size;
+        }
+        out += "{\"symbol\":";
+        appendString(out, s->assets[row].symbol);
+        out += ",\"results\":[";
+        for (size_t j = 0; j < count; j++)
+        {
+            const Asset &a = s->assets[rows[j]];
+            if (j > 0)
+                out += ',';
+            out.append(a.json.data(), a.json.size() - 1);
+            out += ",\"similarity\":";
+            appendNumber(out, std::round(scores[j] * 1e4) / 1e4);
+            out += '}';
+        }
+        out += "]}";
+        return true;
+    }
+
+    // {"plan":...,"examined":...,"results":[...]} for q. The planner either walks the sort
+    // field's index in order and stops at q.limit matches, or takes the smallest candidate
+    // list (a field range, the category's or the type's rows), filters it and keeps the
+    // best q.limit; it picks whichever should examine fewer rows, assuming independent
+    // filters. Every candidate is checked against every filter on the columns.
+    void queryJSON(const AssetQuery &q, std::string &out) const
+    {
+        static thread_local std::vector<uint32_t> matches;
+        static thread_local std::vector<const Asset *> picks;
+        Reader s(*this);
+        const AssetColumns &c = s->columns;
+        const size_t n = s->assets.size();
+        const double *column[AssetQuery::FieldCount];
+        for (int f = 0; f < AssetQuery::FieldCount; f++)
+            column[f] = AssetQuery::column(c, f);
+
+        // candidate lists: each field's rows within its range, then category, then type
+        struct Candidates
+        {
+            const uint32_t *rows;
+            size_t size;
+        } lists[AssetQuery::FieldCount + 2];
+        for (int f = 0; f < AssetQuery::FieldCount; f++)
+        {
+            const std::vector<double> &keys = s->keys[f];
+            size_t from = std::lower_bound(keys.begin(), keys.end(), q.low[f]) - keys.begin();
+            size_t to = std::upper_bound(keys.begin() + static_cast<std::ptrdiff_t>(from), keys.end(), q.high[f]) - keys.begin();
+            lists[f] = {s->sorted[f].data() + from, to > from ? to - from : 0};
+        }
+        auto postings = [&](const std::string &name, const Interner &names, const std::vector<std::vector<uint32_t>> &lists) -> Candidates
+        {
+            if (name.empty())
+                return {nullptr, n};
+            int id = names.find(name);
+            if (id < 0 || static_cast<size_t>(id) >= lists.size())
+                return {nullptr, 0};
+            return {lists[id].data(), lists[id].size()};
+        };
+        const int kCategory = AssetQuery::FieldCount, kType = AssetQuery::FieldCount + 1;
+        lists[kCategory] = postings(q.category, s->categories, s->byCategory);
+        lists[kType] = postings(q.type, s->types, s->byType);
+        // -1 for any, -2 for a name no asset has
+        auto idOf = [](const std::string &name, const Interner &names) { return name.empty() ? -1 : std::max(names.find(name), -2); };
+        const int categoryId = idOf(q.category, s->categories), typeId = idOf(q.type, s->types);
+
+        auto matchesAll = [&](uint32_t i)
+        {
+            for (int f = 0; f < AssetQuery::FieldCount; f++)
+                if (q.bounded(f) && !(column[f][i] >= q.low[f] && column[f][i] <= q.high[f]))
+                    return false;
+            return (categoryId == -1 || c.categoryId[i] == categoryId) && (typeId == -1 || c.typeId[i] == typeId);
+        };
+        auto filtered = [&](int l) { return l < AssetQuery::FieldCount ? q.bounded(l) : !(l == kCategory ? q.category : q.type).empty(); };
+
+        // rows an ordered walk should examine: limit over the share of rows the other
+        // filters let through, at most the sort range
+        const int sortField = q.sort;
+        double share = 1;
+        int driver = -1;
+        for (int l = 0; l < AssetQuery::FieldCount + 2; l++)
+        {
+            if (!filtered(l))
+                continue;
+            if (l != sortField)
+                share *= n ? static_cast<double>(lists[l].size) / static_cast<double>(n) : 0;
+            if (l != sortField && (driver < 0 || lists[l].size < lists[driver].size))
+                driver = l;
+        }
+        double walkCost = share > 0 ? std::min(static_cast<double>(lists[sortField].size), static_cast<double>(q.limit) / share)
+                                    : static_cast<double>(lists[sortField].size);
+        bool walk = driver < 0 || walkCost <= static_cast<double>(lists[driver].size);
+
+        matches.clear();
+        size_t examined = 0;
+        const Candidates &range = lists[sortField];
+        if (walk)
+        {
+            // ascending from the bottom of the range or descending from its top; ties come
+            // out by index the same way the other plan orders them
+            for (size_t j = 0; j < range.size && matches.size() < q.limit; j++)
+            {
+                uint32_t i = range.rows[q.ascending ? j : range.size - 1 - j];
+                examined++;
+                if (matchesAll(i))
+                    matches.push_back(i);
+            }
+        }
+        else
+        {
+            const Candidates &from = lists[driver];
+            examined = from.size;
+            for (size_t j = 0; j < from.size; j++)
+                if (matchesAll(from.rows[j]))
+                    matches.push_back(from.rows[j]);
+            const double *key = column[sortField];
+            auto before = [&](uint32_t a, uint32_t b)
+            {
+                auto ka = std::make_pair(indexKey(key[a]), a), kb = std::make_pair(indexKey(key[b]), b);
+                return q.ascending ? ka < kb : kb < ka;
+            };
+            size_t keep = std::min(matches.size(), q.limit);
+            std::partial_sort(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(keep), matches.end(), before);
+            matches.resize(keep);
+        }
+
+        out += "{\"plan\":\"";
+        if (walk)
+        {
+            out += AssetQuery::kFieldNames[sortField];
+            out += " order";
+        }
+        else if (driver < AssetQuery::FieldCount)
+        {
+            out += AssetQuery::kFieldNames[driver];
+            out += " range";
+        }
+        else
+            out += driver == kCategory ? "category" : "type";
+        out += "\",\"examined\":";
+        appendNumber(out, static_cast<long long>(examined));
+        out += ",\"results\":";
+        picks.clear();
+        for (uint32_t i : matches)
+            picks.push_back(&s->assets[i]);
+        appendArray(out, picks, picks.size());
+        out += '}';
+    }
+
+    // partial: the sums behind the averages instead, for the router to add up
+    void getStatsJSON(std::string &out, bool partial = false) const
+    {
+        Reader s(*this);
+        const std::vector<Asset> &assets = s->assets;
+        const AssetColumns &c = s->columns;
+        double totalCap = kernels::sum(c.marketCap.data(), assets.size());
+        double rankSum = kernels::sum(c.rank.data(), assets.size());
+        // ids are >= 0, so a type no asset has (-1) counts nothing
+        size_t cryptoCount = kernels::countEqual(c.typeId.data(), assets.size(), s->types.find("crypto"));
+        size_t stockCount = kernels::countEqual(c.typeId.data(), assets.size(), s->types.find("stock"));
+        if (partial)
+        {
+            out += "{\"total\":";
+            appendNumber(out, static_cast<long long>(assets.size()));
+            out += ",\"cryptos\":";
+            appendNumber(out, static_cast<long long>(cryptoCount));
+            out += ",\"stocks\":";
+            appendNumber(out, static_cast<long long>(stockCount));
+            out += ",\"rankSum\":";
+            appendNumber(out, rankSum);
+            out += ",\"capSum\":";
+            appendNumber(out, totalCap);
+            out += '}';
+            return;
+        }
+        appendStats(out, assets.size(), cryptoCount, stockCount, rankSum, totalCap);
+    }
+
+    // the /api/stats object from its counts and sums
+    static void appendStats(std::string &out, size_t total, size_t cryptoCount, size_t stockCount, double rankSum,
+                            double totalCap)
+    {
+        double avgScore = total > 0 ? rankSum / static_cast<double>(total) : 0;
+        out += "{\"total\":";
+        appendNumber(out, static_cast<long long>(total));
+        out += ",\"cryptos\":";
+        appendNumber(out, static_cast<long long>(cryptoCount));
+        out += ",\"stocks\":";
+        appendNumber(out, static_cast<long long>(stockCount));
+        out += ",\"avgScore\":";
+        appendNumber(out, static_cast<long long>(avgScore));
+        out += ",\"totalCap\":";
+        appendNumber(out, totalCap / 1e12);
+        out += '}';
+    }
+};
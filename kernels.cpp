@@ -0,0 +1,371 @@
+#include "kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+namespace kernels
+{
+const char *variant()
+{
+#if defined(SIMD_AVX2)
+    return "avx2";
+#elif defined(SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static int bitCount(unsigned m)
+{
+    int c = 0;
+    for (; m; m &= m - 1)
+        c++;
+    return c;
+}
+
+double sum(const double *v, size_t n)
+{
+    size_t i = 0;
+    double total = 0;
+#if defined(SIMD_AVX2)
+    __m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8)
+    {
+        a = _mm256_add_pd(a, _mm256_loadu_pd(v + i));
+        b = _mm256_add_pd(b, _mm256_loadu_pd(v + i + 4));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(a, b));
+    total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(SIMD_SSE2)
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd(), c = _mm_setzero_pd(), d = _mm_setzero_pd();
+    for (; i + 8 <= n; i += 8)
+    {
+        a = _mm_add_pd(a, _mm_loadu_pd(v + i));
+        b = _mm_add_pd(b, _mm_loadu_pd(v + i + 2));
+        c = _mm_add_pd(c, _mm_loadu_pd(v + i + 4));
+        d = _mm_add_pd(d, _mm_loadu_pd(v + i + 6));
+    }
+    alignas(16) double low[2], high[2];
+    _mm_store_pd(low, _mm_add_pd(a, c));
+    _mm_store_pd(high, _mm_add_pd(b, d));
+    total = (low[0] + low[1]) + (high[0] + high[1]);
+#else
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0, s5 = 0, s6 = 0, s7 = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 += v[i];
+        s1 += v[i + 1];
+        s2 += v[i + 2];
+        s3 += v[i + 3];
+        s4 += v[i + 4];
+        s5 += v[i + 5];
+        s6 += v[i + 6];
+        s7 += v[i + 7];
+    }
+    total = ((s0 + s4) + (s1 + s5)) + ((s2 + s6) + (s3 + s7));
+#endif
+    for (; i < n; i++)
+        total += v[i];
+    return total;
+}
+
+size_t countEqual(const int32_t *v, size_t n, int32_t value)
+{
+    size_t i = 0, count = 0;
+#if defined(SIMD_AVX2)
+    __m256i want = _mm256_set1_epi32(value);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(v + i)), want);
+        count += static_cast<size_t>(bitCount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)))));
+    }
+#elif defined(SIMD_SSE2)
+    __m128i want = _mm_set1_epi32(value);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i)), want);
+        count += static_cast<size_t>(bitCount(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq)))));
+    }
+#endif
+    for (; i < n; i++)
+        count += v[i] == value;
+    return count;
+}
+
+void ranks(const AssetColumns &c, const double *bonus, size_t n, double *out)
+{
+    size_t i = 0;
+#if defined(SIMD_AVX2)
+    const __m256d big = _mm256_set1_pd(50000000000.0), ten = _mm256_set1_pd(10), cap = _mm256_set1_pd(100);
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i cat = _mm_loadu_si128(reinterpret_cast<const __m128i *>(c.categoryId.data() + i));
+        __m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_loadu_pd(c.score.data() + i), _mm256_loadu_pd(c.trend.data() + i)),
+                                  _mm256_mask_i32gather_pd(_mm256_setzero_pd(), bonus, cat, all, 8));
+        __m256d isBig = _mm256_cmp_pd(_mm256_loadu_pd(c.marketCap.data() + i), big, _CMP_GT_OQ);
+        s = _mm256_add_pd(s, _mm256_and_pd(isBig, ten));
+        _mm256_storeu_pd(out + i, _mm256_min_pd(s, cap));
+    }
+#elif defined(SIMD_SSE2)
+    const __m128d big = _mm_set1_pd(50000000000.0), ten = _mm_set1_pd(10), cap = _mm_set1_pd(100);
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d b = _mm_set_pd(bonus[c.categoryId[i + 1]], bonus[c.categoryId[i]]);
+        __m128d s = _mm_add_pd(_mm_add_pd(_mm_loadu_pd(c.score.data() + i), _mm_loadu_pd(c.trend.data() + i)), b);
+        __m128d isBig = _mm_cmpgt_pd(_mm_loadu_pd(c.marketCap.data() + i), big);
+        s = _mm_add_pd(s, _mm_and_pd(isBig, ten));
+        _mm_storeu_pd(out + i, _mm_min_pd(s, cap));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        double s = c.score[i] + c.trend[i] + bonus[c.categoryId[i]];
+        if (c.marketCap[i] > 50000000000.0)
+            s += 10;
+        out[i] = std::min(100.0, s);
+    }
+}
+
+void topBy(const double *key, double sign, double floor, const int32_t *typeId, size_t n, int type, size_t k,
+           std::vector<uint32_t> &out)
+{
+    out.clear();
+    if (k == 0)
+        return;
+    double threshold = floor;
+    auto offer = [&](size_t i)
+    {
+        if (type >= 0 && typeId[i] != type)
+            return;
+        double v = sign * key[i];
+        if (!(v > threshold))
+            return;
+        auto at = std::upper_bound(out.begin(), out.end(), v, [&](double x, uint32_t j)
+                                   { return x > sign * key[j]; });
+        out.insert(at, static_cast<uint32_t>(i));
+        if (out.size() > k)
+            out.pop_back();
+        if (out.size() == k)
+            threshold = sign * key[out.back()];
+    };
+
+    size_t i = 0;
+#if defined(SIMD_AVX2)
+    const __m128i want = _mm_set1_epi32(type);
+    const __m256d signs = _mm256_set1_pd(sign);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(key + i), signs);
+        __m256d better = _mm256_cmp_pd(v, _mm256_set1_pd(threshold), _CMP_GT_OQ);
+        if (type >= 0)
+        {
+            __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(typeId + i)), want);
+            better = _mm256_and_pd(better, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(eq)));
+        }
+        for (unsigned m = static_cast<unsigned>(_mm256_movemask_pd(better)); m; m &= m - 1)
+            offer(i + static_cast<size_t>(bitCount((m & (0u - m)) - 1)));
+    }
+#elif defined(SIMD_SSE2)
+    const __m128i want = _mm_set1_epi32(type);
+    const __m128d signs = _mm_set1_pd(sign);
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d v = _mm_mul_pd(_mm_loadu_pd(key + i), signs);
+        __m128d better = _mm_cmpgt_pd(v, _mm_set1_pd(threshold));
+        if (type >= 0)
+        {
+            __m128i ids = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(typeId + i));
+            __m128i eq = _mm_cmpeq_epi32(_mm_unpacklo_epi32(ids, ids), want);
+            better = _mm_and_pd(better, _mm_castsi128_pd(eq));
+        }
+        for (unsigned m = static_cast<unsigned>(_mm_movemask_pd(better)); m; m &= m - 1)
+            offer(i + static_cast<size_t>(bitCount((m & (0u - m)) - 1)));
+    }
+#endif
+    for (; i < n; i++)
+        offer(i);
+}
+
+void topByRank(const AssetColumns &c, size_t n, int type, size_t k, std::vector<uint32_t> &out)
+{
+    topBy(c.rank.data(), 1, -std::numeric_limits<double>::infinity(), c.typeId.data(), n, type, k, out);
+}
+
+// feature columns one tile spans: 16 dims of 512 floats, 32 KiB, stay cached while every
+// query block of a thread passes over them
+static constexpr size_t kSimilarTile = 512;
+
+// row i's features, gathered from their dims into one vector
+static void featureRow(const SimilarityIndex &x, size_t i, float *out)
+{
+    for (size_t d = 0; d < SimilarityIndex::kDims; d++)
+        out[d] = x.features[d * x.stride + i];
+}
+
+// scores query rows q[0..count) (count <= 4; the kernel always computes 4), whose
+// featureRow()s are vectors[r * kDims...], against rows [from, to) of x and offers each
+// other row to best[r] with k places. A score is the sum over dims in order, then the
+// category weight, in every variant.
+static void similarityTile(const SimilarityIndex &x, const uint32_t *q, const float *vectors, size_t count, size_t from,
+                           size_t to, size_t k, SimilarBest *best)
+{
+    constexpr size_t kDims = SimilarityIndex::kDims;
+    const float *f = x.features.data();
+    const int32_t *category = x.categoryId.data();
+    const size_t stride = x.stride, n = x.n;
+    uint32_t rows[4];
+    float qv[4][kDims];
+    for (size_t r = 0; r < 4; r++)
+    {
+        rows[r] = q[std::min(r, count - 1)];
+        std::copy(vectors + std::min(r, count - 1) * kDims, vectors + (std::min(r, count - 1) + 1) * kDims, qv[r]);
+    }
+    auto offer = [&](size_t r, size_t j, float score)
+    {
+        if (j < n && j != rows[r])
+            best[r].offer(static_cast<uint32_t>(j), score, k);
+    };
+
+    size_t j = from;
+#if defined(SIMD_AVX2)
+    const __m256 weight = _mm256_set1_ps(SimilarityIndex::kCategoryWeight);
+    for (; j + 8 <= to; j += 8)
+    {
+        // named accumulators stay in registers; an indexed array of them need not
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        for (size_t d = 0; d < kDims; d++)
+        {
+            __m256 v = _mm256_loadu_ps(f + d * stride + j);
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_set1_ps(qv[0][d]), v));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_set1_ps(qv[1][d]), v));
+            a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_set1_ps(qv[2][d]), v));
+            a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_set1_ps(qv[3][d]), v));
+        }
+        const __m256 acc[4] = {a0, a1, a2, a3};
+        __m256i cat = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(category + j));
+        for (size_t r = 0; r < count; r++)
+        {
+            __m256 same = _mm256_castsi256_ps(_mm256_cmpeq_epi32(cat, _mm256_set1_epi32(category[rows[r]])));
+            __m256 score = _mm256_add_ps(acc[r], _mm256_and_ps(same, weight));
+            unsigned m = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(score, _mm256_set1_ps(best[r].threshold), _CMP_GT_OQ)));
+            if (!m)
+                continue;
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, score);
+            for (; m; m &= m - 1)
+            {
+                int lane = bitCount((m & (0u - m)) - 1);
+                // an earlier lane may have raised the bar
+                if (lanes[lane] > best[r].threshold)
+                    offer(r, j + static_cast<size_t>(lane), lanes[lane]);
+            }
+        }
+    }
+#elif defined(SIMD_SSE2)
+    const __m128 weight = _mm_set1_ps(SimilarityIndex::kCategoryWeight);
+    for (; j + 4 <= to; j += 4)
+    {
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        for (size_t d = 0; d < kDims; d++)
+        {
+            __m128 v = _mm_loadu_ps(f + d * stride + j);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_set1_ps(qv[0][d]), v));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_set1_ps(qv[1][d]), v));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_set1_ps(qv[2][d]), v));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_set1_ps(qv[3][d]), v));
+        }
+        const __m128 acc[4] = {a0, a1, a2, a3};
+        __m128i cat = _mm_loadu_si128(reinterpret_cast<const __m128i *>(category + j));
+        for (size_t r = 0; r < count; r++)
+        {
+            __m128 same = _mm_castsi128_ps(_mm_cmpeq_epi32(cat, _mm_set1_epi32(category[rows[r]])));
+            __m128 score = _mm_add_ps(acc[r], _mm_and_ps(same, weight));
+            unsigned m = static_cast<unsigned>(_mm_movemask_ps(_mm_cmpgt_ps(score, _mm_set1_ps(best[r].threshold))));
+            if (!m)
+                continue;
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, score);
+            for (; m; m &= m - 1)
+            {
+                int lane = bitCount((m & (0u - m)) - 1);
+                if (lanes[lane] > best[r].threshold)
+                    offer(r, j + static_cast<size_t>(lane), lanes[lane]);
+            }
+        }
+    }
+#endif
+    for (; j < to; j++)
+        for (size_t r = 0; r < count; r++)
+        {
+            float score = 0;
+            for (size_t d = 0; d < kDims; d++)
+                score += qv[r][d] * f[d * stride + j];
+            if (category[j] == category[rows[r]])
+                score += SimilarityIndex::kCategoryWeight;
+            if (score > best[r].threshold)
+                offer(r, j, score);
+        }
+}
+
+void similarTo(const SimilarityIndex &x, uint32_t row, size_t k, SimilarBest &best)
+{
+    best = SimilarBest();
+    k = std::min({k, SimilarityIndex::kNeighbors, x.n > 0 ? x.n - 1 : 0});
+    if (k == 0)
+        return;
+    float vector[SimilarityIndex::kDims];
+    featureRow(x, row, vector);
+    for (size_t from = 0; from < x.stride; from += kSimilarTile)
+        similarityTile(x, &row, vector, 1, from, std::min(from + kSimilarTile, x.stride), k, &best);
+}
+
+void similarNeighbors(SimilarityIndex &x, unsigned threads)
+{
+    const size_t n = x.n, k = std::min(SimilarityIndex::kNeighbors, n > 0 ? n - 1 : 0);
+    x.width = k;
+    x.neighbors.assign(n * k, 0);
+    x.scores.assign(n * k, 0.0f);
+    x.linked = true;
+    if (k == 0)
+        return;
+    auto work = [&](size_t rowFrom, size_t rowTo)
+    {
+        constexpr size_t kDims = SimilarityIndex::kDims;
+        std::vector<SimilarBest> best(rowTo - rowFrom);
+        std::vector<uint32_t> rows(rowTo - rowFrom);
+        // the query vectors contiguous, rather than 16 strided loads per row per tile
+        std::vector<float> vectors(rows.size() * kDims);
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+            rows[r] = static_cast<uint32_t>(rowFrom + r);
+            featureRow(x, rowFrom + r, vectors.data() + r * kDims);
+        }
+        for (size_t from = 0; from < x.stride; from += kSimilarTile)
+            for (size_t r = 0; r < rows.size(); r += 4)
+                similarityTile(x, rows.data() + r, vectors.data() + r * kDims, std::min<size_t>(4, rows.size() - r), from,
+                               std::min(from + kSimilarTile, x.stride), k, best.data() + r);
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+            std::copy(best[r].rows, best[r].rows + k, x.neighbors.begin() + static_cast<std::ptrdiff_t>((rowFrom + r) * k));
+            std::copy(best[r].scores, best[r].scores + k, x.scores.begin() + static_cast<std::ptrdiff_t>((rowFrom + r) * k));
+        }
+    };
+    // no more threads than 1024-row slices
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, (n + 1023) / 1024)));
+    size_t slice = (n + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(work, std::min(n, t * slice), std::min(n, (t + 1) * slice));
+    work(0, std::min(n, slice));
+    for (auto &t : pool)
+        t.join();
+}
+} // namespace kernels
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "prices.h"
+
+// The fields full-universe scans read, one contiguous array each and index-aligned with
+// a snapshot's assets, so a pass streams 8-byte values instead of whole Asset records.
+struct AssetColumns
+{
+    std::vector<double> price, change, marketCap, score, trend, rank;
+    std::vector<int32_t> typeId, categoryId;
+    // per PriceStats window, the price's move from the window's base; NaN without one
+    std::vector<double> momentum[PriceStats::kWindows];
+
+    void resize(size_t n)
+    {
+        for (auto *c : {&price, &change, &marketCap, &score, &trend, &rank})
+            c->resize(n);
+        typeId.resize(n);
+        categoryId.resize(n);
+        for (auto &m : momentum)
+            m.resize(n, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    void set(size_t i, const Asset &a)
+    {
+        price[i] = a.price;
+        change[i] = a.change;
+        marketCap[i] = static_cast<double>(a.marketCap);
+        score[i] = a.score;
+        trend[i] = a.trend;
+        rank[i] = a.rank;
+        typeId[i] = a.typeId;
+        categoryId[i] = a.categoryId;
+    }
+};
+
+// What /api/similar compares assets by: per asset kDims features, dims-major so a kernel
+// streams one dimension of consecutive assets at a time, and its category. The first
+// kSteps are its last log returns over kStepBars bars each, centred and scaled to unit
+// length so that two assets' dot product is the correlation of their returns (0 for a
+// flat price or too little history); the next two put the decade of its market cap on a
+// quarter circle, so their dot product is kCapWeight for equal caps and falls to 0 seven
+// decades apart. Matching categories add kCategoryWeight. Once linked, it also holds
+// every asset's best-scoring others. Immutable once published.
+struct SimilarityIndex
+{
+    static constexpr size_t kDims = 16;
+    static constexpr size_t kSteps = 12, kStepBars = 5;
+    static constexpr size_t kNeighbors = 20; // most a lookup returns
+    static constexpr float kCapWeight = 0.5f, kCategoryWeight = 0.5f;
+
+    size_t n = 0, stride = 0;        // stride is n rounded up to a multiple of 8
+    std::vector<float> features;     // features[d * stride + i], zero past n
+    std::vector<int32_t> categoryId; // stride long, -1 past n
+    bool linked = false;
+    size_t width = 0;                // neighbours per asset once linked: min(kNeighbors, n - 1)
+    std::vector<uint32_t> neighbors; // neighbors[i * width + j], best first, ties to the lower index
+    std::vector<float> scores;       // likewise
+};
+
+// Column kernels: AVX2 when the build targets it (-mavx2 / -march=native), SSE2 on any
+// other x86-64 build, plain loops elsewhere. All variants return identical results.
+namespace kernels
+{
+// the kernel set this build compiled in: "avx2", "sse2" or "scalar"
+const char *variant();
+
+// Every variant adds in the same order, so totals match to the bit: eight running sums,
+// sum j taking v[i + j] of each block of 8, folded as ((0+4)+(1+5)) + ((2+6)+(3+7)), then
+// the tail one by one.
+double sum(const double *v, size_t n);
+
+size_t countEqual(const int32_t *v, size_t n, int32_t value);
+
+// rank = min(100, score + trend + bonus[categoryId] + (marketCap > 50B ? 10 : 0)), calcScore's formula
+void ranks(const AssetColumns &c, const double *bonus, size_t n, double *out);
+
+// indices of the k rows with the largest sign * key above floor among rows whose typeId
+// is `type` (any row when type < 0), best first, ties to the lower index; NaN never
+// qualifies. Vector lanes only drop rows that cannot beat the current k-th best, so at
+// most a handful per block reach the scalar insert.
+void topBy(const double *key, double sign, double floor, const int32_t *typeId, size_t n, int type, size_t k,
+           std::vector<uint32_t> &out);
+
+// indices of the k best ranks among rows whose typeId is `type` (any row when type < 0),
+// best first, ties to the lower index
+void topByRank(const AssetColumns &c, size_t n, int type, size_t k, std::vector<uint32_t> &out);
+
+// the best k (score, row) offers, best first; an offer has to beat the k-th best, so among
+// equal scores the first offered stays ahead
+struct SimilarBest
+{
+    uint32_t rows[SimilarityIndex::kNeighbors];
+    float scores[SimilarityIndex::kNeighbors];
+    size_t size = 0;
+    float threshold = -std::numeric_limits<float>::infinity();
+
+    void offer(uint32_t row, float score, size_t k)
+    {
+        size_t at = size;
+        while (at > 0 && scores[at - 1] < score)
+            at--;
+        size_t last = std::min(size, k - 1);
+        for (size_t j = last; j > at; j--)
+        {
+            rows[j] = rows[j - 1];
+            scores[j] = scores[j - 1];
+        }
+        rows[at] = row;
+        scores[at] = score;
+        size = std::min(size + 1, k);
+        if (size == k)
+            threshold = scores[k - 1];
+    }
+};
+
+// the k rows most similar to row, best first
+void similarTo(const SimilarityIndex &x, uint32_t row, size_t k, SimilarBest &best);
+
+// links x: every row's x.width best others, blocked as column tiles by blocks of 4 query
+// rows and the rows split over up to `threads` threads
+void similarNeighbors(SimilarityIndex &x, unsigned threads);
+} // namespace kernels
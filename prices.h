@@ -0,0 +1,199 @@
+#pragma once
+
+#include "common.h"
+
+// one price update from the feed
+struct Tick
+{
+    std::string symbol;
+    double price = 0;
+    double change = std::numeric_limits<double>::quiet_NaN(); // NaN keeps the current change
+    long long marketCap = -1;                                  // < 0 scales the cap with the price
+};
+
+// Rolling statistics over one-minute closing prices, per window and asset, as of the last
+// closed bar. Immutable once published: snapshots share one until the next bar closes.
+struct PriceStats
+{
+    static constexpr int kWindows = 3;
+    static constexpr uint32_t kWindowBars[kWindows] = {5, 15, 60};
+    static constexpr const char *kWindowNames[kWindows] = {"5m", "15m", "1h"};
+
+    uint64_t bars = 0; // bars closed so far
+    // indexed by asset; NaN until the window's bars and the close before them are in
+    std::vector<double> base[kWindows];       // the close before the window, momentum's reference
+    std::vector<double> high[kWindows];       // highest close in the window
+    std::vector<double> sma[kWindows];        // mean close
+    std::vector<double> ema[kWindows];        // smoothed with 2 / (bars + 1) per bar
+    std::vector<double> volatility[kWindows]; // standard deviation of the one-bar log returns
+
+    // -1 for a name not in kWindowNames
+    static int window(std::string_view name)
+    {
+        for (int w = 0; w < kWindows; w++)
+            if (name == kWindowNames[w])
+                return w;
+        return -1;
+    }
+
+    // relative move from the window's base to price; price is rounded to a float like the
+    // closes, so one that has not changed is no move
+    double momentum(int w, size_t i, double price) const { return static_cast<float>(price) / base[w][i] - 1; }
+
+    // how far price sits below the window's high, counting price itself as a candidate
+    double drawdown(int w, size_t i, double price) const
+    {
+        double peak = high[w][i], p = static_cast<float>(price);
+        return peak != peak ? peak : 1 - p / std::max(peak, p);
+    }
+};
+
+// The writer's side of PriceStats: the last kBars closes and log returns of every asset,
+// bar-major so a closing bar writes one contiguous row, and per window the running sums
+// and a monotonic queue of candidate highs that move its statistics along in O(1) per
+// asset and bar (amortized for the queue) instead of rescanning the window.
+class PriceHistory
+{
+public:
+    // the longest window, the close before it and the one before that, whose return
+    // leaves the window next
+    static constexpr size_t kBars = 62;
+
+private:
+    static constexpr int kWindows = PriceStats::kWindows;
+
+    struct Window
+    {
+        uint32_t bars;
+        std::vector<double> closeSum, returnSum, returnSquares, ema;
+        // per asset a ring of `bars` bar numbers (low 8 bits) with falling closes, oldest first
+        std::vector<uint8_t> queue, queueHead, queueSize;
+    };
+
+    size_t n = 0;
+    uint64_t closed = 0;
+    std::vector<float> closes;  // closes[(bar % kBars) * n + i]
+    std::vector<float> returns; // likewise, the log return into the bar (0 for the first)
+    Window windows[kWindows];
+
+    float close(uint64_t bar, size_t i) const { return closes[(bar % kBars) * n + i]; }
+    const float *row(const std::vector<float> &ring, uint64_t bar) const { return ring.data() + (bar % kBars) * n; }
+
+    static double logReturn(float from, float to) { return from > 0 && to > 0 ? std::log(static_cast<double>(to) / from) : 0; }
+
+public:
+    // forgets everything; n assets from now on
+    void reset(size_t assets)
+    {
+        n = assets;
+        closed = 0;
+        closes.assign(kBars * n, 0.0f);
+        returns.assign(kBars * n, 0.0f);
+        for (int w = 0; w < kWindows; w++)
+        {
+            Window &win = windows[w];
+            win.bars = PriceStats::kWindowBars[w];
+            for (auto *v : {&win.closeSum, &win.returnSum, &win.returnSquares, &win.ema})
+                v->assign(n, 0.0);
+            win.queue.assign(n * win.bars, 0);
+            win.queueHead.assign(n, 0);
+            win.queueSize.assign(n, 0);
+        }
+    }
+
+    uint64_t barsClosed() const { return closed; }
+
+    // log return of asset i from the close of bar `from` to that of bar `to`; 0 unless both
+    // closes are still kept
+    double move(size_t i, uint64_t from, uint64_t to) const
+    {
+        return from <= to && to < closed && closed - from <= kBars ? logReturn(close(from, i), close(to, i)) : 0;
+    }
+
+    // closes the current bar at price[i] for every asset
+    void close(const std::vector<double> &price)
+    {
+        const uint64_t b = closed;
+        float *c = closes.data() + (b % kBars) * n;
+        float *r = returns.data() + (b % kBars) * n;
+        for (size_t i = 0; i < n; i++)
+            c[i] = static_cast<float>(price[i]);
+        if (b >= 1)
+        {
+            const float *before = row(closes, b - 1);
+            for (size_t i = 0; i < n; i++)
+                r[i] = static_cast<float>(logReturn(before[i], c[i]));
+        }
+        else
+            std::fill(r, r + n, 0.0f);
+        for (int w = 0; w < kWindows; w++)
+        {
+            Window &win = windows[w];
+            const uint32_t bars = win.bars;
+            const double alpha = 2.0 / (bars + 1);
+            // the close and return that leave the window; bar 0's return is 0 anyway
+            const float *oldClose = b >= bars ? row(closes, b - bars) : nullptr;
+            const float *oldReturn = b >= bars ? row(returns, b - bars) : nullptr;
+            for (size_t i = 0; i < n; i++)
+            {
+                const double x = c[i], ret = r[i];
+                win.closeSum[i] += x;
+                win.returnSum[i] += ret;
+                win.returnSquares[i] += ret * ret;
+                if (oldClose)
+                {
+                    const double old = oldReturn[i];
+                    win.closeSum[i] -= oldClose[i];
+                    win.returnSum[i] -= old;
+                    win.returnSquares[i] -= old * old;
+                }
+                win.ema[i] = b == 0 ? x : win.ema[i] + alpha * (x - win.ema[i]);
+
+                // drop queued bars whose close c beats, then the one that left the window
+                uint8_t *queue = win.queue.data() + i * bars;
+                uint8_t &head = win.queueHead[i], &size = win.queueSize[i];
+                auto slot = [&](uint32_t k) { return head + k < bars ? head + k : head + k - bars; };
+                auto barAt = [&](uint32_t k) { return b - static_cast<uint8_t>(b - queue[slot(k)]); };
+                while (size > 0 && close(barAt(size - 1u), i) <= c[i])
+                    size--;
+                if (size > 0 && barAt(0) + bars <= b)
+                {
+                    head = static_cast<uint8_t>(slot(1));
+                    size--;
+                }
+                queue[slot(size)] = static_cast<uint8_t>(b);
+                size++;
+            }
+        }
+        closed++;
+    }
+
+    // the statistics as of the last closed bar
+    std::shared_ptr<const PriceStats> stats() const
+    {
+        auto s = std::make_shared<PriceStats>();
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        s->bars = closed;
+        for (int w = 0; w < kWindows; w++)
+        {
+            const Window &win = windows[w];
+            const uint32_t bars = win.bars;
+            for (auto *v : {&s->base[w], &s->high[w], &s->sma[w], &s->ema[w], &s->volatility[w]})
+                v->assign(n, nan);
+            if (closed < bars + 1u)
+                continue;
+            const uint64_t last = closed - 1;
+            for (size_t i = 0; i < n; i++)
+            {
+                double mean = win.returnSum[i] / bars;
+                double variance = (win.returnSquares[i] - mean * win.returnSum[i]) / (bars - 1);
+                s->base[w][i] = close(last - bars, i);
+                s->high[w][i] = close(last - static_cast<uint8_t>(last - win.queue[i * bars + win.queueHead[i]]), i);
+                s->sma[w][i] = win.closeSum[i] / bars;
+                s->ema[w][i] = win.ema[i];
+                s->volatility[w][i] = std::sqrt(std::max(0.0, variance));
+            }
+        }
+        return s;
+    }
+};
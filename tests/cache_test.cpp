@@ -0,0 +1,83 @@
+#include "server_test.h"
+
+static void eviction()
+{
+    ResponseCache cache;
+    const size_t max = ResponseCache::kMaxEntries;
+    for (size_t i = 0; i < max; i++)
+        cache.store("key" + std::to_string(i), 1, "head", std::to_string(i));
+    CHECK_EQ(cache.size(), max);
+    // storing a key again replaces it in place
+    cache.store("key0", 2, "head", "again");
+    CHECK_EQ(cache.size(), max);
+    auto hit = cache.find("key0", 2);
+    CHECK(hit && hit->head == "head" && hit->body == "again");
+    CHECK(!cache.find("key0", 1));
+
+    // a new key evicts the oldest one only
+    cache.store("new", 1, "head", "new");
+    CHECK_EQ(cache.size(), max);
+    CHECK(!cache.find("key0", 2));
+    CHECK(cache.find("key1", 1) && cache.find("new", 1));
+    for (size_t i = 0; i < max; i++)
+        cache.store("more" + std::to_string(i), 1, "head", "");
+    CHECK_EQ(cache.size(), max);
+    CHECK(!cache.find("new", 1) && cache.find("more0", 1) && cache.find("more" + std::to_string(max - 1), 1));
+}
+
+static void served()
+{
+    ServerTest t;
+    ResponseCache &cache = t.system.responses();
+    const std::string request = "GET /api/recommend?type=crypto HTTP/1.1\r\n\r\n";
+    auto first = t.feed(request);
+    uint64_t hits = cache.hitCount();
+    auto second = t.feed(request);
+    CHECK_EQ(cache.hitCount(), hits + 1);
+    CHECK(first.size() == 1 && second.size() == 1);
+    if (first.size() == 1 && second.size() == 1)
+    {
+        CHECK_EQ(second[0].head, first[0].head);
+        CHECK_EQ(second[0].body, first[0].body);
+    }
+
+    // the same request closing the connection gets its own entry with its own head
+    auto closing = t.feed("GET /api/recommend?type=crypto HTTP/1.1\r\nConnection: close\r\n\r\n");
+    CHECK(closing.size() == 1 && closing[0].closes());
+
+    // a change of data is a new generation
+    std::vector<Tick> ticks(1);
+    ticks[0].symbol = "BTC";
+    ticks[0].price = 1;
+    CHECK_EQ(t.system.applyTicks(ticks), size_t(1));
+    hits = cache.hitCount();
+    t.c.closing = false;
+    auto changed = t.feed(request);
+    CHECK_EQ(cache.hitCount(), hits);
+    CHECK(changed.size() == 1 && changed[0].body != first[0].body);
+}
+
+static void unknownNames()
+{
+    // names the data does not have are answered but never stored
+    ServerTest t;
+    ResponseCache &cache = t.system.responses();
+    size_t size = cache.size();
+    for (const char *target : {"/api/recommend?type=nope", "/api/movers?type=nope", "/api/similar?symbol=NOPE",
+                               "/api/movers?window=2d"})
+    {
+        auto list = t.feed(std::string("GET ") + target + " HTTP/1.1\r\n\r\n");
+        CHECK_EQ(list.size(), size_t(1));
+        CHECK_EQ(cache.size(), size);
+    }
+    t.feed("GET /api/similar?symbol=BTC HTTP/1.1\r\n\r\n");
+    CHECK_EQ(cache.size(), size + 1);
+}
+
+int main()
+{
+    eviction();
+    served();
+    unknownNames();
+    return checkResult("cache");
+}
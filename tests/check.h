@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iostream>
+
+// Assertions for the tests/*_test.cpp programs. A failed check prints where and what and
+// is counted; main() returns checkResult(), so any failure fails `make test`.
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                    \
+    do                                                                                 \
+    {                                                                                  \
+        if (!(cond))                                                                   \
+        {                                                                              \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            checkFailures()++;                                                         \
+        }                                                                              \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                  \
+    do                                                                                                  \
+    {                                                                                                   \
+        const auto checkA = (a);                                                                        \
+        const auto checkB = (b);                                                                        \
+        if (!(checkA == checkB))                                                                        \
+        {                                                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " << checkA \
+                      << " vs " << checkB << "\n";                                                      \
+            checkFailures()++;                                                                          \
+        }                                                                                               \
+    } while (0)
+
+inline int checkResult(const char *name)
+{
+    std::cout << name << ": " << (checkFailures() ? "FAILED" : "ok") << "\n";
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+#include "server_test.h"
+
+static const std::string kSearch = "GET /api/search?q=bit HTTP/1.1\r\nHost: test\r\n\r\n";
+static const std::string kStats = "GET /api/stats HTTP/1.1\r\nHost: test\r\n\r\n";
+
+static void parserSplits()
+{
+    // a request arriving one byte at a time, the end of its headers included
+    HttpParser parser;
+    HttpRequest req;
+    size_t consumed = 0;
+    for (size_t i = 1; i < kSearch.size(); i++)
+        CHECK_EQ(parser.parse(std::string_view(kSearch).substr(0, i), req, consumed), HttpParser::Incomplete);
+    CHECK_EQ(parser.parse(kSearch, req, consumed), HttpParser::Complete);
+    CHECK_EQ(consumed, kSearch.size());
+    CHECK_EQ(req.method, "GET");
+    CHECK_EQ(req.path, "/api/search");
+    CHECK_EQ(req.query, "q=bit");
+    CHECK(req.keepAlive);
+
+    // a body split across reads
+    const std::string post = "POST /api/ticks HTTP/1.1\r\nContent-Length: 11\r\n\r\nBTC,100,1.5";
+    HttpParser body;
+    CHECK_EQ(body.parse(std::string_view(post).substr(0, post.size() - 4), req, consumed), HttpParser::Incomplete);
+    CHECK_EQ(body.parse(post, req, consumed), HttpParser::Complete);
+    CHECK_EQ(req.body, "BTC,100,1.5");
+    CHECK_EQ(consumed, post.size());
+}
+
+static void parserPipelines()
+{
+    const std::string both = kSearch + kStats;
+    HttpParser parser;
+    HttpRequest req;
+    size_t consumed = 0;
+    CHECK_EQ(parser.parse(both, req, consumed), HttpParser::Complete);
+    CHECK_EQ(consumed, kSearch.size());
+    CHECK_EQ(req.path, "/api/search");
+    CHECK_EQ(parser.parse(std::string_view(both).substr(consumed), req, consumed), HttpParser::Complete);
+    CHECK_EQ(req.path, "/api/stats");
+    CHECK_EQ(consumed, kStats.size());
+}
+
+static void parserKeepAlive()
+{
+    HttpParser parser;
+    HttpRequest req;
+    size_t consumed = 0;
+    CHECK_EQ(parser.parse("GET / HTTP/1.0\r\n\r\n", req, consumed), HttpParser::Complete);
+    CHECK(!req.keepAlive);
+    CHECK_EQ(parser.parse("GET / HTTP/1.1\r\nconnection:  CLOSE \r\n\r\n", req, consumed), HttpParser::Complete);
+    CHECK(!req.keepAlive);
+    CHECK_EQ(parser.parse("GET / HTTP/1.1\r\nConnection: keep-alive\r\n\r\n", req, consumed), HttpParser::Complete);
+    CHECK(req.keepAlive);
+}
+
+static void parserLimits()
+{
+    const size_t limit = 1024;
+    HttpRequest req;
+    size_t consumed = 0;
+    // headers that never end, and headers that end past the limit
+    std::string endless = "GET / HTTP/1.1\r\nX-Fill: " + std::string(limit, 'a');
+    CHECK_EQ(HttpParser().parse(endless, req, consumed, limit), HttpParser::HeadersTooLarge);
+    CHECK_EQ(HttpParser().parse(endless + "\r\n\r\n", req, consumed, limit), HttpParser::HeadersTooLarge);
+    // a body larger than the limit is refused from its Content-Length, before it arrives
+    std::string big = "POST /api/ticks HTTP/1.1\r\nContent-Length: " + std::to_string(limit + 1) + "\r\n\r\n";
+    CHECK_EQ(HttpParser().parse(big, req, consumed, limit), HttpParser::BodyTooLarge);
+    std::string fits = "POST /api/ticks HTTP/1.1\r\nContent-Length: " + std::to_string(limit) + "\r\n\r\n";
+    CHECK_EQ(HttpParser().parse(fits, req, consumed, limit), HttpParser::Incomplete);
+}
+
+static void parserRejects()
+{
+    HttpRequest req;
+    size_t consumed = 0;
+    for (const char *bad : {"POST /api/ticks HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nBTC,1\r\n0\r\n\r\n",
+                            "GET / HTTP/2.0\r\n\r\n", "GET\r\n\r\n", "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+                            "POST / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n", "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"})
+        CHECK_EQ(HttpParser().parse(bad, req, consumed), HttpParser::Invalid);
+}
+
+static void parserResponses()
+{
+    // headers in any case, two replies back to back, each split across reads
+    const std::string two = "HTTP/1.1 200 OK\r\ncontent-TYPE: application/json\r\ncontent-length: 2\r\n\r\n[]"
+                            "HTTP/1.1 400 Bad Request\r\nContent-Length:  13 \r\nConnection: close\r\n\r\n{\"error\":\"x\"}";
+    HttpParser parser;
+    HttpResponse res;
+    size_t consumed = 0, first = two.find("HTTP/1.1 400");
+    for (size_t i = 1; i < first; i++)
+        CHECK_EQ(parser.parseResponse(std::string_view(two).substr(0, i), res, consumed), HttpParser::Incomplete);
+    CHECK_EQ(parser.parseResponse(two, res, consumed), HttpParser::Complete);
+    CHECK_EQ(consumed, first);
+    CHECK_EQ(res.status, 200);
+    CHECK_EQ(res.body, "[]");
+    CHECK(res.keepAlive);
+    CHECK_EQ(parser.parseResponse(std::string_view(two).substr(first), res, consumed), HttpParser::Complete);
+    CHECK_EQ(res.status, 400);
+    CHECK_EQ(res.body, "{\"error\":\"x\"}");
+    CHECK(!res.keepAlive);
+
+    // a chunked body, with an extension and a trailer, decoded as it arrives
+    const std::string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: Chunked\r\n\r\n"
+                                "4;x=1\r\n{\"a\"\r\nA\r\n:1234567}\n\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    HttpParser chunks;
+    for (size_t i = 1; i < chunked.size(); i++)
+        CHECK_EQ(chunks.parseResponse(std::string_view(chunked).substr(0, i), res, consumed), HttpParser::Incomplete);
+    CHECK_EQ(chunks.parseResponse(chunked + "HTTP/1.1", res, consumed), HttpParser::Complete);
+    CHECK_EQ(consumed, chunked.size());
+    CHECK_EQ(res.body, "{\"a\":1234567}\n");
+
+    // replies without a body
+    CHECK_EQ(HttpParser().parseResponse("HTTP/1.1 204 No Content\r\n\r\n", res, consumed), HttpParser::Complete);
+    CHECK(res.status == 204 && res.body.empty());
+    CHECK_EQ(HttpParser().parseResponse("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n", res, consumed), HttpParser::Complete);
+    CHECK(!res.keepAlive);
+
+    for (const char *bad : {"HTTP/1.1 20 OK\r\nContent-Length: 0\r\n\r\n", "HTTP/1.1 2000 OK\r\nContent-Length: 0\r\n\r\n",
+                            "HTTP/2 200 OK\r\nContent-Length: 0\r\n\r\n", "HTTP/1.1 abc OK\r\nContent-Length: 0\r\n\r\n",
+                            "HTTP/1.1 600 Odd\r\nContent-Length: 0\r\n\r\n", "GET / HTTP/1.1\r\n\r\n",
+                            // a body only the connection's end would delimit
+                            "HTTP/1.1 200 OK\r\n\r\n[]",
+                            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nTransfer-Encoding: chunked\r\n\r\n",
+                            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+                            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\n[]xx0\r\n\r\n"})
+        CHECK_EQ(HttpParser().parseResponse(bad, res, consumed), HttpParser::Invalid);
+}
+
+static void splitRequest()
+{
+    ServerTest t;
+    CHECK(t.feed(kSearch.substr(0, 20)).empty());
+    CHECK(t.feed(kSearch.substr(20, kSearch.size() - 22)).empty());
+    auto list = t.feed(kSearch.substr(kSearch.size() - 2));
+    CHECK_EQ(list.size(), size_t(1));
+    if (!list.empty())
+    {
+        CHECK_EQ(list[0].status, 200);
+        CHECK(list[0].body.find("\"BTC\"") != std::string::npos);
+        CHECK(!list[0].closes());
+    }
+    CHECK(t.c.in.empty());
+    CHECK(!t.c.closing);
+}
+
+static void pipelining()
+{
+    Response search = ServerTest::get("/api/search?q=bit"), stats = ServerTest::get("/api/stats");
+    ServerTest t;
+    // three requests in one read and the start of a fourth
+    auto list = t.feed(kSearch + kStats + kSearch + kStats.substr(0, 10));
+    CHECK_EQ(list.size(), size_t(3));
+    if (list.size() == 3)
+    {
+        CHECK(list[0].body == search.body && list[1].body == stats.body && list[2].body == search.body);
+        CHECK(list[0].status == 200 && list[1].status == 200 && list[2].status == 200);
+    }
+    CHECK_EQ(t.c.in, kStats.substr(0, 10));
+    list = t.feed(kStats.substr(10));
+    CHECK(list.size() == 1 && list[0].body == stats.body);
+    CHECK(!t.c.closing);
+}
+
+static void oversized()
+{
+    {
+        ServerTest t;
+        auto list = t.feed("GET / HTTP/1.1\r\nX-Fill: " + std::string(ServerTest::kMaxRequestBytes, 'a'));
+        CHECK(list.size() == 1 && list[0].status == 431 && list[0].closes());
+        CHECK(t.c.closing);
+    }
+    {
+        ServerTest t;
+        auto list = t.feed("POST /api/ticks HTTP/1.1\r\nContent-Length: " + std::to_string(ServerTest::kMaxRequestBytes + 1) +
+                           "\r\n\r\n");
+        CHECK(list.size() == 1 && list[0].status == 413 && list[0].closes());
+        CHECK(t.c.closing);
+    }
+    {
+        // at the limit the body is waited for, not refused
+        ServerTest t;
+        auto list = t.feed("POST /api/ticks HTTP/1.1\r\nContent-Length: " + std::to_string(ServerTest::kMaxRequestBytes) +
+                           "\r\n\r\n");
+        CHECK(list.empty());
+        CHECK(!t.c.closing);
+    }
+}
+
+static void chunked()
+{
+    ServerTest t;
+    // answered with 400 and closed; the request behind it is not read
+    auto list = t.feed("POST /api/ticks HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nBTC,1\r\n0\r\n\r\n" + kStats);
+    CHECK(list.size() == 1 && list[0].status == 400 && list[0].closes());
+    CHECK(t.c.closing);
+}
+
+static void keepAlive()
+{
+    {
+        ServerTest t;
+        auto list = t.feed("GET /api/stats HTTP/1.0\r\n\r\n" + kStats);
+        CHECK(list.size() == 1 && list[0].status == 200 && list[0].closes());
+        CHECK(t.c.closing);
+    }
+    {
+        ServerTest t;
+        auto list = t.feed(kStats + "GET /api/stats HTTP/1.1\r\nConnection: close\r\n\r\n" + kStats);
+        CHECK(list.size() == 2 && !list[0].closes() && list[1].closes());
+        CHECK(t.c.closing);
+    }
+}
+
+int main()
+{
+    parserSplits();
+    parserPipelines();
+    parserKeepAlive();
+    parserLimits();
+    parserRejects();
+    parserResponses();
+    splitRequest();
+    pipelining();
+    oversized();
+    chunked();
+    keepAlive();
+    return checkResult("http");
+}
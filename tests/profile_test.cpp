@@ -0,0 +1,36 @@
+#include "server_test.h"
+
+static void setProfile(ServerTest &t, const std::string &user, std::initializer_list<std::pair<const char *, float>> weights)
+{
+    std::pmr::vector<std::pair<std::string_view, float>> list;
+    for (auto &w : weights)
+        list.emplace_back(w.first, w.second);
+    CHECK(t.system.setProfile(user, list));
+}
+
+int main()
+{
+    ServerTest t;
+    // large weights push whole categories past the cap, where they tie at 100
+    setProfile(t, "capped", {{"tech", 100}, {"consumer", 60}, {"layer1", 40}});
+    setProfile(t, "mixed", {{"defi", 12.5f}, {"energy", -30}, {"financial", 8}});
+    setProfile(t, "down", {{"tech", -100}, {"layer1", -100}, {"consumer", -100}});
+    setProfile(t, "empty", {});
+    std::vector<uint32_t> want;
+    for (const char *user : {"capped", "mixed", "down", "empty"})
+        for (const char *type : {"", "crypto", "stock"})
+            for (size_t k : {size_t(1), size_t(3), size_t(5), size_t(20), size_t(1000)})
+            {
+                auto got = t.personalTop(user, type, k, want);
+                CHECK(!got.empty());
+                CHECK(got == want);
+            }
+
+    // personal ranks are capped like the shared one: the eleven tech and consumer stocks
+    // all reach 100 and tie there, so they come first in index order
+    t.personalTop("capped", "stock", 11, want);
+    CHECK_EQ(want.size(), size_t(11));
+    CHECK(std::is_sorted(want.begin(), want.end()));
+    CHECK(t.personalTop("nobody", "", 5, want).empty());
+    return checkResult("profile");
+}
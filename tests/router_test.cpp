@@ -0,0 +1,126 @@
+#include "server_test.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+
+// loopback listeners standing in for the shards; the router connects to them, and the
+// test reads its requests and writes the replies
+struct Shards
+{
+    std::vector<int> listeners, accepted;
+    ServerConfig config;
+
+    explicit Shards(size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t size = sizeof(addr);
+            CHECK(bind(fd, reinterpret_cast<sockaddr *>(&addr), size) == 0 && listen(fd, 4) == 0);
+            CHECK(getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &size) == 0);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            listeners.push_back(fd);
+            accepted.push_back(-1);
+            config.shards.emplace_back("127.0.0.1", ntohs(addr.sin_port));
+        }
+    }
+
+    ~Shards()
+    {
+        for (int fd : listeners)
+            close(fd);
+        for (int fd : accepted)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    // takes shard i's connection from the router, if it has made one
+    bool accept(size_t i)
+    {
+        if (accepted[i] < 0)
+            accepted[i] = ::accept(listeners[i], nullptr, nullptr);
+        return accepted[i] >= 0;
+    }
+
+    std::string read(size_t i)
+    {
+        std::string in;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(accepted[i], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            in.append(buffer, static_cast<size_t>(n));
+        return in;
+    }
+};
+
+static void ownerReads()
+{
+    const size_t n = 3;
+    Shards shards(n);
+    ServerTest t(shards.config);
+    std::vector<bool> seen(n);
+    for (int u = 0; u < 64 && std::find(seen.begin(), seen.end(), false) != seen.end(); u++)
+    {
+        const std::string user = "user" + std::to_string(u);
+        const size_t owner = ShardSpec::hash(user) % n;
+        if (seen[owner])
+            continue;
+        seen[owner] = true;
+        CHECK(t.feed("GET /api/profile?user=" + user + " HTTP/1.1\r\nHost: test\r\n\r\n").empty());
+        CHECK(shards.accept(owner));
+        t.upstreamEvent(owner, false, true);
+        CHECK_EQ(shards.read(owner).find("GET /api/profile?user=" + user + " HTTP/1.1\r\n"), size_t(0));
+        // only the owner is asked
+        for (size_t i = 0; i < n; i++)
+            if (i != owner)
+                CHECK(t.upstream(i).waiting.empty() && (!shards.accept(i) || shards.read(i).empty()));
+
+        // its reply, chunked and in lowercase, is passed on as it is
+        const std::string rest = std::to_string(u) + "}\n";
+        const std::string reply = "HTTP/1.1 200 OK\r\ntransfer-encoding: chunked\r\n\r\n5\r\n{\"a\":\r\n" +
+                                  std::to_string(rest.size()) + "\r\n" + rest + "\r\n0\r\n\r\n";
+        send(shards.accepted[owner], reply.data(), reply.size(), 0);
+        t.upstreamEvent(owner, true, false);
+        auto list = responses(t.received());
+        CHECK_EQ(list.size(), size_t(1));
+        if (!list.empty())
+        {
+            CHECK_EQ(list[0].status, 200);
+            CHECK_EQ(list[0].body, "{\"a\":" + rest);
+        }
+    }
+    CHECK(std::find(seen.begin(), seen.end(), false) == seen.end());
+}
+
+static void badProfile()
+{
+    Shards shards(2);
+    ServerTest t(shards.config);
+    // a category the router's universe does not have is refused there, no shard asked
+    auto list = t.feed("POST /api/profile?user=bob HTTP/1.1\r\nContent-Length: 7\r\n\r\nnope,10");
+    CHECK(list.size() == 1 && list[0].status == 400);
+    if (!list.empty())
+        CHECK_EQ(list[0].body, "{\"error\":\"Bad profile\"}");
+    for (size_t i = 0; i < 2; i++)
+        CHECK(!shards.accept(i) && t.upstream(i).fd < 0);
+
+    // a known one goes to every shard
+    CHECK(t.feed("POST /api/profile?user=bob HTTP/1.1\r\nContent-Length: 7\r\n\r\ndefi,10").empty());
+    for (size_t i = 0; i < 2; i++)
+    {
+        CHECK(shards.accept(i));
+        t.upstreamEvent(i, false, true);
+        CHECK(shards.read(i).find("partial=1") != std::string::npos);
+    }
+}
+
+int main()
+{
+    ownerReads();
+    badProfile();
+    return checkResult("router");
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "../http.h"
+#include "check.h"
+
+#include <sys/socket.h>
+
+// one response as the client sees it
+struct Response
+{
+    int status = 0;
+    std::string head, body;
+
+    bool closes() const { return head.find("\r\nConnection: close\r\n") != std::string::npos; }
+};
+
+// splits what the server wrote into responses; a response cut short ends the list
+inline std::vector<Response> responses(std::string_view out)
+{
+    std::vector<Response> list;
+    while (!out.empty())
+    {
+        size_t end = out.find("\r\n\r\n");
+        size_t length = out.find("\r\nContent-Length: ");
+        if (end == std::string_view::npos || length == std::string_view::npos || length > end || out.compare(0, 9, "HTTP/1.1 "))
+            break;
+        Response r;
+        r.status = std::atoi(std::string(out.substr(9, 3)).c_str());
+        r.head = std::string(out.substr(0, end + 4));
+        size_t size = static_cast<size_t>(std::atoll(std::string(out.substr(length + 18, 20)).c_str()));
+        if (out.size() < end + 4 + size)
+            break;
+        r.body = std::string(out.substr(end + 4, size));
+        out.remove_prefix(end + 4 + size);
+        list.push_back(std::move(r));
+    }
+    return list;
+}
+
+// Drives one connection of the built-in universe the way a worker does, without the
+// event loop: bytes go into the connection's input, processInput() answers them, and the
+// responses are read back from the other end of a socket pair. With config.shards set it
+// is a router, whose shard replies the test writes and hands over with upstreamEvent().
+// startStream() runs the server's stream thread, which publishes to this worker.
+struct ServerTest
+{
+    using Connection = SimpleHTTPServer::Connection;
+    using Upstream = SimpleHTTPServer::Upstream;
+    static constexpr size_t kMaxRequestBytes = SimpleHTTPServer::kMaxRequestBytes;
+    static constexpr auto kStreamPing = SimpleHTTPServer::kStreamPing;
+    static constexpr size_t kMaxStreamSymbols = SimpleHTTPServer::kMaxStreamSymbols;
+
+    InvestmentSystem system;
+    SimpleHTTPServer server;
+    SimpleHTTPServer::WorkerState *worker; // the server's only one
+    int peer = -1;
+    Connection &c; // registered with the worker, as an accepted connection is
+    std::thread streamer;
+
+    explicit ServerTest(const ServerConfig &config = ServerConfig())
+        : server(system, config),
+          worker(server.workerStates.emplace_back(std::make_unique<SimpleHTTPServer::WorkerState>()).get()),
+          c(open(*worker, peer))
+    {
+        for (size_t i = 0; i < config.shards.size(); i++)
+        {
+            worker->upstreams.push_back(std::make_unique<Upstream>());
+            worker->upstreams.back()->shard = i;
+        }
+    }
+
+    static Connection &open(SimpleHTTPServer::WorkerState &w, int &peer)
+    {
+        int fds[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        auto owned = std::make_unique<Connection>();
+        owned->fd = fds[0];
+        owned->id = 1;
+        owned->worker = &w;
+        peer = fds[1];
+        SimpleHTTPServer::setNonBlocking(peer);
+        return *(w.conns[fds[0]] = std::move(owned));
+    }
+
+    ~ServerTest()
+    {
+        if (streamer.joinable())
+            stopStream();
+        if (worker->conns.count(c.fd)) // else the worker closed it
+            close(c.fd);
+        close(peer);
+        for (auto &u : worker->upstreams)
+            if (u->fd >= 0)
+                close(u->fd);
+    }
+
+    // router mode: what the worker does when shard's connection becomes readable or writable
+    void upstreamEvent(size_t shard, bool readable, bool writable)
+    {
+        Upstream &u = *worker->upstreams[shard];
+        server.onUpstreamEvent(*worker, u, {&u, readable, writable, false});
+    }
+
+    Upstream &upstream(size_t shard) { return *worker->upstreams[shard]; }
+
+    void startStream()
+    {
+        server.streaming = true;
+        streamer = std::thread(&SimpleHTTPServer::streamLoop, &server);
+    }
+
+    void stopStream()
+    {
+        server.streaming = false;
+        system.wakeDataWaiters();
+        streamer.join();
+    }
+
+    // whether the stream thread has published events to the worker since deliverStream()
+    bool streamMail() const { return worker->mail.load(std::memory_order_acquire); }
+
+    // what the worker does when woken with them; returns what the client got
+    std::string deliverStream()
+    {
+        worker->mail.exchange(false, std::memory_order_acquire);
+        server.deliverStream(*worker);
+        return received();
+    }
+
+    // everything written to the client so far
+    std::string received()
+    {
+        std::string out;
+        char buffer[65536];
+        ssize_t n;
+        while ((n = recv(peer, buffer, sizeof(buffer), 0)) > 0)
+            out.append(buffer, static_cast<size_t>(n));
+        return out;
+    }
+
+    // bytes from the client, and everything written back to it
+    std::string exchange(std::string_view bytes)
+    {
+        c.in.append(bytes);
+        server.processInput(c);
+        return received();
+    }
+
+    // what the worker does after each event on the connection: writes out what is queued
+    // on it, stream events included, or closes it; returns what the client got
+    std::string settle()
+    {
+        server.settle(*worker, c, true);
+        return received();
+    }
+
+    std::vector<Response> feed(std::string_view bytes) { return responses(exchange(bytes)); }
+
+    // the router's answer once every shard in c.fanout has replied
+    std::vector<Response> finishFanOut()
+    {
+        std::fill(std::begin(c.fanout.at), std::end(c.fanout.at), SimpleHTTPServer::Clock::now());
+        server.finishFanOut(c, nullptr);
+        return responses(received());
+    }
+
+    // user's top k of type (any if empty) on the current snapshot, as recommendations pick
+    // it and, in want, by sorting every asset on its personal rank
+    std::vector<uint32_t> personalTop(const std::string &user, const std::string &type, size_t k, std::vector<uint32_t> &want)
+    {
+        InvestmentSystem::Reader s(system);
+        std::vector<double> bonus;
+        std::vector<uint32_t> got;
+        want.clear();
+        if (!system.profileBonus(*s, user, bonus))
+            return got;
+        int typeId = InvestmentSystem::typeFilter(*s, type);
+        InvestmentSystem::personalTop(*s, bonus, typeId, k, got);
+        const AssetColumns &c = s->columns;
+        for (uint32_t i = 0; i < s->assets.size(); i++)
+            if (typeId == Trie::kAnyType || c.typeId[i] == typeId)
+                want.push_back(i);
+        std::sort(want.begin(), want.end(), [&](uint32_t a, uint32_t b)
+                  {
+                      double ra = InvestmentSystem::personalRank(c, a, bonus), rb = InvestmentSystem::personalRank(c, b, bonus);
+                      return ra > rb || (ra == rb && a < b);
+                  });
+        want.resize(std::min(want.size(), k));
+        return got;
+    }
+
+    // the symbol of the asset in row i of the current snapshot
+    std::string symbol(size_t i)
+    {
+        InvestmentSystem::Reader s(system);
+        return std::string(s->assets.at(i).symbol);
+    }
+
+    // one request on a fresh connection
+    static Response get(const std::string &target)
+    {
+        ServerTest t;
+        auto list = t.feed("GET " + target + " HTTP/1.1\r\nHost: test\r\n\r\n");
+        CHECK_EQ(list.size(), size_t(1));
+        return list.empty() ? Response() : list[0];
+    }
+};
@@ -0,0 +1,124 @@
+#include "server_test.h"
+
+static Response send(ServerTest &t, const std::string &method, const std::string &target, const std::string &body = "")
+{
+    std::string request = method + " " + target + " HTTP/1.1\r\nHost: test\r\n";
+    if (!body.empty())
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    auto list = t.feed(request + "\r\n" + body);
+    CHECK_EQ(list.size(), size_t(1));
+    return list.empty() ? Response() : list[0];
+}
+
+static void singleNode()
+{
+    struct Case
+    {
+        const char *method, *target, *body;
+        int status;
+    };
+    const Case cases[] = {
+        {"GET", "/api/search?q=bit", "", 200},
+        {"GET", "/api/recommend?type=crypto", "", 200},
+        // a type the data does not have is an empty answer, not an error
+        {"GET", "/api/recommend?type=nope", "", 200},
+        {"GET", "/api/movers?window=1h", "", 200},
+        {"GET", "/api/movers?window=2d", "", 400},
+        {"GET", "/api/similar?symbol=BTC", "", 200},
+        {"GET", "/api/similar?symbol=NOPE", "", 400},
+        {"GET", "/api/similar?symbol=BTC&k=100000", "", 400},
+        {"GET", "/api/query?price>10&sort=cap", "", 200},
+        {"GET", "/api/query?price<<10", "", 400},
+        {"GET", "/api/profile?user=nobody", "", 400},
+        {"POST", "/api/ticks", "BTC,100000", 200},
+        {"POST", "/api/ticks", "BTC,inf", 400},
+        {"POST", "/api/profile?user=ann", "defi,10", 200},
+        {"POST", "/api/profile?user=bob", "nope,10", 400},
+        {"POST", "/api/profile?user=bob", "defi", 400},
+        {"GET", "/api/nowhere", "", 404},
+        {"DELETE", "/api/stats", "", 404},
+    };
+    ServerTest t;
+    for (const Case &k : cases)
+    {
+        Response r = send(t, k.method, k.target, k.body);
+        if (r.status != k.status)
+            std::cerr << k.method << " " << k.target << ": " << r.status << " " << r.body << "\n";
+        CHECK_EQ(r.status, k.status);
+        CHECK_EQ(r.body.compare(0, 9, "{\"error\":") == 0, k.status != 200);
+    }
+    // the stored profile reads back
+    CHECK_EQ(send(t, "GET", "/api/profile?user=ann").status, 200);
+}
+
+// what the router answers when each of its shards replies as a node of the built-in
+// universe does; a request the router merges is sent to them with partial=1, any other
+// only to the shard single
+static Response routed(const std::string &method, const std::string &path, const std::string &query,
+                       const std::string &body, int single = -1)
+{
+    const bool merged = single < 0;
+    const size_t shards = 2;
+    ServerTest router;
+    auto &f = router.c.fanout;
+    f.route = RequestMetrics::routeOf(path);
+    f.method = method;
+    f.path = path;
+    f.query = query;
+    f.status.assign(shards, 0);
+    f.replies.assign(shards, "");
+    f.single = single;
+    std::string target = path + "?" + query + (merged ? "&partial=1" : "");
+    for (size_t i = 0; i < shards; i++)
+    {
+        if (!merged && static_cast<int>(i) != single)
+            continue;
+        ServerTest shard;
+        Response r = send(shard, method, target, body);
+        f.status[i] = static_cast<uint16_t>(r.status);
+        f.replies[i] = r.body;
+    }
+    auto list = router.finishFanOut();
+    CHECK_EQ(list.size(), size_t(1));
+    return list.empty() ? Response() : list[0];
+}
+
+static void routerAgrees()
+{
+    // refusals pass through with the status and body a single node answers with
+    for (auto &k : {std::make_pair("/api/ticks", "BTC,inf"), std::make_pair("/api/profile", "defi")})
+    {
+        ServerTest single;
+        Response want = send(single, "POST", std::string(k.first) + "?user=bob", k.second);
+        Response got = routed("POST", k.first, "user=bob", k.second);
+        CHECK_EQ(want.status, 400);
+        CHECK_EQ(got.status, want.status);
+        CHECK_EQ(got.body, want.body);
+    }
+    Response unknown = routed("GET", "/api/profile", "user=nobody", "", 1);
+    CHECK_EQ(unknown.status, 400);
+    CHECK_EQ(unknown.body, "{\"error\":\"Unknown user\"}");
+
+    // answers are merged
+    Response ticks = routed("POST", "/api/ticks", "", "BTC,100000");
+    CHECK_EQ(ticks.status, 200);
+    CHECK_EQ(ticks.body, "{\"accepted\":2,\"dropped\":0}");
+    CHECK_EQ(routed("GET", "/api/search", "q=bit", "").status, 200);
+
+    // a missing or failed shard is still a gateway error
+    ServerTest router;
+    auto &f = router.c.fanout;
+    f.route = RequestMetrics::Ticks;
+    f.method = "POST";
+    f.status = {400, 0};
+    f.replies = {"{\"error\":\"Bad tick\"}", ""};
+    auto list = router.finishFanOut();
+    CHECK(list.size() == 1 && list[0].status == 502);
+}
+
+int main()
+{
+    singleNode();
+    routerAgrees();
+    return checkResult("status");
+}
@@ -0,0 +1,127 @@
+#include "server_test.h"
+
+using Clock = std::chrono::steady_clock;
+
+static void tick(InvestmentSystem &system, const char *symbol, double price)
+{
+    std::vector<Tick> ticks(1);
+    ticks[0].symbol = symbol;
+    ticks[0].price = price;
+    CHECK_EQ(system.applyTicks(ticks), size_t(1));
+}
+
+static void waits()
+{
+    // a waiter is woken by the next published snapshot, not by its deadline
+    InvestmentSystem system;
+    std::atomic<bool> running{true};
+    uint64_t seen = system.dataGeneration(), woke = seen;
+    auto start = Clock::now();
+    std::thread waiter([&] { woke = system.waitForData(seen, start + std::chrono::seconds(60), running); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    tick(system, "BTC", 12345);
+    waiter.join();
+    CHECK(woke != seen);
+    CHECK(Clock::now() - start < std::chrono::seconds(30));
+
+    // and by being stopped
+    start = Clock::now();
+    std::thread stopped([&] { system.waitForData(system.dataGeneration(), start + std::chrono::seconds(60), running); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    running = false;
+    system.wakeDataWaiters();
+    stopped.join();
+    CHECK(Clock::now() - start < std::chrono::seconds(30));
+}
+
+// what a new subscriber to target gets at once
+static std::string subscribe(const std::string &target)
+{
+    ServerTest t;
+    std::string first = t.exchange("GET " + target + " HTTP/1.1\r\nHost: test\r\n\r\n");
+    return first + t.settle();
+}
+
+static void topics()
+{
+    // one stream for several types, each recommend event saying which it is
+    std::string both = subscribe("/api/stream?type=crypto,stock");
+    CHECK(both.find("event: recommend\ndata: {\"type\":\"crypto\",\"assets\":[{") != std::string::npos);
+    CHECK(both.find("event: recommend\ndata: {\"type\":\"stock\",\"assets\":[{") != std::string::npos);
+    CHECK(subscribe("/api/stream").find("event: recommend\ndata: {\"type\":\"\",\"assets\":[{") != std::string::npos);
+    CHECK(subscribe("/api/stream?type=crypto,,crypto").find("\"type\":\"crypto\"") != std::string::npos);
+    auto unknown = responses(subscribe("/api/stream?type=crypto,nope"));
+    CHECK(unknown.size() == 1 && unknown[0].body == "{\"error\":\"Unknown type\"}");
+
+    // the symbol limit does not depend on how many types there are
+    ServerTest t;
+    std::string symbols;
+    for (size_t i = 0; i < ServerTest::kMaxStreamSymbols; i++)
+        symbols += t.symbol(i) + ",";
+    for (const char *types : {"", "crypto", "crypto,stock"})
+    {
+        std::string target = std::string("/api/stream?type=") + types + "&symbols=" + symbols;
+        CHECK_EQ(subscribe(target).find("HTTP/1.1 200 OK\r\n"), size_t(0));
+        auto refused = responses(subscribe(target + t.symbol(ServerTest::kMaxStreamSymbols)));
+        CHECK(refused.size() == 1 && refused[0].body == "{\"error\":\"Too many symbols\"}");
+    }
+}
+
+// the stream thread's next round, as the worker gets it
+static std::string nextRound(ServerTest &t)
+{
+    for (auto start = Clock::now(); !t.streamMail() && Clock::now() - start < std::chrono::seconds(10);)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(t.streamMail());
+    return t.deliverStream();
+}
+
+static void streams()
+{
+    ServerTest t;
+    std::string first = t.exchange("GET /api/stream?type=crypto&symbols=BTC HTTP/1.1\r\nHost: test\r\n\r\n");
+    first += t.settle();
+    CHECK_EQ(first.find("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"), size_t(0));
+    for (const char *event : {"event: stats\n", "event: recommend\n", "event: price\n"})
+        CHECK(first.find(event) != std::string::npos);
+
+    // the stream thread takes the data as it finds it when it starts; once it has sent a
+    // round and gone quiet, it is waiting
+    t.startStream();
+    for (int i = 1; !t.streamMail() && i < 1000; i++)
+    {
+        tick(t.system, "BTC", i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    do
+    {
+        t.deliverStream();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    } while (t.streamMail());
+
+    auto start = Clock::now();
+    tick(t.system, "BTC", 12345);
+    std::string next = nextRound(t);
+    CHECK(next.find("event: price\ndata: {\"name\":\"Bitcoin\",\"symbol\":\"BTC\",\"price\":12345,") != std::string::npos);
+    CHECK(next.find("event: stats\n") != std::string::npos);
+
+    // a later change is its own round, with only what changed
+    tick(t.system, "ETH", 2345);
+    next = nextRound(t);
+    CHECK(next.find("event: stats\n") != std::string::npos);
+    CHECK_EQ(next.find("event: price\n"), std::string::npos);
+    CHECK(Clock::now() - start < std::chrono::seconds(10));
+
+    // stopping does not wait for the next keep-alive
+    start = Clock::now();
+    t.stopStream();
+    CHECK(Clock::now() - start < ServerTest::kStreamPing);
+}
+
+int main()
+{
+    waits();
+    topics();
+    streams();
+    return checkResult("stream");
+}
@@ -0,0 +1,258 @@
+#include "../trie.h"
+#include "check.h"
+
+#include <map>
+#include <set>
+
+// random names and tickers; short symbols collide, and scores tie often, so dedup and
+// tie order get exercised
+static std::vector<Asset> assets(size_t n, unsigned seed, StringArena &strings, Interner &types)
+{
+    static const char *syllables[] = {"bit", "eth", "coin", "sol", "ana", "chain", "link", "lite", "doge", "net", "meta"};
+    static const char *categories[] = {"layer1", "defi", "ai", "meme", "gaming", "tech", "energy"};
+    std::mt19937 rng(seed);
+    std::vector<Asset> out(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        std::string name, symbol;
+        for (int p = 0; p < 2 + static_cast<int>(rng() % 3); p++)
+            name += syllables[rng() % (sizeof(syllables) / sizeof(*syllables))];
+        name += " " + std::to_string(i);
+        for (int c = 0; c < 2 + static_cast<int>(rng() % 3); c++)
+            symbol += static_cast<char>('A' + rng() % 8);
+        Asset &a = out[i];
+        a.name = strings.add(name);
+        a.symbol = strings.add(symbol);
+        a.category = categories[rng() % (sizeof(categories) / sizeof(*categories))];
+        a.type = (rng() % 2) ? "crypto" : "stock";
+        a.typeId = types.intern(a.type);
+        a.score = 60 + static_cast<int>(rng() % 40);
+    }
+    return out;
+}
+
+static std::string lowered(std::string_view s)
+{
+    std::string out(s);
+    for (char &ch : out)
+        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    return out;
+}
+
+static double score(const Asset &a) { return a.score; }
+
+// the trie's top(): best k distinct symbols by rank, ties to the lower address
+static std::vector<Asset *> bruteTop(const std::vector<std::pair<std::string, Asset *>> &keys, const std::string &prefix,
+                                     size_t k, int typeId)
+{
+    std::vector<Asset *> under;
+    for (auto &key : keys)
+        if (key.first.compare(0, prefix.size(), prefix) == 0 && (typeId == Trie::kAnyType || key.second->typeId == typeId))
+            under.push_back(key.second);
+    std::sort(under.begin(), under.end(), [](const Asset *a, const Asset *b)
+              { return score(*a) != score(*b) ? score(*a) > score(*b) : a < b; });
+    std::vector<Asset *> out;
+    for (Asset *a : under)
+        if (out.size() < k && std::none_of(out.begin(), out.end(), [a](const Asset *r) { return r->symbol == a->symbol; }))
+            out.push_back(a);
+    return out;
+}
+
+// edits (insertions, deletions, substitutions, adjacent swaps) between query and the
+// closest prefix of key
+static uint32_t prefixDistance(const std::string &query, const std::string &key)
+{
+    const size_t m = query.size(), n = key.size();
+    std::vector<std::vector<uint32_t>> d(m + 1, std::vector<uint32_t>(n + 1));
+    for (size_t i = 0; i <= m; i++)
+        for (size_t j = 0; j <= n; j++)
+        {
+            if (i == 0 || j == 0)
+            {
+                d[i][j] = static_cast<uint32_t>(i + j);
+                continue;
+            }
+            d[i][j] = std::min({d[i - 1][j] + 1, d[i][j - 1] + 1, d[i - 1][j - 1] + (query[i - 1] != key[j - 1])});
+            if (i > 1 && j > 1 && query[i - 1] == key[j - 2] && query[i - 2] == key[j - 1])
+                d[i][j] = std::min(d[i][j], d[i - 2][j - 2] + 1);
+        }
+    return *std::min_element(d[m].begin(), d[m].end());
+}
+
+// the trie's fuzzyTop(): best k distinct symbols by distance, then rank, then address
+static std::vector<Asset *> bruteFuzzy(const std::vector<std::pair<std::string, Asset *>> &keys, const std::string &query,
+                                       uint32_t maxEdits, size_t k)
+{
+    std::vector<std::pair<uint32_t, Asset *>> near;
+    for (auto &key : keys)
+    {
+        uint32_t d = prefixDistance(query, key.first);
+        if (d <= maxEdits)
+            near.emplace_back(d, key.second);
+    }
+    std::sort(near.begin(), near.end(), [](const auto &a, const auto &b)
+              {
+                  if (a.first != b.first)
+                      return a.first < b.first;
+                  return score(*a.second) != score(*b.second) ? score(*a.second) > score(*b.second) : a.second < b.second;
+              });
+    std::vector<Asset *> out;
+    for (auto &n : near)
+        if (out.size() < k && std::none_of(out.begin(), out.end(), [&](const Asset *r) { return r->symbol == n.second->symbol; }))
+            out.push_back(n.second);
+    return out;
+}
+
+int main()
+{
+    const size_t n = 20000;
+    StringArena strings;
+    Interner types;
+    std::vector<Asset> universe = assets(n, 7, strings, types);
+    Trie trie(score);
+    std::vector<std::pair<std::string, Asset *>> keys;
+    for (auto &a : universe)
+        for (std::string_view key : {a.name, a.symbol, a.category})
+        {
+            trie.insert(key, &a);
+            keys.emplace_back(lowered(key), &a);
+        }
+    trie.build();
+
+    // one node per distinct key prefix, the empty one included
+    std::set<std::string> prefixes;
+    // per prefix, the (symbol, type) pairs below it: what its ranked list may hold
+    std::map<std::string, std::set<std::pair<std::string_view, uint16_t>>> below;
+    for (auto &key : keys)
+        for (size_t len = 0; len <= key.first.size(); len++)
+        {
+            prefixes.insert(key.first.substr(0, len));
+            below[key.first.substr(0, len)].emplace(key.second->symbol, key.second->typeId);
+        }
+    CHECK_EQ(trie.nodeCount(), prefixes.size());
+
+    // Footprint: the frozen arrays are sized exactly, so the index is its nodes (six
+    // uint32s), one label byte and one uint32 target per edge, and one pointer per key
+    // and per ranked-list entry, with no growth slack on top.
+    size_t rankedEntries = 0;
+    for (auto &p : below)
+    {
+        std::map<uint16_t, size_t> perType;
+        for (auto &entry : p.second)
+            perType[entry.second]++;
+        for (auto &t : perType)
+            rankedEntries += std::min(t.second, Trie::kTopK);
+    }
+    const size_t nodes = trie.nodeCount();
+    const size_t expected = sizeof(Trie) + nodes * 6 * sizeof(uint32_t) + (nodes - 1) * (1 + sizeof(uint32_t)) +
+                            (keys.size() + rankedEntries) * sizeof(Asset *);
+    CHECK_EQ(trie.memoryBytes(), expected);
+    std::cout << "trie footprint: " << n << " assets, " << keys.size() << " keys, " << nodes << " nodes, "
+              << trie.memoryBytes() / 1024 << " KiB (" << trie.memoryBytes() / keys.size() << " bytes per key)\n";
+    // the budget this layout was accepted at, on these keys
+    CHECK(trie.memoryBytes() / keys.size() <= 128);
+
+    // a rebuild with nothing staged lays out the same arrays
+    trie.build();
+    CHECK_EQ(trie.nodeCount(), nodes);
+    CHECK_EQ(trie.memoryBytes(), expected);
+
+    // lookups match a scan of the keys
+    const int crypto = types.find("crypto");
+    std::vector<std::string> queries = {"", "b", "bit", "bitcoin", "e", "ab", "abc", "defi", "meme", "zzz", "coin 1"};
+    for (size_t i = 0; i < 200; i++)
+    {
+        const auto &key = keys[(i * 7919) % keys.size()].first;
+        queries.push_back(key.substr(0, 1 + i % key.size()));
+    }
+    std::vector<Asset *> got;
+    for (const std::string &q : queries)
+    {
+        std::multiset<Asset *> want, found;
+        for (auto &key : keys)
+            if (key.first.compare(0, q.size(), q) == 0)
+                want.insert(key.second);
+        for (Asset *a : trie.search(q, static_cast<int>(keys.size())))
+            found.insert(a);
+        CHECK(found == want);
+        CHECK_EQ(trie.search(q, 5).size(), std::min<size_t>(5, want.size()));
+
+        for (int type : {Trie::kAnyType, crypto})
+            for (size_t k : {size_t(1), size_t(10), Trie::kTopK})
+            {
+                trie.top(q, k, type, got);
+                CHECK(got == bruteTop(keys, q, k, type));
+            }
+    }
+    // upper case finds the same keys
+    trie.top("BIT", 10, Trie::kAnyType, got);
+    CHECK(got == bruteTop(keys, "bit", 10, Trie::kAnyType));
+
+    // a score change reaches every list on the key's path
+    Asset &moved = universe[123];
+    moved.score = 1000;
+    trie.rerank(lowered(moved.symbol));
+    trie.top(lowered(moved.symbol).substr(0, 1), 1, Trie::kAnyType, got);
+    CHECK(got.size() == 1 && got[0] == &moved);
+    moved.score = 60;
+    trie.buildTopLists();
+
+    // typo'd lookups match a scan of the keys, with the typo anywhere, the first
+    // character included
+    std::vector<std::string> typos = {"xitcoin", "ibtcoin", "itcoin", "bitocin", "bitcoinn", "etherr", "tehchain",
+                                      "dfei", "meem", "zzzz", "doge", "dogecoin 12"};
+    for (size_t i = 0; i < 100; i++)
+    {
+        std::string q = keys[(i * 7919 + 13) % keys.size()].first.substr(0, 4 + i % 6);
+        size_t at = i % q.size();
+        if (i % 3 == 0)
+            q[at] = static_cast<char>('a' + i % 26);
+        else if (i % 3 == 1)
+            q.erase(at, 1);
+        else if (at + 1 < q.size())
+            std::swap(q[at], q[at + 1]);
+        typos.push_back(q);
+    }
+    std::vector<uint32_t> distances;
+    for (const std::string &q : typos)
+        for (size_t k : {size_t(10), Trie::kTopK})
+        {
+            trie.fuzzyTop(q, Trie::typoBudget(q.size()), k, Trie::kAnyType, got, &distances);
+            CHECK(got == bruteFuzzy(keys, q, Trie::typoBudget(q.size()), k));
+            CHECK_EQ(distances.size(), got.size());
+        }
+    trie.fuzzyTop("xitcoin", 1, 10, Trie::kAnyType, got, &distances);
+    CHECK(!got.empty() && distances[0] == 1);
+
+    // a saved index loads back into the same arrays
+    std::FILE *file = std::tmpfile();
+    CHECK(file != nullptr);
+    if (file)
+    {
+        BinaryWriter writer(file);
+        trie.save(writer, universe.data());
+        CHECK(writer.good());
+        std::string bytes(static_cast<size_t>(std::ftell(file)), '\0');
+        std::rewind(file);
+        CHECK_EQ(std::fread(&bytes[0], 1, bytes.size(), file), bytes.size());
+        std::fclose(file);
+
+        Trie loaded(score);
+        BinaryReader reader(bytes.data(), bytes.size());
+        CHECK(loaded.load(reader, universe.data(), universe.size()));
+        CHECK_EQ(loaded.nodeCount(), nodes);
+        for (const std::string &q : queries)
+        {
+            CHECK(loaded.search(q, 50) == trie.search(q, 50));
+            std::vector<Asset *> want;
+            trie.top(q, 20, Trie::kAnyType, want);
+            loaded.top(q, 20, Trie::kAnyType, got);
+            CHECK(got == want);
+        }
+        // an index that points past the assets is refused
+        BinaryReader again(bytes.data(), bytes.size());
+        Trie refused(score);
+        CHECK(!refused.load(again, universe.data(), 10));
+    }
+    return checkResult("trie");
+}
@@ -0,0 +1,434 @@
+#include "trie.h"
+
+void Trie::collectKeys(uint32_t n, std::pmr::string &key, std::pmr::vector<Staged> &out)
+{
+    const Node &node = nodes[n];
+    uint32_t own = node.edgeCount ? nodes[targets[node.firstEdge]].assetBegin : node.assetEnd;
+    for (uint32_t i = node.assetBegin; i < own; i++)
+        stage(key, leaves[i], out);
+    for (uint32_t e = node.firstEdge; e < node.firstEdge + node.edgeCount; e++)
+    {
+        key.push_back(static_cast<char>(labels[e]));
+        collectKeys(targets[e], key, out);
+        key.pop_back();
+    }
+}
+
+uint32_t Trie::buildNode(const Keys &keys, size_t lo, size_t hi, size_t depth)
+{
+    uint32_t id = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({0, 0, static_cast<uint32_t>(leaves.size()), 0, 0, 0});
+    while (lo < hi && keys[lo].first.size() == depth)
+        leaves.push_back(keys[lo++].second);
+
+    uint32_t firstEdge = static_cast<uint32_t>(labels.size());
+    uint32_t edgeCount = 0;
+    for (size_t i = lo; i < hi; i++)
+    {
+        if (i == lo || keys[i].first[depth] != keys[i - 1].first[depth])
+        {
+            labels.push_back(static_cast<unsigned char>(keys[i].first[depth]));
+            edgeCount++;
+        }
+    }
+    targets.resize(labels.size());
+    nodes[id].firstEdge = firstEdge;
+    nodes[id].edgeCount = edgeCount;
+
+    for (uint32_t e = firstEdge; e < firstEdge + edgeCount; e++)
+    {
+        size_t end = lo;
+        while (end < hi && static_cast<unsigned char>(keys[end].first[depth]) == labels[e])
+            end++;
+        targets[e] = buildNode(keys, lo, end, depth + 1);
+        lo = end;
+    }
+    nodes[id].assetEnd = static_cast<uint32_t>(leaves.size());
+    return id;
+}
+
+void Trie::rankCandidates(uint32_t n)
+{
+    const Node &node = nodes[n];
+    scratch.clear();
+    for (uint32_t i = node.assetBegin; i < ownEnd(node); i++)
+        scratch.emplace_back(rank(*leaves[i]), leaves[i]);
+    for (uint32_t e = node.firstEdge; e < node.firstEdge + node.edgeCount; e++)
+    {
+        const Node &child = nodes[targets[e]];
+        for (uint32_t i = child.topBegin; i < child.topBegin + child.topCount; i++)
+            scratch.emplace_back(rank(*ranked[i]), ranked[i]);
+    }
+    std::sort(scratch.begin(), scratch.end(), [](const auto &a, const auto &b)
+              { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+}
+
+void Trie::selectTop(std::vector<Asset *> &out)
+{
+    size_t start = out.size();
+    perType.clear();
+    for (auto &cand : scratch)
+    {
+        const Asset *a = cand.second;
+        if (a->typeId >= perType.size())
+            perType.resize(a->typeId + 1u, 0);
+        if (perType[a->typeId] == kTopK)
+            continue;
+        bool dup = false;
+        for (size_t i = start; i < out.size() && !dup; i++)
+            dup = out[i]->typeId == a->typeId && out[i]->symbol == a->symbol;
+        if (dup)
+            continue;
+        perType[a->typeId]++;
+        out.push_back(cand.second);
+    }
+}
+
+void Trie::buildTopLists()
+{
+    ranked.clear();
+    // children always follow their parent, so reverse order is bottom-up
+    for (size_t n = nodes.size(); n-- > 0;)
+    {
+        rankCandidates(static_cast<uint32_t>(n));
+        winners.clear();
+        selectTop(winners);
+        nodes[n].topBegin = static_cast<uint32_t>(ranked.size());
+        nodes[n].topCount = static_cast<uint32_t>(winners.size());
+        ranked.insert(ranked.end(), winners.begin(), winners.end());
+    }
+    ranked.shrink_to_fit();
+}
+
+void Trie::build()
+{
+    const size_t keyCount = leaves.size() + pending.size();
+    std::pmr::monotonic_buffer_resource arena(keyCount * (sizeof(Staged) + sizeof(Keys::value_type)) + 4096);
+    std::pmr::vector<Staged> staged(&arena);
+    staged.reserve(keyCount);
+    if (!nodes.empty())
+    {
+        std::pmr::string key(&arena);
+        collectKeys(0, key, staged);
+    }
+    staged.insert(staged.end(), pending.begin(), pending.end());
+    pending.clear();
+    pending.shrink_to_fit();
+    // keyChars is complete, so views into it stay put from here on
+    Keys keys(&arena);
+    keys.reserve(staged.size());
+    for (auto &k : staged)
+        keys.emplace_back(std::string_view(keyChars).substr(k.offset, k.length), k.asset);
+    // stable: assets sharing a key keep insertion order
+    std::stable_sort(keys.begin(), keys.end(), [](const auto &a, const auto &b)
+                     { return a.first < b.first; });
+
+    // one node per distinct prefix: the root plus, per sorted key, the characters it does
+    // not share with the key before it. Every node but the root has one incoming edge.
+    size_t nodeCount = 1;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        std::string_view key = keys[i].first, prev = i ? keys[i - 1].first : std::string_view();
+        size_t shared = 0;
+        while (shared < key.size() && shared < prev.size() && key[shared] == prev[shared])
+            shared++;
+        nodeCount += key.size() - shared;
+    }
+    // exact sizes up front, so building makes no growth copies
+    auto fresh = [](auto &v, size_t n)
+    {
+        std::decay_t<decltype(v)>().swap(v);
+        v.reserve(n);
+    };
+    fresh(nodes, nodeCount);
+    fresh(labels, nodeCount - 1);
+    fresh(targets, nodeCount - 1);
+    fresh(leaves, keys.size());
+    buildNode(keys, 0, keys.size(), 0);
+    keyChars.clear();
+    keyChars.shrink_to_fit();
+    buildTopLists();
+}
+
+void Trie::rerank(std::string_view key)
+{
+    path.clear();
+    int64_t n = nodes.empty() ? -1 : 0;
+    for (size_t i = 0; n >= 0; i++)
+    {
+        path.push_back(static_cast<uint32_t>(n));
+        if (i == key.size())
+            break;
+        n = child(static_cast<uint32_t>(n), key[i]);
+    }
+    if (n < 0)
+        return;
+    for (size_t i = path.size(); i-- > 0;)
+    {
+        rankCandidates(path[i]);
+        winners.clear();
+        selectTop(winners);
+        Node &node = nodes[path[i]];
+        std::copy(winners.begin(), winners.end(), ranked.begin() + node.topBegin);
+    }
+}
+
+std::vector<Asset *> Trie::search(const std::string &prefix, int max) const
+{
+    std::vector<Asset *> res;
+    int64_t n = find(prefix);
+    if (n < 0)
+        return res;
+    const Node &node = nodes[static_cast<size_t>(n)];
+    size_t count = std::min<size_t>(node.assetEnd - node.assetBegin, static_cast<size_t>(std::max(max, 0)));
+    res.assign(leaves.begin() + node.assetBegin, leaves.begin() + node.assetBegin + count);
+    return res;
+}
+
+void Trie::top(const std::string &prefix, size_t k, int typeId, std::vector<Asset *> &res) const
+{
+    SearchStats &stats = lastSearch();
+    stats = {static_cast<uint32_t>(prefix.size()), 0};
+    res.clear();
+    int64_t n = find(prefix);
+    if (n < 0)
+        return;
+    const Node &node = nodes[static_cast<size_t>(n)];
+    for (uint32_t i = node.topBegin; i < node.topBegin + node.topCount && res.size() < k; i++)
+    {
+        stats.candidates++;
+        Asset *a = ranked[i];
+        if (typeId != kAnyType && a->typeId != typeId)
+            continue;
+        // the list keeps one entry per (symbol, type); across types keep the best
+        if (typeId == kAnyType && std::any_of(res.begin(), res.end(), [a](const Asset *r)
+                                        { return r->symbol == a->symbol; }))
+            continue;
+        res.push_back(a);
+    }
+}
+
+uint32_t Trie::fuzzyRow(FuzzyWalk &w, size_t depth, unsigned char ch)
+{
+    const size_t m = w.query.size();
+    const uint64_t mask = m == 64 ? ~0ull : (1ull << m) - 1;
+    const FuzzyRow &up = w.rows[depth - 1];
+    FuzzyRow &row = w.rows[depth];
+    const uint64_t eq = w.peq[ch];
+    const uint64_t x = eq | up.vn;
+    const uint64_t swap = depth > 1 ? ((~up.d0 & eq) << 1) & w.peq[up.ch] : 0;
+    const uint64_t d0 = (((x & up.vp) + up.vp) ^ up.vp) | x | swap;
+    const uint64_t hp = up.vn | ~(up.vp | d0);
+    const uint64_t hn = up.vp & d0;
+    const uint64_t shifted = (hp << 1) | 1; // the empty query prefix costs depth
+    row.vp = ((hn << 1) | ~(shifted | d0)) & mask;
+    row.vn = shifted & d0 & mask;
+    row.d0 = d0 & mask;
+    row.ch = ch;
+    row.last = up.last + static_cast<uint32_t>((hp >> (m - 1)) & 1) - static_cast<uint32_t>((hn >> (m - 1)) & 1);
+
+    size_t lo = 0;
+    if (depth <= w.maxEdits)
+    {
+        row.edge = static_cast<uint32_t>(depth);
+    }
+    else
+    {
+        lo = depth - w.maxEdits;
+        if (lo > m)
+            return UINT32_MAX;
+        row.edge = up.edge + static_cast<uint32_t>(~(row.d0 >> (lo - 1)) & 1);
+    }
+    // the band is at most 2 * kMaxFuzzyEdits = 4 steps right of its edge
+    const uint64_t bits = (1ull << (std::min(m, depth + w.maxEdits) - lo)) - 1;
+    const uint64_t rise = (row.vp >> lo) & bits, fall = (row.vn >> lo) & bits;
+    return row.edge - bandDip(static_cast<unsigned>(fall << 4 | rise));
+}
+
+unsigned Trie::bandDip(unsigned steps)
+{
+    static const auto table = []
+    {
+        std::array<unsigned char, 256> dip{};
+        for (unsigned i = 0; i < 256; i++)
+        {
+            int cell = 0, low = 0;
+            for (unsigned j = 0; j < 4; j++)
+            {
+                cell += static_cast<int>((i >> j) & 1) - static_cast<int>((i >> (4 + j)) & 1);
+                low = std::min(low, cell);
+            }
+            dip[i] = static_cast<unsigned char>(-low);
+        }
+        return dip;
+    }();
+    return table[steps];
+}
+
+void Trie::fuzzyEdge(FuzzyWalk &w, uint32_t e, size_t depth, uint32_t covered) const
+{
+    uint32_t best = fuzzyRow(w, depth + 1, labels[e]);
+    uint32_t last = w.rows[depth + 1].last;
+    w.deepest = std::max(w.deepest, static_cast<uint32_t>(depth + 1));
+    if (last <= w.maxEdits && last < covered)
+    {
+        w.hits.emplace_back(last, targets[e]);
+        covered = last;
+    }
+    // cells never shrink going down, so the row minimum bounds every match below;
+    // this also keeps depth under query.size() + maxEdits + 2
+    if (best <= w.maxEdits && best < covered)
+    {
+        const Node &node = nodes[targets[e]];
+        for (uint32_t c = node.firstEdge; c < node.firstEdge + node.edgeCount; c++)
+            fuzzyEdge(w, c, depth + 1, covered);
+    }
+}
+
+void Trie::mergeLists(const std::pair<uint32_t, uint32_t> *first, const std::pair<uint32_t, uint32_t> *last, size_t k,
+                      int typeId, std::vector<Asset *> &res) const
+{
+    struct Cursor
+    {
+        double rank;
+        uint32_t at, end; // next entry is ranked[at]
+    };
+    static thread_local std::vector<Cursor> heap;
+    // the lists' own order: rank descending, then address
+    auto after = [this](const Cursor &a, const Cursor &b)
+    { return a.rank != b.rank ? a.rank < b.rank : ranked[a.at] > ranked[b.at]; };
+    heap.clear();
+    for (auto hit = first; hit != last; ++hit)
+    {
+        const Node &node = nodes[hit->second];
+        if (node.topCount)
+            heap.push_back({rank(*ranked[node.topBegin]), node.topBegin, node.topBegin + node.topCount});
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+    uint32_t &candidates = lastSearch().candidates;
+    while (!heap.empty() && res.size() < k)
+    {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        Cursor &c = heap.back();
+        candidates++;
+        Asset *a = ranked[c.at];
+        // an asset reached under several keys, or at a smaller distance, is already in
+        if ((typeId == kAnyType || a->typeId == typeId) &&
+            std::none_of(res.begin(), res.end(), [a](const Asset *r) { return r->symbol == a->symbol; }))
+            res.push_back(a);
+        if (++c.at < c.end)
+        {
+            c.rank = rank(*ranked[c.at]);
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+        else
+        {
+            heap.pop_back();
+        }
+    }
+}
+
+void Trie::fuzzyTop(std::string_view query, uint32_t maxEdits, size_t k, int typeId, std::vector<Asset *> &res,
+                    std::vector<uint32_t> *distances) const
+{
+    static thread_local FuzzyWalk w;
+    maxEdits = std::min(maxEdits, kMaxFuzzyEdits);
+    lastSearch() = {0, 0};
+    w.deepest = 0;
+    res.clear();
+    if (nodes.empty())
+        return;
+    for (unsigned char ch : w.query) // clear the previous query's masks
+        w.peq[ch] = 0;
+    w.query.clear();
+    for (size_t i = 0; i < query.size() && i < kMaxFuzzyQuery; i++)
+        w.query.push_back(static_cast<char>(lower(query[i])));
+    const size_t m = w.query.size();
+    for (size_t j = 0; j < m; j++)
+        w.peq[static_cast<unsigned char>(w.query[j])] |= 1ull << j;
+    w.rows.resize(m + maxEdits + 2);
+    w.rows[0] = {m == 64 ? ~0ull : (1ull << m) - 1, 0, 0, static_cast<uint32_t>(m), 0, 0};
+
+    // results are ordered by distance first, so once k of them are within e edits no
+    // match needing more can get in; the walk's cost grows steeply with its budget
+    for (uint32_t edits = 0; edits <= maxEdits && res.size() < k; edits++)
+    {
+        w.maxEdits = edits;
+        w.hits.clear();
+        uint32_t covered = UINT32_MAX;
+        if (m <= edits) // the root, i.e. everything, is within reach; closer matches may be below
+            w.hits.emplace_back(covered = static_cast<uint32_t>(m), 0);
+        // every child of the root, so a typo in the first character is found too; under a
+        // wrong first letter the band has spent an edit already and is cut soon after
+        const Node &root = nodes[0];
+        for (uint32_t e = root.firstEdge; covered > 0 && m > 0 && e < root.firstEdge + root.edgeCount; e++)
+            fuzzyEdge(w, e, 0, covered);
+        std::sort(w.hits.begin(), w.hits.end());
+        res.clear();
+        if (distances)
+            distances->clear();
+        for (size_t first = 0, last; first < w.hits.size() && res.size() < k; first = last)
+        {
+            for (last = first; last < w.hits.size() && w.hits[last].first == w.hits[first].first; last++)
+                ;
+            mergeLists(w.hits.data() + first, w.hits.data() + last, k, typeId, res);
+            if (distances)
+                distances->resize(res.size(), w.hits[first].first);
+        }
+    }
+    lastSearch().depth = w.deepest;
+}
+
+void Trie::save(BinaryWriter &w, const Asset *base) const
+{
+    std::vector<uint32_t> index;
+    auto indices = [&](const std::vector<Asset *> &v)
+    {
+        index.clear();
+        for (const Asset *a : v)
+            index.push_back(static_cast<uint32_t>(a - base));
+        w.array(index.data(), index.size());
+    };
+    w.array(nodes.data(), nodes.size());
+    w.array(labels.data(), labels.size());
+    w.array(targets.data(), targets.size());
+    indices(leaves);
+    indices(ranked);
+}
+
+bool Trie::load(BinaryReader &r, Asset *base, size_t count)
+{
+    const Node *n;
+    const unsigned char *l;
+    const uint32_t *t, *leaf, *rank;
+    size_t nn, nl, nt, nleaf, nrank;
+    if (!r.array(n, nn) || !r.array(l, nl) || !r.array(t, nt) || !r.array(leaf, nleaf) || !r.array(rank, nrank))
+        return false;
+    if (nl != nt || nn == 0)
+        return false;
+    for (size_t i = 0; i < nt; i++)
+        if (t[i] >= nn)
+            return false;
+    for (size_t i = 0; i < nn; i++)
+        if (static_cast<size_t>(n[i].firstEdge) + n[i].edgeCount > nl || n[i].assetEnd > nleaf ||
+            n[i].assetBegin > n[i].assetEnd || static_cast<size_t>(n[i].topBegin) + n[i].topCount > nrank)
+            return false;
+    nodes.assign(n, n + nn);
+    labels.assign(l, l + nl);
+    targets.assign(t, t + nt);
+    leaves.resize(nleaf);
+    ranked.resize(nrank);
+    for (size_t i = 0; i < nleaf; i++)
+    {
+        if (leaf[i] >= count)
+            return false;
+        leaves[i] = base + leaf[i];
+    }
+    for (size_t i = 0; i < nrank; i++)
+    {
+        if (rank[i] >= count)
+            return false;
+        ranked[i] = base + rank[i];
+    }
+    return true;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "common.h"
+
+// Prefix index frozen into contiguous arrays. Nodes are laid out depth-first with
+// children sorted by label, so every subtree's assets form one contiguous range of
+// `leaves` and a prefix search is a descent plus a copy. insert() stages keys;
+// they become searchable after build().
+//
+// Each node also keeps a ranked, symbol-deduplicated list holding the best kTopK
+// symbols of every asset type in its subtree, so top() answers "best k under this
+// prefix" without visiting the subtree.
+class Trie
+{
+public:
+    static constexpr size_t kTopK = 50;
+    using RankFn = std::function<double(const Asset &)>;
+
+private:
+    struct Node
+    {
+        uint32_t firstEdge;  // children live in labels/targets[firstEdge, firstEdge + edgeCount)
+        uint32_t edgeCount;
+        uint32_t assetBegin; // subtree's assets are leaves[assetBegin, assetEnd)
+        uint32_t assetEnd;
+        uint32_t topBegin;   // ranked list is ranked[topBegin, topBegin + topCount)
+        uint32_t topCount;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned char> labels;
+    std::vector<uint32_t> targets;
+    std::vector<Asset *> leaves;
+    std::vector<Asset *> ranked;
+    struct Staged
+    {
+        uint32_t offset, length; // key is keyChars[offset, offset + length)
+        Asset *asset;
+    };
+    std::string keyChars; // lowercased staged keys, back to back
+    std::vector<Staged> pending;
+    RankFn rank;
+    std::vector<std::pair<double, Asset *>> scratch;
+    std::vector<size_t> perType;
+    std::vector<uint32_t> path;   // rerank's walk, kept for its capacity
+    std::vector<Asset *> winners; // one node's new list
+    using Keys = std::pmr::vector<std::pair<std::string_view, Asset *>>;
+
+    static unsigned char lower(char ch)
+    {
+        return static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(ch)));
+    }
+
+    void stage(std::string_view key, Asset *asset, std::pmr::vector<Staged> &out)
+    {
+        out.push_back({static_cast<uint32_t>(keyChars.size()), static_cast<uint32_t>(key.size()), asset});
+        keyChars.append(key);
+    }
+
+    // enumerate (key, asset) pairs already frozen into the arrays
+    void collectKeys(uint32_t n, std::pmr::string &key, std::pmr::vector<Staged> &out);
+
+    // keys[lo, hi) are sorted and share their first `depth` characters
+    uint32_t buildNode(const Keys &keys, size_t lo, size_t hi, size_t depth);
+
+    uint32_t ownEnd(const Node &node) const
+    {
+        return node.edgeCount ? nodes[targets[node.firstEdge]].assetBegin : node.assetEnd;
+    }
+
+    // candidates are the node's own assets plus its children's lists, which already
+    // hold every symbol that can make this node's per-type top kTopK
+    void rankCandidates(uint32_t n);
+
+    // appends the winners of scratch to out: best asset per (symbol, type), at most kTopK per type
+    void selectTop(std::vector<Asset *> &out);
+
+public:
+    // recompute every list, e.g. after a change that moved many scores at once
+    void buildTopLists();
+
+private:
+    // index of n's edge labelled ch, or -1
+    int64_t edge(uint32_t n, char ch) const
+    {
+        const Node &node = nodes[n];
+        auto first = labels.begin() + node.firstEdge;
+        auto last = first + node.edgeCount;
+        auto it = std::lower_bound(first, last, lower(ch));
+        if (it == last || *it != lower(ch))
+            return -1;
+        return it - labels.begin();
+    }
+
+    int64_t child(uint32_t n, char ch) const
+    {
+        int64_t e = edge(n, ch);
+        if (e < 0)
+            return -1;
+        return targets[static_cast<size_t>(e)];
+    }
+
+    int64_t find(const std::string &prefix) const
+    {
+        int64_t cur = nodes.empty() ? -1 : 0;
+        for (size_t i = 0; i < prefix.size() && cur >= 0; i++)
+            cur = child(static_cast<uint32_t>(cur), prefix[i]);
+        return cur;
+    }
+
+public:
+    explicit Trie(RankFn rankFn) : rank(std::move(rankFn)) {}
+
+    void insert(std::string_view word, Asset *asset)
+    {
+        pending.push_back({static_cast<uint32_t>(keyChars.size()), static_cast<uint32_t>(word.size()), asset});
+        for (char ch : word)
+            keyChars.push_back(static_cast<char>(lower(ch)));
+    }
+
+    // merge staged keys into the frozen arrays. The build's own scratch (the key lists and
+    // the walk over the old arrays) comes from one arena, sized up front and dropped in one
+    // go at the end.
+    void build();
+
+    // call after the score of an asset inserted under `key` changed. Only the lists on
+    // the path to that key can change, and their lengths stay fixed: they depend on how
+    // many distinct symbols each subtree holds, not on scores.
+    void rerank(std::string_view key);
+
+    std::vector<Asset *> search(const std::string &prefix, int max = 20) const;
+
+    static constexpr int kAnyType = -1;
+
+    // best k (<= kTopK) distinct symbols under prefix, restricted to one type id unless kAnyType;
+    // res is cleared first so callers can reuse its capacity
+    void top(const std::string &prefix, size_t k, int typeId, std::vector<Asset *> &res) const;
+
+private:
+    // One row of the edit-distance table between query and the key prefix spelled by
+    // the path, bit-parallel (Myers, with Hyyro's transposition term): bit j of vp / vn
+    // is set when the cell for query[0, j + 1) is one more / one less than the cell to
+    // its left.
+    struct FuzzyRow
+    {
+        uint64_t vp, vn, d0; // d0: the cell equals the one diagonally above-left
+        uint32_t last;       // distance to the whole query
+        uint32_t edge;       // cell at the left edge of the band, see fuzzyRow()
+        unsigned char ch;    // label that led here
+    };
+
+    struct FuzzyWalk
+    {
+        std::string query;                               // lowercased, at most kMaxFuzzyQuery chars
+        uint64_t peq[256];                               // bit j set where query[j] is that char
+        uint32_t maxEdits;
+        std::vector<FuzzyRow> rows;                      // by depth
+        std::vector<std::pair<uint32_t, uint32_t>> hits; // (distance, node)
+        uint32_t deepest;
+    };
+
+    // fills rows[depth] for a path ending in ch and returns its smallest cell. Cells are
+    // at least |depth - j|, so only the band j in [depth - maxEdits, depth + maxEdits] can
+    // be small; its left edge moves one column per row, down the diagonal d0 describes.
+    static uint32_t fuzzyRow(FuzzyWalk &w, size_t depth, unsigned char ch);
+
+    // how far a walk of four steps dips below its start; bit j of the low nibble of
+    // steps is a +1 step, of the high nibble a -1 step
+    static unsigned bandDip(unsigned steps);
+
+    // scores the child behind edge e of a node at `depth` from its label alone, records it
+    // if it matches more cheaply than `covered`, the best match already recorded on the
+    // path, and descends, touching the child's node, while something below still can. A
+    // node whose key prefix matches stands for its whole subtree.
+    void fuzzyEdge(FuzzyWalk &w, uint32_t e, size_t depth, uint32_t covered) const;
+
+    // appends the best of the matched nodes' ranked lists to res until it holds k, merging
+    // them by rank so only the entries taken are looked at; as in top(), a node's list holds
+    // every symbol that can make a top kTopK below it
+    void mergeLists(const std::pair<uint32_t, uint32_t> *first, const std::pair<uint32_t, uint32_t> *last, size_t k,
+                    int typeId, std::vector<Asset *> &res) const;
+
+public:
+    // what the last top() or fuzzyTop() on this thread walked: how deep into the trie it
+    // went (the prefix length for top()) and how many ranked-list entries it looked at
+    struct SearchStats
+    {
+        uint32_t depth, candidates;
+    };
+
+    static SearchStats &lastSearch()
+    {
+        static thread_local SearchStats stats{0, 0};
+        return stats;
+    }
+
+    static constexpr size_t kMaxFuzzyQuery = 64; // longer queries are cut
+    static constexpr uint32_t kMaxFuzzyEdits = 2;
+
+    // typos tolerated in a query of this length: none below 4 characters, one from 4, two
+    // from 8. One typo in a 3-character prefix already reaches a large part of the
+    // universe, so short queries only match exactly.
+    static uint32_t typoBudget(size_t length) { return length >= 8 ? 2 : length >= 4 ? 1 : 0; }
+
+    // like top(), for keys that start with something within maxEdits (<= kMaxFuzzyEdits)
+    // insertions, deletions, substitutions or adjacent swaps of query, anywhere in it, the
+    // first character included; closest first, then by rank. distances, if given, gets
+    // each result's edit count.
+    void fuzzyTop(std::string_view query, uint32_t maxEdits, size_t k, int typeId, std::vector<Asset *> &res,
+                  std::vector<uint32_t> *distances = nullptr) const;
+
+    // re-points every asset pointer after the assets were copied from `from` to `to`
+    void rebase(const Asset *from, Asset *to)
+    {
+        for (auto &p : leaves)
+            p = to + (p - from);
+        for (auto &p : ranked)
+            p = to + (p - from);
+        for (auto &k : pending)
+            k.asset = to + (k.asset - from);
+    }
+
+    // writes the frozen arrays, asset pointers as indices from base; staged keys are not saved
+    void save(BinaryWriter &w, const Asset *base) const;
+
+    // the inverse of save(); false if the arrays are inconsistent with count assets
+    bool load(BinaryReader &r, Asset *base, size_t count);
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    size_t memoryBytes() const
+    {
+        return sizeof(*this) + nodes.capacity() * sizeof(Node) + labels.capacity() +
+               targets.capacity() * sizeof(uint32_t) + (leaves.capacity() + ranked.capacity()) * sizeof(Asset *);
+    }
+};